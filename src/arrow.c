@@ -0,0 +1,867 @@
+/* FMP Tools - A library for reading FileMaker Pro databases
+ * Copyright (c) 2020 Evan Miller (except where otherwise noted)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/* Columnar export through the Arrow C data interface.
+ *
+ * Values are collected per table until a row is complete and then appended
+ * to one builder per column. Once a batch holds batch_rows rows, the
+ * builders' buffers are handed over to a struct ArrowArray as they are, so
+ * nothing is copied after the value is first stored.
+ *
+ * Every column is utf8 by default, or dictionary<int32, utf8> with
+ * FMP_ARROW_DICTIONARY, in which case each batch has its own dictionary.
+ * With FMP_ARROW_TYPED_VALUES, number, date, time and timestamp columns
+ * become float64, date32, time64[us] and timestamp[us] instead. FileMaker
+ * doesn't enforce field types, so values that don't parse as the column's
+ * type are then written as null, and fmp_read_all_arrow reports how many
+ * per column. */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+
+#include "fmp.h"
+#include "fmp_arrow.h"
+#include "fmp_internal.h"
+
+#define DEFAULT_BATCH_ROWS 65536
+/* String offsets are int32, so a batch's string bytes per column can't
+ * go past this */
+#define MAX_STRING_BYTES INT32_MAX
+
+typedef enum {
+    ARROW_UTF8,
+    ARROW_DICTIONARY,
+    ARROW_FLOAT64,
+    ARROW_DATE32,
+    ARROW_TIME64,
+    ARROW_TIMESTAMP
+} arrow_type_t;
+
+typedef struct arrow_buffer_s {
+    uint8_t *data;
+    size_t len;
+    size_t capacity;
+} arrow_buffer_t;
+
+typedef struct arrow_column_builder_s {
+    arrow_type_t type;
+    arrow_buffer_t validity;
+    arrow_buffer_t values;      /* Fixed-width values, string offsets or dictionary indices */
+    arrow_buffer_t data;        /* String bytes */
+    int64_t null_count;
+    size_t unparsed_values;     /* Values that didn't parse as the type */
+
+    /* Dictionary entries seen in the current batch, kept in an open
+     * addressing table of entry numbers plus one */
+    arrow_buffer_t dict_offsets;
+    arrow_buffer_t dict_data;
+    int32_t dict_count;
+    int32_t *dict_slots;
+    size_t dict_capacity;
+} arrow_column_builder_t;
+
+typedef struct arrow_field_s {
+    size_t offset;
+    size_t len;
+    int set;
+} arrow_field_t;
+
+typedef struct arrow_table_builder_s {
+    int table_index;
+    fmp_column_array_t *columns;
+    int *positions;             /* Column position by column index */
+    size_t num_indexes;
+    arrow_column_builder_t *builders;
+    int64_t length;
+    size_t batch_rows;
+
+    /* The row being collected */
+    int last_row;
+    arrow_field_t *fields;
+    arrow_buffer_t row_values;
+} arrow_table_builder_t;
+
+typedef struct arrow_array_private_s {
+    const void *buffers[3];
+    struct ArrowArray **children;
+    struct ArrowArray *child_arrays;
+    struct ArrowArray dictionary;
+} arrow_array_private_t;
+
+typedef struct arrow_schema_private_s {
+    char *format;
+    char *name;
+    struct ArrowSchema **children;
+    struct ArrowSchema *child_schemas;
+    struct ArrowSchema dictionary;
+} arrow_schema_private_t;
+
+static int buffer_reserve(arrow_buffer_t *b, size_t extra) {
+    if (b->len + extra <= b->capacity)
+        return 0;
+    size_t capacity = b->capacity ? b->capacity : 64;
+    while (capacity < b->len + extra)
+        capacity *= 2;
+    uint8_t *data = realloc(b->data, capacity);
+    if (!data)
+        return -1;
+    b->data = data;
+    b->capacity = capacity;
+    return 0;
+}
+
+static int buffer_append(arrow_buffer_t *b, const void *data, size_t len) {
+    if (len == 0)
+        return 0;
+    if (buffer_reserve(b, len) != 0)
+        return -1;
+    memcpy(b->data + b->len, data, len);
+    b->len += len;
+    return 0;
+}
+
+/* Gives up the buffer's memory, which then belongs to an ArrowArray */
+static void *buffer_take(arrow_buffer_t *b) {
+    void *data = b->data;
+    memset(b, 0, sizeof(arrow_buffer_t));
+    return data;
+}
+
+static arrow_type_t arrow_type(fmp_column_t *column, int flags) {
+    if ((flags & FMP_ARROW_TYPED_VALUES) && !(flags & FMP_ARROW_TEXT_VALUES)) {
+        switch (column->type) {
+        case FMP_COLUMN_TYPE_NUMBER: return ARROW_FLOAT64;
+        case FMP_COLUMN_TYPE_DATE: return ARROW_DATE32;
+        case FMP_COLUMN_TYPE_TIME: return ARROW_TIME64;
+        case FMP_COLUMN_TYPE_TIMESTAMP: return ARROW_TIMESTAMP;
+        default: break;
+        }
+    }
+    return (flags & FMP_ARROW_DICTIONARY) ? ARROW_DICTIONARY : ARROW_UTF8;
+}
+
+static const char *arrow_format(arrow_type_t type) {
+    switch (type) {
+    case ARROW_DICTIONARY: return "i";
+    case ARROW_FLOAT64: return "g";
+    case ARROW_DATE32: return "tdD";
+    case ARROW_TIME64: return "ttu";
+    case ARROW_TIMESTAMP: return "tsu:";
+    default: return "u";
+    }
+}
+
+static size_t fixed_width(arrow_type_t type) {
+    switch (type) {
+    case ARROW_UTF8: return sizeof(int32_t);
+    case ARROW_DICTIONARY: return sizeof(int32_t);
+    case ARROW_DATE32: return sizeof(int32_t);
+    default: return sizeof(int64_t);
+    }
+}
+
+/* Days since 1970-01-01 in the proleptic Gregorian calendar */
+static int64_t days_from_civil(int year, int month, int day) {
+    year -= month <= 2;
+    int64_t era = (year >= 0 ? year : year - 399) / 400;
+    int64_t yoe = year - era * 400;
+    int64_t doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+static int64_t time_usec(const fmp_value_t *value) {
+    return ((value->hour * 60 + value->minute) * 60 + value->second) * (int64_t)1000000 + value->usec;
+}
+
+static int builder_begin_row(arrow_column_builder_t *b, int64_t row) {
+    if ((row % 8) == 0) {
+        uint8_t zero = 0;
+        if (buffer_append(&b->validity, &zero, 1) != 0)
+            return -1;
+    }
+    if ((b->type == ARROW_UTF8) && b->values.len == 0) {
+        int32_t zero = 0;
+        return buffer_append(&b->values, &zero, sizeof(zero));
+    }
+    return 0;
+}
+
+static int append_null(arrow_column_builder_t *b, int64_t row) {
+    if (builder_begin_row(b, row) != 0)
+        return -1;
+    b->null_count++;
+    if (b->type == ARROW_UTF8) {
+        int32_t offset = b->data.len;
+        return buffer_append(&b->values, &offset, sizeof(offset));
+    }
+    uint8_t zero[8] = { 0 };
+    return buffer_append(&b->values, zero, fixed_width(b->type));
+}
+
+static int append_valid(arrow_column_builder_t *b, int64_t row, const void *value, size_t len) {
+    if (builder_begin_row(b, row) != 0)
+        return -1;
+    b->validity.data[row / 8] |= 1 << (row % 8);
+    return buffer_append(&b->values, value, len);
+}
+
+static int append_string(arrow_column_builder_t *b, int64_t row, const char *s, size_t len) {
+    if (len > MAX_STRING_BYTES - b->data.len || buffer_append(&b->data, s, len) != 0)
+        return -1;
+    int32_t offset = b->data.len;
+    return append_valid(b, row, &offset, sizeof(offset));
+}
+
+static int dictionary_grow(arrow_column_builder_t *b) {
+    size_t capacity = b->dict_capacity ? 2 * b->dict_capacity : 256;
+    int32_t *slots = calloc(capacity, sizeof(int32_t));
+    if (!slots)
+        return -1;
+    const int32_t *offsets = (const int32_t *)b->dict_offsets.data;
+    for (int32_t i = 0; i < b->dict_count; i++) {
+        uint64_t h = hash64(b->dict_data.data + offsets[i], offsets[i+1] - offsets[i], 0);
+        size_t slot = h & (capacity - 1);
+        while (slots[slot])
+            slot = (slot + 1) & (capacity - 1);
+        slots[slot] = i + 1;
+    }
+    free(b->dict_slots);
+    b->dict_slots = slots;
+    b->dict_capacity = capacity;
+    return 0;
+}
+
+static int append_dictionary(arrow_column_builder_t *b, int64_t row, const char *s, size_t len) {
+    if (2 * (b->dict_count + 1) > b->dict_capacity && dictionary_grow(b) != 0)
+        return -1;
+
+    const int32_t *offsets = (const int32_t *)b->dict_offsets.data;
+    size_t slot = hash64((const uint8_t *)s, len, 0) & (b->dict_capacity - 1);
+    while (b->dict_slots[slot]) {
+        int32_t i = b->dict_slots[slot] - 1;
+        if (offsets[i+1] - offsets[i] == len && memcmp(b->dict_data.data + offsets[i], s, len) == 0)
+            return append_valid(b, row, &i, sizeof(i));
+        slot = (slot + 1) & (b->dict_capacity - 1);
+    }
+
+    int32_t i = b->dict_count;
+    if (len > MAX_STRING_BYTES - b->dict_data.len)
+        return -1;
+    if (b->dict_offsets.len == 0) {
+        int32_t zero = 0;
+        if (buffer_append(&b->dict_offsets, &zero, sizeof(zero)) != 0)
+            return -1;
+    }
+    if (buffer_append(&b->dict_data, s, len) != 0)
+        return -1;
+    int32_t end = b->dict_data.len;
+    if (buffer_append(&b->dict_offsets, &end, sizeof(end)) != 0)
+        return -1;
+    b->dict_slots[slot] = ++b->dict_count;
+    return append_valid(b, row, &i, sizeof(i));
+}
+
+static int append_value(arrow_column_builder_t *b, fmp_column_t *column, int64_t row,
+        const char *s, size_t len) {
+    fmp_value_t value;
+    int64_t v64;
+    int32_t v32;
+
+    switch (b->type) {
+    case ARROW_UTF8:
+        return append_string(b, row, s, len);
+    case ARROW_DICTIONARY:
+        return append_dictionary(b, row, s, len);
+    case ARROW_FLOAT64:
+        if (fmp_parse_value(column->type, s, &value) == FMP_VALUE_TEXT)
+            break;
+        return append_valid(b, row, &value.real, sizeof(value.real));
+    case ARROW_DATE32:
+        if (fmp_parse_value(column->type, s, &value) != FMP_VALUE_DATE)
+            break;
+        v32 = days_from_civil(value.year, value.month, value.day);
+        return append_valid(b, row, &v32, sizeof(v32));
+    case ARROW_TIME64:
+        if (fmp_parse_value(column->type, s, &value) != FMP_VALUE_TIME)
+            break;
+        v64 = time_usec(&value);
+        return append_valid(b, row, &v64, sizeof(v64));
+    case ARROW_TIMESTAMP:
+        if (fmp_parse_value(column->type, s, &value) != FMP_VALUE_TIMESTAMP)
+            break;
+        v64 = days_from_civil(value.year, value.month, value.day) * 86400 * (int64_t)1000000 + time_usec(&value);
+        return append_valid(b, row, &v64, sizeof(v64));
+    }
+    if (len)
+        b->unparsed_values++;
+    return append_null(b, row);
+}
+
+static void release_array(struct ArrowArray *array) {
+    arrow_array_private_t *private_data = (arrow_array_private_t *)array->private_data;
+    for (int64_t i = 0; i < array->n_children; i++) {
+        if (array->children[i]->release)
+            array->children[i]->release(array->children[i]);
+    }
+    if (array->dictionary && array->dictionary->release)
+        array->dictionary->release(array->dictionary);
+    for (int64_t i = 0; i < array->n_buffers; i++)
+        free((void *)private_data->buffers[i]);
+    free(private_data->children);
+    free(private_data->child_arrays);
+    free(private_data);
+    array->release = NULL;
+}
+
+static int init_array(struct ArrowArray *array, int64_t length, int64_t n_buffers, int64_t n_children) {
+    arrow_array_private_t *private_data = calloc(1, sizeof(arrow_array_private_t));
+    if (!private_data)
+        return -1;
+    memset(array, 0, sizeof(struct ArrowArray));
+    array->length = length;
+    array->n_buffers = n_buffers;
+    array->buffers = private_data->buffers;
+    array->private_data = private_data;
+    array->release = &release_array;
+    if (n_children) {
+        private_data->children = calloc(n_children, sizeof(struct ArrowArray *));
+        private_data->child_arrays = calloc(n_children, sizeof(struct ArrowArray));
+        if (!private_data->children || !private_data->child_arrays) {
+            release_array(array);
+            return -1;
+        }
+        array->children = private_data->children;
+    }
+    return 0;
+}
+
+/* Moves the column's buffers into child, leaving the builder empty */
+static int finish_column(arrow_column_builder_t *b, int64_t length, struct ArrowArray *child) {
+    int64_t n_buffers = b->type == ARROW_UTF8 ? 3 : 2;
+    if (init_array(child, length, n_buffers, 0) != 0)
+        return -1;
+    arrow_array_private_t *private_data = (arrow_array_private_t *)child->private_data;
+    child->null_count = b->null_count;
+    if (b->null_count) {
+        private_data->buffers[0] = buffer_take(&b->validity);
+    } else {
+        free(buffer_take(&b->validity));
+    }
+    private_data->buffers[1] = buffer_take(&b->values);
+    if (b->type == ARROW_UTF8)
+        private_data->buffers[2] = buffer_take(&b->data);
+    b->null_count = 0;
+
+    if (b->type == ARROW_DICTIONARY) {
+        struct ArrowArray *dictionary = &private_data->dictionary;
+        if (init_array(dictionary, b->dict_count, 3, 0) != 0)
+            return -1;
+        arrow_array_private_t *dictionary_data = (arrow_array_private_t *)dictionary->private_data;
+        if (b->dict_offsets.len == 0) {
+            int32_t zero = 0;
+            if (buffer_append(&b->dict_offsets, &zero, sizeof(zero)) != 0)
+                return -1;
+        }
+        dictionary_data->buffers[1] = buffer_take(&b->dict_offsets);
+        dictionary_data->buffers[2] = buffer_take(&b->dict_data);
+        child->dictionary = dictionary;
+        b->dict_count = 0;
+        if (b->dict_slots)
+            memset(b->dict_slots, 0, b->dict_capacity * sizeof(int32_t));
+    }
+    return 0;
+}
+
+static int finish_batch(arrow_table_builder_t *t, struct ArrowArray *batch) {
+    size_t count = t->columns->count;
+    if (init_array(batch, t->length, 1, count) != 0)
+        return -1;
+    arrow_array_private_t *private_data = (arrow_array_private_t *)batch->private_data;
+    batch->n_children = count;
+    for (size_t i = 0; i < count; i++) {
+        struct ArrowArray *child = &private_data->child_arrays[i];
+        private_data->children[i] = child;
+        if (finish_column(&t->builders[i], t->length, child) != 0) {
+            batch->n_children = i + (child->release != NULL);
+            release_array(batch);
+            return -1;
+        }
+    }
+    t->length = 0;
+    return 0;
+}
+
+static int table_builder_init(arrow_table_builder_t *t, int table_index,
+        fmp_column_array_t *columns, size_t batch_rows, int flags) {
+    memset(t, 0, sizeof(arrow_table_builder_t));
+    t->table_index = table_index;
+    t->columns = columns;
+    t->batch_rows = batch_rows ? batch_rows : DEFAULT_BATCH_ROWS;
+    for (size_t i = 0; i < columns->count; i++) {
+        if (columns->columns[i].index >= t->num_indexes)
+            t->num_indexes = columns->columns[i].index + 1;
+    }
+    t->positions = malloc(t->num_indexes * sizeof(int));
+    t->builders = calloc(columns->count, sizeof(arrow_column_builder_t));
+    t->fields = calloc(columns->count, sizeof(arrow_field_t));
+    if (!t->positions || !t->builders || !t->fields)
+        return -1;
+    for (size_t i = 0; i < t->num_indexes; i++)
+        t->positions[i] = -1;
+    for (size_t i = 0; i < columns->count; i++) {
+        t->positions[columns->columns[i].index] = i;
+        t->builders[i].type = arrow_type(&columns->columns[i], flags);
+    }
+    return 0;
+}
+
+static void table_builder_free(arrow_table_builder_t *t) {
+    for (size_t i = 0; t->builders && i < t->columns->count; i++) {
+        arrow_column_builder_t *b = &t->builders[i];
+        free(b->validity.data);
+        free(b->values.data);
+        free(b->data.data);
+        free(b->dict_offsets.data);
+        free(b->dict_data.data);
+        free(b->dict_slots);
+    }
+    free(t->builders);
+    free(t->positions);
+    free(t->fields);
+    free(t->row_values.data);
+}
+
+/* Whether the collected row's strings still fit the batch's offsets */
+static int row_fits(arrow_table_builder_t *t) {
+    for (size_t i = 0; i < t->columns->count; i++) {
+        arrow_column_builder_t *b = &t->builders[i];
+        size_t used = b->type == ARROW_UTF8 ? b->data.len
+            : b->type == ARROW_DICTIONARY ? b->dict_data.len : 0;
+        if (t->fields[i].set && t->fields[i].len > MAX_STRING_BYTES - used)
+            return 0;
+    }
+    return 1;
+}
+
+/* Appends the collected row to the column builders; returns 1 when the
+ * batch is full, or 2 when the row doesn't fit and stays pending until the
+ * caller has taken the batch with finish_batch */
+static int end_row(arrow_table_builder_t *t) {
+    if (!t->last_row)
+        return 0;
+    if (t->length && !row_fits(t))
+        return 2;
+    for (size_t i = 0; i < t->columns->count; i++) {
+        arrow_field_t *field = &t->fields[i];
+        arrow_column_builder_t *b = &t->builders[i];
+        int rc = field->set
+            ? append_value(b, &t->columns->columns[i], t->length,
+                    (const char *)t->row_values.data + field->offset, field->len)
+            : append_null(b, t->length);
+        if (rc != 0)
+            return -1;
+        field->set = 0;
+    }
+    t->row_values.len = 0;
+    t->last_row = 0;
+    t->length++;
+    return t->length >= t->batch_rows;
+}
+
+/* Stores one value of the current row; returns 1 when the previous row
+ * filled the batch, which the caller then takes with finish_batch. A return
+ * of 2 means the value wasn't stored: take the batch and call again. */
+static int add_value(arrow_table_builder_t *t, int row, fmp_column_t *column, const char *value) {
+    int rc = 0;
+    if (column->index >= t->num_indexes || t->positions[column->index] < 0)
+        return 0;
+    if (row != t->last_row) {
+        if ((rc = end_row(t)) < 0 || rc == 2)
+            return rc;
+        t->last_row = row;
+    }
+    arrow_field_t *field = &t->fields[t->positions[column->index]];
+    field->offset = t->row_values.len;
+    field->len = strlen(value);
+    field->set = 1;
+    /* Keep values NUL-terminated for fmp_parse_value */
+    if (buffer_append(&t->row_values, value, field->len + 1) != 0)
+        return -1;
+    return rc;
+}
+
+static void release_schema(struct ArrowSchema *schema) {
+    arrow_schema_private_t *private_data = (arrow_schema_private_t *)schema->private_data;
+    for (int64_t i = 0; i < schema->n_children; i++) {
+        if (schema->children[i]->release)
+            schema->children[i]->release(schema->children[i]);
+    }
+    if (schema->dictionary && schema->dictionary->release)
+        schema->dictionary->release(schema->dictionary);
+    free(private_data->format);
+    free(private_data->name);
+    free(private_data->children);
+    free(private_data->child_schemas);
+    free(private_data);
+    schema->release = NULL;
+}
+
+static int init_schema(struct ArrowSchema *schema, const char *format, const char *name, int64_t n_children) {
+    arrow_schema_private_t *private_data = calloc(1, sizeof(arrow_schema_private_t));
+    if (!private_data)
+        return -1;
+    memset(schema, 0, sizeof(struct ArrowSchema));
+    schema->private_data = private_data;
+    schema->release = &release_schema;
+    private_data->format = strdup(format);
+    private_data->name = strdup(name);
+    schema->format = private_data->format;
+    schema->name = private_data->name;
+    schema->flags = ARROW_FLAG_NULLABLE;
+    if (n_children) {
+        private_data->children = calloc(n_children, sizeof(struct ArrowSchema *));
+        private_data->child_schemas = calloc(n_children, sizeof(struct ArrowSchema));
+        schema->children = private_data->children;
+    }
+    if (!private_data->format || !private_data->name ||
+            (n_children && (!private_data->children || !private_data->child_schemas))) {
+        release_schema(schema);
+        return -1;
+    }
+    return 0;
+}
+
+fmp_error_t fmp_arrow_schema(fmp_column_array_t *columns, int flags, struct ArrowSchema *out) {
+    if (init_schema(out, "+s", "", columns->count) != 0)
+        return FMP_ERROR_MALLOC;
+    out->flags = 0;
+    arrow_schema_private_t *private_data = (arrow_schema_private_t *)out->private_data;
+    for (size_t i = 0; i < columns->count; i++) {
+        fmp_column_t *column = &columns->columns[i];
+        struct ArrowSchema *child = &private_data->child_schemas[i];
+        arrow_type_t type = arrow_type(column, flags);
+        private_data->children[i] = child;
+        if (init_schema(child, arrow_format(type), column->utf8_name, 0) != 0) {
+            release_schema(out);
+            return FMP_ERROR_MALLOC;
+        }
+        out->n_children = i + 1;
+        if (type == ARROW_DICTIONARY) {
+            arrow_schema_private_t *child_data = (arrow_schema_private_t *)child->private_data;
+            if (init_schema(&child_data->dictionary, "u", "", 0) != 0) {
+                release_schema(out);
+                return FMP_ERROR_MALLOC;
+            }
+            child->dictionary = &child_data->dictionary;
+        }
+    }
+    return FMP_OK;
+}
+
+/* fmp_read_all_arrow: batches go to the caller's handler as they fill up */
+
+typedef struct fmp_read_all_arrow_ctx_s {
+    arrow_table_builder_t *builders;
+    arrow_table_builder_t **builders_by_index;
+    size_t num_indexes;
+    fmp_arrow_batch_handler handle_batch;
+    void *user_ctx;
+    fmp_error_t error;
+} fmp_read_all_arrow_ctx_t;
+
+static fmp_handler_status_t emit_batch(fmp_read_all_arrow_ctx_t *ctx, arrow_table_builder_t *t) {
+    struct ArrowArray batch;
+    if (finish_batch(t, &batch) != 0) {
+        ctx->error = FMP_ERROR_MALLOC;
+        return FMP_HANDLER_ABORT;
+    }
+    return ctx->handle_batch(t->table_index, &batch, ctx->user_ctx);
+}
+
+static fmp_handler_status_t handle_value_arrow(int table_index, int row, fmp_column_t *column,
+        const char *value, void *ctxp) {
+    fmp_read_all_arrow_ctx_t *ctx = (fmp_read_all_arrow_ctx_t *)ctxp;
+    if (table_index >= ctx->num_indexes || !ctx->builders_by_index[table_index])
+        return FMP_HANDLER_OK;
+
+    arrow_table_builder_t *t = ctx->builders_by_index[table_index];
+    int rc;
+    while ((rc = add_value(t, row, column, value)) == 2) {
+        if (emit_batch(ctx, t) == FMP_HANDLER_ABORT)
+            return FMP_HANDLER_ABORT;
+    }
+    if (rc < 0) {
+        ctx->error = FMP_ERROR_MALLOC;
+        return FMP_HANDLER_ABORT;
+    }
+    return rc ? emit_batch(ctx, t) : FMP_HANDLER_OK;
+}
+
+static fmp_unparsed_array_t *unparsed_array(arrow_table_builder_t *builders, size_t num_builders,
+        size_t num_columns) {
+    fmp_unparsed_array_t *array = calloc(1, sizeof(fmp_unparsed_array_t));
+    if (!array || !(array->columns = calloc(num_columns + 1, sizeof(fmp_unparsed_column_t)))) {
+        free(array);
+        return NULL;
+    }
+    for (size_t i = 0; i < num_builders; i++) {
+        arrow_table_builder_t *t = &builders[i];
+        for (size_t j = 0; j < t->columns->count; j++) {
+            if (!t->builders[j].unparsed_values)
+                continue;
+            fmp_unparsed_column_t *column = &array->columns[array->count++];
+            column->table_index = t->table_index;
+            column->column_index = t->columns->columns[j].index;
+            column->count = t->builders[j].unparsed_values;
+        }
+    }
+    return array;
+}
+
+fmp_error_t fmp_read_all_arrow(fmp_file_t *file, fmp_metadata_t *metadata, size_t batch_rows, int flags,
+        fmp_arrow_batch_handler handle_batch, void *user_ctx, fmp_unparsed_array_t **unparsed) {
+    fmp_read_all_arrow_ctx_t ctx = { .handle_batch = handle_batch, .user_ctx = user_ctx };
+    fmp_table_array_t *tables = metadata->tables;
+    fmp_error_t retval = FMP_OK;
+    size_t num_builders = 0;
+
+    if (unparsed)
+        *unparsed = NULL;
+    for (size_t i = 0; i < tables->count; i++) {
+        if (tables->tables[i].index >= ctx.num_indexes)
+            ctx.num_indexes = tables->tables[i].index + 1;
+    }
+    ctx.builders = calloc(tables->count, sizeof(arrow_table_builder_t));
+    ctx.builders_by_index = calloc(ctx.num_indexes, sizeof(arrow_table_builder_t *));
+    if (!ctx.builders || !ctx.builders_by_index) {
+        retval = FMP_ERROR_MALLOC;
+        goto cleanup;
+    }
+
+    for (size_t i = 0; i < tables->count; i++) {
+        fmp_table_t *table = &tables->tables[i];
+        fmp_column_array_t *columns = i < metadata->columns_capacity ? metadata->columns[i] : NULL;
+        if (table->skip || !columns || columns->count == 0)
+            continue;
+        arrow_table_builder_t *t = &ctx.builders[num_builders++];
+        if (table_builder_init(t, table->index, columns, batch_rows, flags) != 0) {
+            retval = FMP_ERROR_MALLOC;
+            goto cleanup;
+        }
+        ctx.builders_by_index[table->index] = t;
+    }
+
+    retval = fmp_read_all_values(file, metadata, &handle_value_arrow, &ctx);
+    if (ctx.error)
+        retval = ctx.error;
+
+    /* Partial batches, in table order */
+    for (size_t i = 0; retval == FMP_OK && i < num_builders; i++) {
+        arrow_table_builder_t *t = &ctx.builders[i];
+        int rc = end_row(t);
+        if (rc == 2) {
+            if (emit_batch(&ctx, t) == FMP_HANDLER_ABORT) {
+                retval = ctx.error ? ctx.error : FMP_ERROR_USER_ABORTED;
+                break;
+            }
+            rc = end_row(t);
+        }
+        if (rc < 0) {
+            retval = FMP_ERROR_MALLOC;
+        } else if (t->length && emit_batch(&ctx, t) == FMP_HANDLER_ABORT) {
+            retval = ctx.error ? ctx.error : FMP_ERROR_USER_ABORTED;
+        }
+    }
+
+    size_t unparsed_values = 0, unparsed_columns = 0;
+    for (size_t i = 0; i < num_builders; i++) {
+        arrow_table_builder_t *t = &ctx.builders[i];
+        for (size_t j = 0; j < t->columns->count; j++) {
+            unparsed_values += t->builders[j].unparsed_values;
+            unparsed_columns += t->builders[j].unparsed_values > 0;
+        }
+    }
+    if (unparsed && !(*unparsed = unparsed_array(ctx.builders, num_builders, unparsed_columns)) &&
+            retval == FMP_OK) {
+        retval = FMP_ERROR_MALLOC;
+    }
+    if (unparsed_values) {
+        log_message(FMP_LOG_WARNING, "%zu values in %zu columns didn't parse as their column's type "
+                "and were written as null", unparsed_values, unparsed_columns);
+    }
+
+cleanup:
+    for (size_t i = 0; ctx.builders && i < num_builders; i++)
+        table_builder_free(&ctx.builders[i]);
+    free(ctx.builders);
+    free(ctx.builders_by_index);
+    return retval;
+}
+
+/* fmp_read_arrow: a stream over one table. The scan can't be resumed between
+ * calls, so the whole table is read into batches when the stream is created
+ * and memory is proportional to the table; the stream then hands out the
+ * finished batches one at a time without copying them. If the scan failed,
+ * get_next reports it after the batches read before the failure. */
+
+typedef struct arrow_stream_private_s {
+    fmp_column_array_t *columns;
+    int flags;
+    struct ArrowArray *batches;
+    size_t num_batches;
+    size_t next_batch;
+    fmp_error_t error;
+    char last_error[256];
+} arrow_stream_private_t;
+
+typedef struct fmp_read_arrow_ctx_s {
+    arrow_table_builder_t builder;
+    arrow_stream_private_t *stream;
+    size_t batches_capacity;
+} fmp_read_arrow_ctx_t;
+
+static int stream_add_batch(fmp_read_arrow_ctx_t *ctx) {
+    arrow_stream_private_t *stream = ctx->stream;
+    if (stream->num_batches == ctx->batches_capacity) {
+        size_t capacity = ctx->batches_capacity ? 2 * ctx->batches_capacity : 16;
+        struct ArrowArray *batches = realloc(stream->batches, capacity * sizeof(struct ArrowArray));
+        if (!batches)
+            return -1;
+        stream->batches = batches;
+        ctx->batches_capacity = capacity;
+    }
+    if (finish_batch(&ctx->builder, &stream->batches[stream->num_batches]) != 0)
+        return -1;
+    stream->num_batches++;
+    return 0;
+}
+
+static fmp_handler_status_t handle_value_stream(int row, fmp_column_t *column, const char *value, void *ctxp) {
+    fmp_read_arrow_ctx_t *ctx = (fmp_read_arrow_ctx_t *)ctxp;
+    int rc;
+    while ((rc = add_value(&ctx->builder, row, column, value)) == 2) {
+        if (stream_add_batch(ctx) != 0)
+            return FMP_HANDLER_ABORT;
+    }
+    if (rc < 0 || (rc && stream_add_batch(ctx) != 0))
+        return FMP_HANDLER_ABORT;
+    return FMP_HANDLER_OK;
+}
+
+static int stream_get_schema(struct ArrowArrayStream *stream, struct ArrowSchema *out) {
+    arrow_stream_private_t *private_data = (arrow_stream_private_t *)stream->private_data;
+    if (fmp_arrow_schema(private_data->columns, private_data->flags, out) != FMP_OK) {
+        snprintf(private_data->last_error, sizeof(private_data->last_error), "Out of memory");
+        return ENOMEM;
+    }
+    return 0;
+}
+
+static int stream_get_next(struct ArrowArrayStream *stream, struct ArrowArray *out) {
+    arrow_stream_private_t *private_data = (arrow_stream_private_t *)stream->private_data;
+    if (private_data->next_batch == private_data->num_batches) {
+        memset(out, 0, sizeof(struct ArrowArray));
+        if (private_data->error == FMP_ERROR_MALLOC)
+            return ENOMEM;
+        return private_data->error == FMP_OK ? 0 : EIO;
+    }
+    /* The batch moves to the caller; only its struct lives in our array */
+    *out = private_data->batches[private_data->next_batch];
+    private_data->batches[private_data->next_batch].release = NULL;
+    private_data->next_batch++;
+    return 0;
+}
+
+static const char *stream_get_last_error(struct ArrowArrayStream *stream) {
+    arrow_stream_private_t *private_data = (arrow_stream_private_t *)stream->private_data;
+    return private_data->last_error[0] ? private_data->last_error : NULL;
+}
+
+static void stream_release(struct ArrowArrayStream *stream) {
+    arrow_stream_private_t *private_data = (arrow_stream_private_t *)stream->private_data;
+    for (size_t i = private_data->next_batch; i < private_data->num_batches; i++) {
+        if (private_data->batches[i].release)
+            private_data->batches[i].release(&private_data->batches[i]);
+    }
+    free(private_data->batches);
+    fmp_free_columns(private_data->columns);
+    free(private_data);
+    stream->release = NULL;
+}
+
+fmp_error_t fmp_read_arrow(fmp_file_t *file, fmp_table_t *table, size_t batch_rows, int flags,
+        struct ArrowArrayStream *out) {
+    fmp_error_t retval = FMP_OK;
+    fmp_read_arrow_ctx_t ctx = { .stream = calloc(1, sizeof(arrow_stream_private_t)) };
+    if (!ctx.stream)
+        return FMP_ERROR_MALLOC;
+
+    ctx.stream->columns = fmp_list_columns(file, table, &retval);
+    if (!ctx.stream->columns) {
+        free(ctx.stream);
+        return retval;
+    }
+
+    ctx.stream->flags = flags;
+
+    memset(out, 0, sizeof(struct ArrowArrayStream));
+    out->get_schema = &stream_get_schema;
+    out->get_next = &stream_get_next;
+    out->get_last_error = &stream_get_last_error;
+    out->release = &stream_release;
+    out->private_data = ctx.stream;
+
+    if (table_builder_init(&ctx.builder, table->index, ctx.stream->columns, batch_rows, flags) != 0) {
+        table_builder_free(&ctx.builder);
+        out->release(out);
+        return FMP_ERROR_MALLOC;
+    }
+
+    retval = fmp_read_values(file, table, &handle_value_stream, &ctx);
+    if (retval == FMP_OK) {
+        int rc = end_row(&ctx.builder);
+        if (rc == 2)
+            rc = stream_add_batch(&ctx) != 0 ? -1 : end_row(&ctx.builder);
+        if (rc < 0 || (ctx.builder.length && stream_add_batch(&ctx) != 0))
+            retval = FMP_ERROR_MALLOC;
+    }
+    table_builder_free(&ctx.builder);
+
+    /* The batches read so far are still handed out; get_next reports the
+     * failure after them */
+    if (retval != FMP_OK) {
+        ctx.stream->error = retval;
+        snprintf(ctx.stream->last_error, sizeof(ctx.stream->last_error),
+                "Reading table %s failed with error code %d", table->utf8_name, retval);
+    }
+    return FMP_OK;
+}
+
+void fmp_free_unparsed(fmp_unparsed_array_t *array) {
+    if (array) {
+        free(array->columns);
+        free(array);
+    }
+}
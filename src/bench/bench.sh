@@ -0,0 +1,60 @@
+#!/bin/sh
+# Runs fmpbench over FileMaker files, or directories of them, and collects
+# the results into one JSON document. `make bench` calls this; compare two
+# documents with compare.py.
+#
+# Usage: bench.sh [-o output] [-r repeat] [-e exporters] fmpbench input...
+
+set -e
+
+output=bench.json
+repeat=3
+exporters=""
+while getopts o:r:e: opt; do
+    case $opt in
+        o) output=$OPTARG ;;
+        r) repeat=$OPTARG ;;
+        e) for exporter in $OPTARG; do
+               exporters="$exporters --exporter $exporter"
+           done ;;
+        *) exit 1 ;;
+    esac
+done
+shift $((OPTIND - 1))
+
+if [ $# -lt 2 ]; then
+    echo "Usage: $0 [-o output] [-r repeat] [-e exporters] fmpbench input..." >&2
+    exit 1
+fi
+fmpbench=$1
+shift
+
+list="$output.files"
+: > "$list"
+for input in "$@"; do
+    if [ -d "$input" ]; then
+        find "$input" -type f \( -iname '*.fp3' -o -iname '*.fp5' \
+            -o -iname '*.fp7' -o -iname '*.fmp12' \) | sort >> "$list"
+    elif [ -f "$input" ]; then
+        echo "$input" >> "$list"
+    else
+        echo "No such file or directory: $input" >&2
+    fi
+done
+
+{
+    printf '{"date": "%s", "host": "%s", "repeat": %s, "results": [\n' \
+        "$(date -u +%Y-%m-%dT%H:%M:%SZ)" "$(uname -sm)" "$repeat"
+    sep=""
+    while IFS= read -r file; do
+        echo "$file" >&2
+        printf '%s' "$sep"
+        # shellcheck disable=SC2086
+        "$fmpbench" --repeat "$repeat" $exporters "$file"
+        sep=","
+    done < "$list"
+    printf ']}\n'
+} > "$output"
+
+rm -f "$list"
+echo "Wrote $output" >&2
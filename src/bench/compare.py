@@ -0,0 +1,75 @@
+#!/usr/bin/env python3
+"""Compare two `make bench` results and flag phases that got slower.
+
+Usage: compare.py [--threshold PERCENT] baseline.json current.json
+
+Throughput (MB/s) is compared per file and phase; peak RSS and allocation
+counts are shown alongside. Exits with status 1 if any phase slowed down by
+more than the threshold (default 10%), so it can gate CI.
+"""
+
+import argparse
+import json
+import sys
+
+
+def load(path):
+    with open(path) as f:
+        document = json.load(f)
+    results = {}
+    for result in document["results"]:
+        for phase in result["phases"]:
+            results[(result["file"], phase["phase"])] = phase
+    return results
+
+
+def change(old, new):
+    if old is None or new is None or old == 0:
+        return None
+    return 100.0 * (new - old) / old
+
+
+def format_change(value):
+    return "%+7.1f%%" % value if value is not None else "       -"
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--threshold", type=float, default=10.0,
+                        help="slowdown in percent that counts as a regression")
+    parser.add_argument("baseline")
+    parser.add_argument("current")
+    args = parser.parse_args()
+
+    baseline = load(args.baseline)
+    current = load(args.current)
+
+    regressions = 0
+    print("%-50s %-28s %10s %10s %8s %8s %8s" % (
+        "File", "Phase", "Base MB/s", "MB/s", "Speed", "RSS", "Allocs"))
+    for key in sorted(set(baseline) & set(current)):
+        old, new = baseline[key], current[key]
+        speed = change(old["mb_per_s"], new["mb_per_s"])
+        # Phases this short are mostly noise
+        regressed = (speed is not None and speed < -args.threshold
+                     and max(old["seconds"], new["seconds"]) >= 0.01)
+        regressions += regressed
+        print("%-50s %-28s %10.2f %10.2f %s %s %s%s" % (
+            key[0][-50:], key[1], old["mb_per_s"], new["mb_per_s"],
+            format_change(speed),
+            format_change(change(old["peak_rss_kb"], new["peak_rss_kb"])),
+            format_change(change(old["allocations"], new["allocations"])),
+            "  <-- slower" if regressed else ""))
+
+    for key in sorted(set(baseline) ^ set(current)):
+        print("%s %s: only in %s" % (key[0], key[1],
+              "baseline" if key in baseline else "current"))
+
+    if regressions:
+        print("%d phase(s) slower by more than %.0f%%" % (regressions, args.threshold))
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,382 @@
+/* FMP Tools - A library for reading FileMaker Pro databases
+ * Copyright (c) 2020 Evan Miller (except where otherwise noted)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/* Times the library's main entry points and the export tools on one input
+ * file and prints the results as a JSON object; src/bench/bench.sh runs it
+ * over a corpus for `make bench`. Each phase is repeated and the fastest
+ * run is kept. Peak RSS is the process high-water mark after the phase
+ * (the child's, for exporters), so run one file per process. Allocation
+ * counts are only available when the linker supports --wrap. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+
+#include "../fmp.h"
+#include "../fmp_arrow.h"
+
+#define MAX_PHASES 32
+
+#ifdef COUNT_ALLOCATIONS
+static size_t allocations;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+char *__real_strdup(const char *s);
+
+void *__wrap_malloc(size_t size) {
+    allocations++;
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size) {
+    allocations++;
+    return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+    allocations++;
+    return __real_realloc(ptr, size);
+}
+
+char *__wrap_strdup(const char *s) {
+    allocations++;
+    return __real_strdup(s);
+}
+#endif
+
+typedef struct phase_s {
+    char name[64];
+    double seconds;     /* Fastest run */
+    size_t rows;
+    long peak_rss_kb;
+    long allocations;   /* -1 if not counted */
+} phase_t;
+
+typedef struct bench_ctx_s {
+    phase_t phases[MAX_PHASES];
+    int num_phases;
+    /* For the phase being timed */
+    double start;
+    size_t start_allocations;
+    size_t rows;
+    int last_table;
+    int last_row;
+} bench_ctx_t;
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static long rss_kb(const struct rusage *usage) {
+#ifdef __APPLE__
+    return usage->ru_maxrss / 1024;
+#else
+    return usage->ru_maxrss;
+#endif
+}
+
+static void phase_start(bench_ctx_t *ctx) {
+    ctx->rows = 0;
+    ctx->last_table = -1;
+    ctx->last_row = -1;
+#ifdef COUNT_ALLOCATIONS
+    ctx->start_allocations = allocations;
+#endif
+    ctx->start = now();
+}
+
+static phase_t *phase_record(bench_ctx_t *ctx, const char *name, double seconds,
+        long peak_rss_kb, long phase_allocations) {
+    phase_t *phase = NULL;
+    for (int i=0; i<ctx->num_phases; i++) {
+        if (strcmp(ctx->phases[i].name, name) == 0)
+            phase = &ctx->phases[i];
+    }
+    if (!phase) {
+        if (ctx->num_phases == MAX_PHASES)
+            return NULL;
+        phase = &ctx->phases[ctx->num_phases++];
+        snprintf(phase->name, sizeof(phase->name), "%s", name);
+        phase->seconds = seconds;
+        phase->rows = ctx->rows;
+        phase->allocations = phase_allocations;
+    }
+    if (seconds < phase->seconds)
+        phase->seconds = seconds;
+    phase->peak_rss_kb = peak_rss_kb;
+    return phase;
+}
+
+static void phase_end(bench_ctx_t *ctx, const char *name) {
+    double seconds = now() - ctx->start;
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    long phase_allocations = -1;
+#ifdef COUNT_ALLOCATIONS
+    phase_allocations = allocations - ctx->start_allocations;
+#endif
+    phase_record(ctx, name, seconds, rss_kb(&usage), phase_allocations);
+}
+
+static fmp_handler_status_t handle_value(int row, fmp_column_t *column, const char *value, void *ctxp) {
+    bench_ctx_t *ctx = (bench_ctx_t *)ctxp;
+    if (row != ctx->last_row) {
+        ctx->last_row = row;
+        ctx->rows++;
+    }
+    return FMP_HANDLER_OK;
+}
+
+static fmp_handler_status_t handle_table_value(int table, int row, fmp_column_t *column,
+        const char *value, void *ctxp) {
+    bench_ctx_t *ctx = (bench_ctx_t *)ctxp;
+    if (table != ctx->last_table || row != ctx->last_row) {
+        ctx->last_table = table;
+        ctx->last_row = row;
+        ctx->rows++;
+    }
+    return FMP_HANDLER_OK;
+}
+
+static fmp_handler_status_t handle_batch(int table, struct ArrowArray *batch, void *ctxp) {
+    bench_ctx_t *ctx = (bench_ctx_t *)ctxp;
+    ctx->rows += batch->length;
+    batch->release(batch);
+    return FMP_HANDLER_OK;
+}
+
+static fmp_error_t bench_library(bench_ctx_t *ctx, const char *path) {
+    fmp_error_t error = FMP_OK;
+
+    phase_start(ctx);
+    fmp_file_t *file = fmp_open_file(path, &error);
+    phase_end(ctx, "open");
+    if (!file)
+        return error;
+
+    phase_start(ctx);
+    fmp_metadata_t *metadata = fmp_discover_all_metadata(file, &error);
+    phase_end(ctx, "discover_all_metadata");
+    if (!metadata)
+        goto done;
+
+    phase_start(ctx);
+    fmp_table_array_t *tables = fmp_list_tables(file, &error);
+    for (size_t i=0; tables && i<tables->count; i++) {
+        fmp_column_array_t *columns = fmp_list_columns(file, &tables->tables[i], &error);
+        fmp_free_columns(columns);
+    }
+    phase_end(ctx, "list_columns");
+    if (!tables)
+        goto done;
+
+    phase_start(ctx);
+    for (size_t i=0; i<tables->count && error == FMP_OK; i++) {
+        ctx->last_row = -1;
+        error = fmp_read_values(file, &tables->tables[i], &handle_value, ctx);
+    }
+    phase_end(ctx, "read_values");
+    fmp_free_tables(tables);
+    if (error != FMP_OK)
+        goto done;
+
+    phase_start(ctx);
+    error = fmp_read_all_values(file, metadata, &handle_table_value, ctx);
+    phase_end(ctx, "read_all_values");
+    if (error != FMP_OK)
+        goto done;
+
+    phase_start(ctx);
+    error = fmp_read_all_arrow(file, metadata, 0, 0, &handle_batch, ctx, NULL);
+    phase_end(ctx, "read_all_arrow");
+
+done:
+    fmp_free_metadata(metadata);
+    fmp_close_file(file);
+    return error;
+}
+
+static void remove_tree(const char *path) {
+    struct stat st;
+    DIR *dir = NULL;
+    if (lstat(path, &st) == 0 && S_ISDIR(st.st_mode) && (dir = opendir(path))) {
+        struct dirent *entry;
+        while ((entry = readdir(dir))) {
+            if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+                continue;
+            char child[4096];
+            snprintf(child, sizeof(child), "%s/%s", path, entry->d_name);
+            remove_tree(child);
+        }
+        closedir(dir);
+    }
+    remove(path);
+}
+
+/* Runs `exporter input outdir/out`, which suits both the directory and the
+ * single-file tools */
+static int bench_exporter(bench_ctx_t *ctx, const char *exporter, const char *path) {
+    char dir[] = "/tmp/fmpbench.XXXXXX";
+    char out[sizeof(dir) + 4];
+    if (!mkdtemp(dir)) {
+        perror("mkdtemp");
+        return -1;
+    }
+    snprintf(out, sizeof(out), "%s/out", dir);
+
+    double start = now();
+    pid_t pid = fork();
+    if (pid == 0) {
+        int null = open("/dev/null", O_WRONLY);
+        dup2(null, STDOUT_FILENO);
+        dup2(null, STDERR_FILENO);
+        execl(exporter, exporter, path, out, (char *)NULL);
+        _exit(127);
+    }
+    int status = 0;
+    struct rusage usage = { .ru_maxrss = 0 };
+    if (pid < 0 || wait4(pid, &status, 0, &usage) < 0) {
+        perror("fork");
+        status = -1;
+    }
+    double seconds = now() - start;
+    remove_tree(dir);
+
+    if (status != 0)
+        return status;
+
+    const char *slash = strrchr(exporter, '/');
+    char name[64];
+    snprintf(name, sizeof(name), "export:%s", slash ? slash + 1 : exporter);
+    ctx->rows = 0;
+    /* Rows come from the read_all_values phase */
+    for (int i=0; i<ctx->num_phases; i++) {
+        if (strcmp(ctx->phases[i].name, "read_all_values") == 0)
+            ctx->rows = ctx->phases[i].rows;
+    }
+    phase_record(ctx, name, seconds, rss_kb(&usage), -1);
+    return 0;
+}
+
+static void print_json_string(const char *s) {
+    putchar('"');
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\') {
+            printf("\\%c", *s);
+        } else if ((unsigned char)*s < 0x20) {
+            printf("\\u%04x", *s);
+        } else {
+            putchar(*s);
+        }
+    }
+    putchar('"');
+}
+
+static void print_results(bench_ctx_t *ctx, const char *path, size_t bytes, fmp_error_t error) {
+    printf("{\"file\": ");
+    print_json_string(path);
+    printf(", \"bytes\": %zu, \"error\": %d, \"phases\": [", bytes, error);
+    for (int i=0; i<ctx->num_phases; i++) {
+        phase_t *phase = &ctx->phases[i];
+        double seconds = phase->seconds > 1e-9 ? phase->seconds : 1e-9;
+        printf("%s\n  {\"phase\": \"%s\", \"seconds\": %.6f, \"mb_per_s\": %.3f, "
+                "\"rows\": %zu, \"rows_per_s\": %.1f, \"peak_rss_kb\": %ld, \"allocations\": ",
+                i ? "," : "", phase->name, phase->seconds, bytes / 1e6 / seconds,
+                phase->rows, phase->rows / seconds, phase->peak_rss_kb);
+        if (phase->allocations < 0) {
+            printf("null}");
+        } else {
+            printf("%ld}", phase->allocations);
+        }
+    }
+    printf("]}\n");
+}
+
+static void print_usage(const char *prog) {
+    printf("Usage: %s [options] input-file\n", prog);
+    printf("Options:\n");
+    printf("  --repeat N       Run each phase N times and keep the fastest (default 3)\n");
+    printf("  --exporter PROG  Also time PROG input-file output, e.g. ./fmp2csv (repeatable)\n");
+    printf("  --help, -h       Show this help message\n");
+}
+
+int main(int argc, char *argv[]) {
+    const char *exporters[MAX_PHASES];
+    int num_exporters = 0;
+    int repeat = 3;
+    const char *path = NULL;
+
+    for (int i=1; i<argc; i++) {
+        if (strcmp(argv[i], "--repeat") == 0 && i + 1 < argc) {
+            repeat = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--exporter") == 0 && i + 1 < argc && num_exporters < MAX_PHASES / 2) {
+            exporters[num_exporters++] = argv[++i];
+        } else if (strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-h") == 0) {
+            print_usage(argv[0]);
+            return 0;
+        } else if (!path && argv[i][0] != '-') {
+            path = argv[i];
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    if (!path || repeat < 1) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        perror(path);
+        return 1;
+    }
+
+    bench_ctx_t ctx = { .num_phases = 0 };
+    fmp_error_t error = FMP_OK;
+    for (int run=0; run<repeat && error == FMP_OK; run++) {
+        error = bench_library(&ctx, path);
+    }
+    for (int i=0; i<num_exporters && error == FMP_OK; i++) {
+        for (int run=0; run<repeat; run++) {
+            if (bench_exporter(&ctx, exporters[i], path) != 0) {
+                fprintf(stderr, "%s failed on %s\n", exporters[i], path);
+                break;
+            }
+        }
+    }
+
+    print_results(&ctx, path, st.st_size, error);
+    return 0;
+}
@@ -0,0 +1,491 @@
+/* FMP Tools - A library for reading FileMaker Pro databases
+ * Copyright (c) 2020 Evan Miller (except where otherwise noted)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/* Writes synthetic HBAM7 (fmp12 or fp7) files for scaling tests. The files
+ * hold only what fmptools reads: table and column definitions under [3] and
+ * [128+t].[3].[5], and records under [128+t].[5].[row], with values longer
+ * than a chunk stored as segments under [128+t].[5].[row].[column]. Blocks
+ * can be shuffled on disk so the chain jumps around the file.
+ *
+ * The file is generated twice with the same seed: once to count the blocks,
+ * which sizes the file and the block permutation, and once to write them.
+ *
+ * Record numbers above 65663 don't fit the three-byte path integers that
+ * fmptools decodes, so their paths wrap around; rows are still counted
+ * correctly since every record starts with a short value in column 1. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define SECTOR_SIZE 4096
+#define SECTOR_HEAD_LEN 20
+#define PAYLOAD_LEN (SECTOR_SIZE - SECTOR_HEAD_LEN)
+#define XOR_MASK 0x5A
+#define MAX_DEPTH 8
+#define MAX_COLUMNS 250     /* Field references 252 and up mean something else */
+#define MAX_SHORT_VALUE 255
+#define SEGMENT_LEN 2048
+
+enum {
+    TYPE_TEXT = 1,
+    TYPE_NUMBER = 2,
+    TYPE_DATE = 3,
+    TYPE_TIME = 4,
+    TYPE_TIMESTAMP = 5
+};
+
+typedef struct gen_options_s {
+    int tables;
+    int columns;
+    uint64_t rows;
+    int long_columns;       /* The last columns of each table hold long text */
+    size_t long_bytes;
+    double fragmentation;   /* Fraction of blocks moved out of chain order */
+    int null_percent;
+    uint64_t seed;
+    int fp7;
+} gen_options_t;
+
+typedef struct gen_s {
+    const gen_options_t *options;
+    int fd;                     /* -1 while counting blocks */
+    uint64_t rng;
+    uint8_t sector[SECTOR_SIZE];
+    size_t used;                /* Payload bytes in the current block */
+    int open;                   /* The current block holds chunks */
+    uint64_t num_blocks;        /* Blocks finished so far */
+    uint64_t total_blocks;
+    uint32_t *positions;        /* Sector of each block, in chain order */
+    uint64_t path[MAX_DEPTH];   /* Path of the next chunk */
+    int depth;
+    uint64_t block_path[MAX_DEPTH]; /* Path pushed in the current block */
+    int block_depth;
+    int failed;
+} gen_t;
+
+static uint64_t next_random(gen_t *gen) {
+    /* xorshift64* */
+    gen->rng ^= gen->rng >> 12;
+    gen->rng ^= gen->rng << 25;
+    gen->rng ^= gen->rng >> 27;
+    return gen->rng * 0x2545F4914F6CDD1DULL;
+}
+
+static uint64_t random_below(gen_t *gen, uint64_t n) {
+    return n ? next_random(gen) % n : 0;
+}
+
+static void put_u32(uint8_t *p, uint32_t value) {
+    p[0] = value >> 24;
+    p[1] = value >> 16;
+    p[2] = value >> 8;
+    p[3] = value;
+}
+
+static int write_sector(gen_t *gen, uint64_t sector_index, const uint8_t *sector) {
+    if (pwrite(gen->fd, sector, SECTOR_SIZE, sector_index * SECTOR_SIZE) != SECTOR_SIZE) {
+        perror("write");
+        gen->failed = 1;
+        return 0;
+    }
+    return 1;
+}
+
+static void finish_block(gen_t *gen) {
+    if (!gen->open)
+        return;
+    if (gen->fd != -1) {
+        uint64_t i = gen->num_blocks;
+        /* The rest of the payload is zero, which ends the chunk list */
+        memset(gen->sector, 0, SECTOR_HEAD_LEN);
+        put_u32(&gen->sector[4], i ? gen->positions[i-1] : 0);
+        put_u32(&gen->sector[8], i + 1 < gen->total_blocks ? gen->positions[i+1] : 0);
+        write_sector(gen, gen->positions[i], gen->sector);
+    }
+    memset(gen->sector, 0, sizeof(gen->sector));
+    gen->used = 0;
+    gen->open = 0;
+    gen->block_depth = 0;
+    gen->num_blocks++;
+}
+
+static size_t path_len(uint64_t value) {
+    if (value < 0x80)
+        return 2;
+    if (value < 0x8080)
+        return 3;
+    return 4;
+}
+
+static void append(gen_t *gen, const void *bytes, size_t len) {
+    memcpy(&gen->sector[SECTOR_HEAD_LEN + gen->used], bytes, len);
+    gen->used += len;
+}
+
+static void append_byte(gen_t *gen, uint8_t byte) {
+    gen->sector[SECTOR_HEAD_LEN + gen->used++] = byte;
+}
+
+static void append_masked(gen_t *gen, const char *bytes, size_t len) {
+    for (size_t i=0; i<len; i++)
+        append_byte(gen, bytes[i] ^ XOR_MASK);
+}
+
+static void append_push(gen_t *gen, uint64_t value) {
+    if (value < 0x80) {
+        append_byte(gen, 0x20);
+        append_byte(gen, value);
+    } else if (value < 0x8080) {
+        value -= 0x80;
+        append_byte(gen, 0x28);
+        append_byte(gen, 0x80 | (value >> 8));
+        append_byte(gen, value & 0xFF);
+    } else {
+        value -= 0x80;
+        append_byte(gen, 0x30);
+        append_byte(gen, 0x80 | ((value >> 16) & 0x7F));
+        append_byte(gen, (value >> 8) & 0xFF);
+        append_byte(gen, value & 0xFF);
+    }
+}
+
+/* Makes room for a chunk of len bytes at the current path, popping and
+ * pushing as needed and moving to a new block if it doesn't fit */
+static void reserve_chunk(gen_t *gen, size_t len) {
+    for (int attempt=0; attempt<2; attempt++) {
+        int common = 0;
+        while (common < gen->block_depth && common < gen->depth &&
+                gen->block_path[common] == gen->path[common])
+            common++;
+        size_t needed = len + (gen->block_depth - common);
+        for (int i=common; i<gen->depth; i++)
+            needed += path_len(gen->path[i]);
+
+        if (gen->used + needed <= PAYLOAD_LEN) {
+            for (int i=common; i<gen->block_depth; i++)
+                append_byte(gen, 0x40);
+            for (int i=common; i<gen->depth; i++) {
+                append_push(gen, gen->path[i]);
+                gen->block_path[i] = gen->path[i];
+            }
+            gen->block_depth = gen->depth;
+            gen->open = 1;
+            return;
+        }
+        finish_block(gen);
+    }
+}
+
+static size_t space_left(gen_t *gen) {
+    return PAYLOAD_LEN - gen->used;
+}
+
+static void set_path(gen_t *gen, int depth, uint64_t a, uint64_t b, uint64_t c, uint64_t d) {
+    uint64_t values[4] = { a, b, c, d };
+    gen->depth = depth;
+    for (int i=0; i<depth; i++)
+        gen->path[i] = values[i];
+}
+
+static void emit_field(gen_t *gen, uint8_t ref, const void *bytes, size_t len, int masked) {
+    reserve_chunk(gen, 3 + len);
+    append_byte(gen, 0x06);
+    append_byte(gen, ref);
+    append_byte(gen, len);
+    if (masked) {
+        append_masked(gen, bytes, len);
+    } else {
+        append(gen, bytes, len);
+    }
+}
+
+/* Long values are split into segments, filling out each block */
+static void emit_long_value(gen_t *gen, const char *bytes, size_t len) {
+    uint8_t segment = 1;
+    while (len) {
+        reserve_chunk(gen, 4 + 1);
+        size_t room = space_left(gen) - 4;
+        size_t chunk_len = len < SEGMENT_LEN ? len : SEGMENT_LEN;
+        if (chunk_len > room)
+            chunk_len = room;
+        append_byte(gen, 0x07);
+        append_byte(gen, segment++);
+        append_byte(gen, chunk_len >> 8);
+        append_byte(gen, chunk_len & 0xFF);
+        append_masked(gen, bytes, chunk_len);
+        bytes += chunk_len;
+        len -= chunk_len;
+    }
+}
+
+static int column_type(const gen_options_t *options, int column) {
+    static const int cycle[] = { TYPE_TEXT, TYPE_NUMBER, TYPE_DATE, TYPE_TEXT, TYPE_TIME, TYPE_TIMESTAMP };
+    if (column == 1)
+        return TYPE_NUMBER;
+    if (column > options->columns - options->long_columns)
+        return TYPE_TEXT;
+    return cycle[(column - 2) % (sizeof(cycle) / sizeof(cycle[0]))];
+}
+
+static size_t random_text(gen_t *gen, char *dst, size_t len) {
+    static const char letters[] = "abcdefghijklmnopqrstuvwxyz";
+    uint64_t r = 0;
+    for (size_t i=0; i<len; i++) {
+        /* Each random number makes four characters */
+        if (i % 4 == 0)
+            r = next_random(gen);
+        unsigned int bits = r & 0xFFFF;
+        r >>= 16;
+        /* About one in eight is a space, never two in a row or at the ends */
+        if (bits % 8 == 0 && i && i + 1 < len && dst[i-1] != ' ') {
+            dst[i] = ' ';
+        } else {
+            dst[i] = letters[(bits >> 3) % 26];
+        }
+    }
+    if (len)
+        dst[0] += 'A' - 'a';
+    return len;
+}
+
+static size_t random_value(gen_t *gen, int type, char *dst, size_t dst_len) {
+    uint64_t r = next_random(gen);
+    int month = 1 + r % 12, day = 1 + (r >> 4) % 28, year = 1970 + (r >> 9) % 60;
+    int hour = (r >> 16) % 24, minute = (r >> 21) % 60, second = (r >> 27) % 60;
+    switch (type) {
+    case TYPE_NUMBER:
+        if (r & 1)
+            return snprintf(dst, dst_len, "%d", (int)((r >> 1) % 1000000));
+        return snprintf(dst, dst_len, "%d.%02d", (int)((r >> 1) % 100000), (int)((r >> 32) % 100));
+    case TYPE_DATE:
+        return snprintf(dst, dst_len, "%d/%d/%d", month, day, year);
+    case TYPE_TIME:
+        return snprintf(dst, dst_len, "%d:%02d:%02d", hour, minute, second);
+    case TYPE_TIMESTAMP:
+        return snprintf(dst, dst_len, "%d/%d/%d %d:%02d:%02d", month, day, year, hour, minute, second);
+    default:
+        return random_text(gen, dst, 4 + (r >> 40) % 40);
+    }
+}
+
+static void generate(gen_t *gen) {
+    const gen_options_t *options = gen->options;
+    char name[64];
+    char value[MAX_SHORT_VALUE + 1];
+    char *long_value = malloc(options->long_bytes + 1);
+
+    gen->rng = options->seed ? options->seed : 1;
+    gen->num_blocks = 0;
+
+    /* Table names */
+    for (int t=1; t<=options->tables; t++) {
+        set_path(gen, 4, 3, 16, 5, 128 + t);
+        int len = snprintf(name, sizeof(name), "Table%d", t);
+        emit_field(gen, 16, name, len, 1);
+    }
+
+    for (int t=1; t<=options->tables && !gen->failed; t++) {
+        /* Column types and names; the type is the second byte of [2] */
+        for (int c=1; c<=options->columns; c++) {
+            uint8_t storage[4] = { 0, column_type(options, c), 0, 0 };
+            set_path(gen, 4, 128 + t, 3, 5, c);
+            emit_field(gen, 2, storage, sizeof(storage), 0);
+            int len = c == 1 ? snprintf(name, sizeof(name), "id") :
+                snprintf(name, sizeof(name), "Field%d", c);
+            emit_field(gen, 16, name, len, 1);
+        }
+
+        for (uint64_t row=1; row<=options->rows && !gen->failed; row++) {
+            for (int c=1; c<=options->columns; c++) {
+                int type = column_type(options, c);
+                if (c > 1 && random_below(gen, 100) < options->null_percent)
+                    continue;
+                if (c > options->columns - options->long_columns) {
+                    size_t len = options->long_bytes;
+                    random_text(gen, long_value, len);
+                    set_path(gen, 4, 128 + t, 5, row, c);
+                    emit_long_value(gen, long_value, len);
+                } else {
+                    size_t len = c == 1 ? (size_t)snprintf(value, sizeof(value), "%llu", (unsigned long long)row) :
+                        random_value(gen, type, value, sizeof(value));
+                    set_path(gen, 3, 128 + t, 5, row, 0);
+                    emit_field(gen, c, value, len, 1);
+                }
+            }
+        }
+    }
+    finish_block(gen);
+    free(long_value);
+}
+
+/* Block 2 starts the chain; the rest are shuffled by the fragmentation */
+static uint32_t *block_positions(gen_t *gen) {
+    uint64_t n = gen->total_blocks;
+    uint32_t *positions = malloc(n * sizeof(uint32_t));
+    if (!positions)
+        return NULL;
+    for (uint64_t i=0; i<n; i++)
+        positions[i] = i + 2;
+    for (uint64_t i=1; i<n; i++) {
+        if ((next_random(gen) >> 11) * (1.0 / 9007199254740992.0) < gen->options->fragmentation) {
+            uint64_t j = 1 + random_below(gen, n - 1);
+            uint32_t tmp = positions[i];
+            positions[i] = positions[j];
+            positions[j] = tmp;
+        }
+    }
+    return positions;
+}
+
+static int write_header(gen_t *gen) {
+    static const uint8_t magic[] = {
+        0x00, 0x01, 0x00, 0x00, 0x00, 0x02, 0x00, 0x01,
+        0x00, 0x05, 0x00, 0x02, 0x00, 0x02, 0xC0, 'H', 'B', 'A', 'M', '7',
+        0x00, 0x00, 0x10, 0x00
+    };
+    uint8_t sector[SECTOR_SIZE] = { 0 };
+    memcpy(sector, magic, sizeof(magic));
+
+    /* Version and release date */
+    static const uint8_t fmp12[] = { 0x00, 0x01, 0x00, 0x1E, 0x00, 0x0E, 0x00, 'H', 'B', 'A', 'M', '2',
+        '1', '2', '5', 'J', 'A', 'N', '1', '1', 0xC1, 0x02, 'H', 0x08, 'P', 'r', 'o', ' ', '1', '2', '.', '0' };
+    static const uint8_t fp7[] = { 0x00, 0x01, 0x00, 0x1D, 0x00, 0x0E, 0x00, 'H', 'B', 'A', 'M', '2',
+        '1', '0', '1', 'O', 'C', 'T', '9', '9', 0xC1, 0x02, 'H', 0x07, 'P', 'r', 'o', ' ', '7', '.', '0' };
+    if (gen->options->fp7) {
+        memcpy(&sector[518], fp7, sizeof(fp7));
+    } else {
+        memcpy(&sector[518], fmp12, sizeof(fmp12));
+    }
+    if (!write_sector(gen, 0, sector))
+        return 0;
+
+    /* The index block records the number of blocks, itself included */
+    memset(sector, 0, sizeof(sector));
+    put_u32(&sector[8], gen->total_blocks + 1);
+    return write_sector(gen, 1, sector);
+}
+
+static void print_usage(const char *prog) {
+    printf("Usage: %s [options] output.fmp12\n", prog);
+    printf("Options:\n");
+    printf("  --tables N          Number of tables (default 1)\n");
+    printf("  --columns N         Columns per table, including the id (default 10, at most %d)\n", MAX_COLUMNS);
+    printf("  --rows N            Records per table (default 1000)\n");
+    printf("  --long-text N       Make the last N columns long text (default 0)\n");
+    printf("  --long-bytes N      Length of each long text value (default 10000)\n");
+    printf("  --nulls PERCENT     Chance that a value is left empty (default 0)\n");
+    printf("  --fragmentation F   Fraction of blocks stored out of chain order, 0 to 1 (default 0)\n");
+    printf("  --seed N            Random seed (default 1)\n");
+    printf("  --fp7               Write an fp7 file instead of fmp12\n");
+    printf("  --help, -h          Show this help message\n");
+}
+
+int main(int argc, char *argv[]) {
+    gen_options_t options = {
+        .tables = 1,
+        .columns = 10,
+        .rows = 1000,
+        .long_bytes = 10000,
+        .seed = 1
+    };
+    const char *path = NULL;
+
+    for (int i=1; i<argc; i++) {
+        const char *arg = argv[i];
+        const char *next = i + 1 < argc ? argv[i+1] : NULL;
+        if (strcmp(arg, "--tables") == 0 && next) {
+            options.tables = atoi(argv[++i]);
+        } else if (strcmp(arg, "--columns") == 0 && next) {
+            options.columns = atoi(argv[++i]);
+        } else if (strcmp(arg, "--rows") == 0 && next) {
+            options.rows = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(arg, "--long-text") == 0 && next) {
+            options.long_columns = atoi(argv[++i]);
+        } else if (strcmp(arg, "--long-bytes") == 0 && next) {
+            options.long_bytes = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(arg, "--nulls") == 0 && next) {
+            options.null_percent = atoi(argv[++i]);
+        } else if (strcmp(arg, "--fragmentation") == 0 && next) {
+            options.fragmentation = atof(argv[++i]);
+        } else if (strcmp(arg, "--seed") == 0 && next) {
+            options.seed = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(arg, "--fp7") == 0) {
+            options.fp7 = 1;
+        } else if (strcmp(arg, "--help") == 0 || strcmp(arg, "-h") == 0) {
+            print_usage(argv[0]);
+            return 0;
+        } else if (!path && arg[0] != '-') {
+            path = arg;
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (!path) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    if (options.tables < 1 || options.tables > 0x7F00 ||
+            options.columns < 1 || options.columns > MAX_COLUMNS ||
+            options.long_columns < 0 || options.long_columns >= options.columns ||
+            (options.long_columns && options.long_bytes == 0) ||
+            options.null_percent < 0 || options.null_percent > 100 ||
+            options.fragmentation < 0 || options.fragmentation > 1) {
+        fprintf(stderr, "Invalid options\n");
+        return 1;
+    }
+
+    gen_t gen = { .options = &options, .fd = -1 };
+    generate(&gen);
+    gen.total_blocks = gen.num_blocks;
+    if (gen.total_blocks + 2 > UINT32_MAX) {
+        fprintf(stderr, "Too many blocks: %llu\n", (unsigned long long)gen.total_blocks);
+        return 1;
+    }
+
+    gen.fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (gen.fd == -1) {
+        perror(path);
+        return 1;
+    }
+    gen.positions = block_positions(&gen);
+    if (!gen.positions) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    if (write_header(&gen))
+        generate(&gen);
+
+    free(gen.positions);
+    if (close(gen.fd) != 0 || gen.failed) {
+        perror(path);
+        return 1;
+    }
+    fprintf(stderr, "Wrote %llu blocks (%llu bytes)\n", (unsigned long long)gen.total_blocks,
+            (unsigned long long)(gen.total_blocks + 2) * SECTOR_SIZE);
+    return 0;
+}
@@ -0,0 +1,547 @@
+/* FMP Tools - A library for reading FileMaker Pro databases
+ * Copyright (c) 2020 Evan Miller (except where otherwise noted)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/* Writes one Arrow IPC file (Feather v2) per table from a single scan.
+ * Record batches come from fmp_read_all_arrow and are written to the
+ * table's file as they fill up; the schema and footer are encoded with a
+ * small FlatBuffers builder below, so no Arrow library is needed. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+
+#include "../fmp.h"
+#include "../fmp_arrow.h"
+#include "table_files.h"
+#include "usage.h"
+
+#define ARROW_MAGIC "ARROW1"
+#define ARROW_CONTINUATION 0xFFFFFFFF
+
+/* Schema.fbs / Message.fbs enumerations */
+#define ARROW_METADATA_V5 4
+#define ARROW_HEADER_SCHEMA 1
+#define ARROW_HEADER_RECORD_BATCH 3
+#define ARROW_TYPE_FLOATING_POINT 3
+#define ARROW_TYPE_UTF8 5
+#define ARROW_TYPE_DATE 8
+#define ARROW_TYPE_TIME 9
+#define ARROW_TYPE_TIMESTAMP 10
+#define ARROW_PRECISION_DOUBLE 2
+#define ARROW_DATE_DAY 0
+#define ARROW_TIME_MICROSECOND 2
+
+#define FB_MAX_FIELDS 8
+
+/* FlatBuffers are built back to front: data occupies the last `size` bytes
+ * of buf, and objects are referred to by their distance from the end. */
+typedef struct fb_builder_s {
+    uint8_t *buf;
+    size_t capacity;
+    size_t size;
+    size_t min_align;
+    size_t object_start;
+    size_t fields[FB_MAX_FIELDS];
+    int num_fields;
+} fb_builder_t;
+
+typedef struct arrow_block_s {
+    int64_t offset;
+    int32_t metadata_length;
+    int64_t body_length;
+} arrow_block_t;
+
+typedef struct arrow_file_s {
+    fmp_table_t *table;
+    struct ArrowSchema schema;
+    const char *path;
+    FILE *stream;
+    int64_t position;
+    arrow_block_t *blocks;
+    size_t num_blocks;
+    size_t blocks_capacity;
+    int error;
+} arrow_file_t;
+
+typedef struct arrow_ctx_s {
+    arrow_file_t *files;
+    arrow_file_t **files_by_index;
+    size_t num_indexes;
+    fb_builder_t fb;
+} arrow_ctx_t;
+
+static void fb_reset(fb_builder_t *b) {
+    b->size = 0;
+    b->min_align = 1;
+}
+
+static uint8_t *fb_alloc(fb_builder_t *b, size_t len) {
+    if (b->size + len > b->capacity) {
+        size_t capacity = b->capacity ? 2 * b->capacity : 1024;
+        while (capacity < b->size + len)
+            capacity *= 2;
+        uint8_t *buf = malloc(capacity);
+        if (b->size)
+            memcpy(buf + capacity - b->size, b->buf + b->capacity - b->size, b->size);
+        free(b->buf);
+        b->buf = buf;
+        b->capacity = capacity;
+    }
+    b->size += len;
+    return b->buf + b->capacity - b->size;
+}
+
+static void fb_prep(fb_builder_t *b, size_t align, size_t additional) {
+    if (align > b->min_align)
+        b->min_align = align;
+    size_t pad = (~(b->size + additional) + 1) & (align - 1);
+    if (pad)
+        memset(fb_alloc(b, pad), 0, pad);
+}
+
+static void put_le(uint8_t *p, uint64_t value, int len) {
+    for (int i = 0; i < len; i++)
+        p[i] = (value >> (8 * i)) & 0xFF;
+}
+
+static void fb_push(fb_builder_t *b, uint64_t value, int len) {
+    fb_prep(b, len, 0);
+    put_le(fb_alloc(b, len), value, len);
+}
+
+static void fb_push_offset(fb_builder_t *b, size_t offset) {
+    fb_prep(b, 4, 0);
+    fb_push(b, b->size + 4 - offset, 4);
+}
+
+static size_t fb_string(fb_builder_t *b, const char *s) {
+    size_t len = strlen(s);
+    fb_prep(b, 4, len + 1);
+    memcpy(fb_alloc(b, len + 1), s, len + 1);
+    fb_push(b, len, 4);
+    return b->size;
+}
+
+static void fb_start_vector(fb_builder_t *b, size_t elem_size, size_t count, size_t align) {
+    fb_prep(b, 4, elem_size * count);
+    fb_prep(b, align, elem_size * count);
+}
+
+static size_t fb_end_vector(fb_builder_t *b, size_t count) {
+    fb_push(b, count, 4);
+    return b->size;
+}
+
+static size_t fb_offset_vector(fb_builder_t *b, const size_t *offsets, size_t count) {
+    fb_start_vector(b, 4, count, 4);
+    for (size_t i = count; i > 0; i--)
+        fb_push_offset(b, offsets[i-1]);
+    return fb_end_vector(b, count);
+}
+
+static void fb_start_table(fb_builder_t *b) {
+    memset(b->fields, 0, sizeof(b->fields));
+    b->num_fields = 0;
+    b->object_start = b->size;
+}
+
+static void fb_slot(fb_builder_t *b, int id) {
+    b->fields[id] = b->size;
+    if (id >= b->num_fields)
+        b->num_fields = id + 1;
+}
+
+static void fb_add_scalar(fb_builder_t *b, int id, uint64_t value, int len) {
+    fb_push(b, value, len);
+    fb_slot(b, id);
+}
+
+static void fb_add_offset(fb_builder_t *b, int id, size_t offset) {
+    fb_push_offset(b, offset);
+    fb_slot(b, id);
+}
+
+static size_t fb_end_table(fb_builder_t *b) {
+    fb_push(b, 0, 4);
+    size_t table = b->size;
+    for (int i = b->num_fields - 1; i >= 0; i--)
+        fb_push(b, b->fields[i] ? table - b->fields[i] : 0, 2);
+    fb_push(b, table - b->object_start, 2);
+    fb_push(b, 2 * (b->num_fields + 2), 2);
+    /* The table starts with the signed distance back to its vtable */
+    put_le(b->buf + b->capacity - table, b->size - table, 4);
+    return table;
+}
+
+static void fb_finish(fb_builder_t *b, size_t root) {
+    fb_prep(b, b->min_align, 4);
+    fb_push_offset(b, root);
+}
+
+static int is_big_endian(void) {
+    const uint16_t one = 1;
+    return *(const uint8_t *)&one == 0;
+}
+
+static size_t arrow_field_type(fb_builder_t *b, const char *format, int *type) {
+    fb_start_table(b);
+    if (strcmp(format, "g") == 0) {
+        *type = ARROW_TYPE_FLOATING_POINT;
+        fb_add_scalar(b, 0, ARROW_PRECISION_DOUBLE, 2);
+    } else if (strcmp(format, "tdD") == 0) {
+        *type = ARROW_TYPE_DATE;
+        fb_add_scalar(b, 0, ARROW_DATE_DAY, 2);
+    } else if (strcmp(format, "ttu") == 0) {
+        *type = ARROW_TYPE_TIME;
+        fb_add_scalar(b, 1, 64, 4);
+        fb_add_scalar(b, 0, ARROW_TIME_MICROSECOND, 2);
+    } else if (strcmp(format, "tsu:") == 0) {
+        *type = ARROW_TYPE_TIMESTAMP;
+        fb_add_scalar(b, 0, ARROW_TIME_MICROSECOND, 2);
+    } else {
+        *type = ARROW_TYPE_UTF8;
+    }
+    return fb_end_table(b);
+}
+
+static size_t arrow_schema_table(fb_builder_t *b, struct ArrowSchema *schema) {
+    size_t fields[schema->n_children];
+    for (int64_t i = 0; i < schema->n_children; i++) {
+        struct ArrowSchema *child = schema->children[i];
+        int type_type = 0;
+        size_t name = fb_string(b, child->name);
+        size_t type = arrow_field_type(b, child->format, &type_type);
+        fb_start_vector(b, 4, 0, 4);
+        size_t children = fb_end_vector(b, 0);
+
+        fb_start_table(b);
+        fb_add_offset(b, 0, name);
+        fb_add_offset(b, 3, type);
+        fb_add_offset(b, 5, children);
+        fb_add_scalar(b, 1, 1, 1);
+        fb_add_scalar(b, 2, type_type, 1);
+        fields[i] = fb_end_table(b);
+    }
+    size_t fields_vector = fb_offset_vector(b, fields, schema->n_children);
+
+    fb_start_table(b);
+    fb_add_offset(b, 1, fields_vector);
+    fb_add_scalar(b, 0, is_big_endian(), 2);
+    return fb_end_table(b);
+}
+
+static size_t arrow_message(fb_builder_t *b, int header_type, size_t header, int64_t body_length) {
+    fb_start_table(b);
+    fb_add_scalar(b, 3, body_length, 8);
+    fb_add_offset(b, 2, header);
+    fb_add_scalar(b, 0, ARROW_METADATA_V5, 2);
+    fb_add_scalar(b, 1, header_type, 1);
+    return fb_end_table(b);
+}
+
+static void file_write(arrow_file_t *f, const void *data, size_t len) {
+    if (f->error || len == 0)
+        return;
+    if (fwrite(data, 1, len, f->stream) != len) {
+        fprintf(stderr, "Error writing %s: %s\n", f->path, strerror(errno));
+        f->error = 1;
+    }
+    f->position += len;
+}
+
+static void file_pad(arrow_file_t *f) {
+    static const uint8_t zeros[8];
+    file_write(f, zeros, (8 - (f->position & 7)) & 7);
+}
+
+/* An encapsulated message: continuation marker, metadata length, the
+ * FlatBuffer padded to 8 bytes. Returns the length including the prefix. */
+static int32_t write_message(arrow_file_t *f, fb_builder_t *b) {
+    uint8_t prefix[8];
+    size_t padded = (b->size + 8 + 7) / 8 * 8 - 8;
+    put_le(prefix, ARROW_CONTINUATION, 4);
+    put_le(prefix + 4, padded, 4);
+    file_write(f, prefix, sizeof(prefix));
+    file_write(f, b->buf + b->capacity - b->size, b->size);
+    file_pad(f);
+    return padded + 8;
+}
+
+static size_t value_width(const char *format) {
+    if (strcmp(format, "tdD") == 0)
+        return 4;
+    if (strcmp(format, "u") == 0)
+        return 0;
+    return 8;
+}
+
+/* Validity, then values or offsets, then string data, for each column */
+static size_t batch_buffers(arrow_file_t *f, struct ArrowArray *batch, int64_t *lengths) {
+    size_t n = 0;
+    for (int64_t i = 0; i < batch->n_children; i++) {
+        struct ArrowArray *child = batch->children[i];
+        size_t width = value_width(f->schema.children[i]->format);
+        lengths[n++] = child->buffers[0] ? (child->length + 7) / 8 : 0;
+        if (width) {
+            lengths[n++] = child->length * width;
+        } else {
+            const int32_t *offsets = child->buffers[1];
+            lengths[n++] = (child->length + 1) * sizeof(int32_t);
+            lengths[n++] = offsets[child->length];
+        }
+    }
+    return n;
+}
+
+static void write_record_batch(arrow_file_t *f, fb_builder_t *b, struct ArrowArray *batch) {
+    int64_t lengths[3 * batch->n_children];
+    const void *data[3 * batch->n_children];
+    size_t num_buffers = batch_buffers(f, batch, lengths);
+    for (int64_t i = 0, n = 0; i < batch->n_children; i++) {
+        struct ArrowArray *child = batch->children[i];
+        for (int64_t j = 0; j < child->n_buffers; j++)
+            data[n++] = child->buffers[j];
+    }
+
+    fb_reset(b);
+    int64_t body_length = 0;
+    fb_start_vector(b, 16, num_buffers, 8);
+    for (size_t i = num_buffers; i > 0; i--) {
+        body_length += (lengths[i-1] + 7) / 8 * 8;
+    }
+    for (size_t i = num_buffers, offset = body_length; i > 0; i--) {
+        offset -= (lengths[i-1] + 7) / 8 * 8;
+        fb_push(b, lengths[i-1], 8);
+        fb_push(b, offset, 8);
+    }
+    size_t buffers = fb_end_vector(b, num_buffers);
+
+    fb_start_vector(b, 16, batch->n_children, 8);
+    for (int64_t i = batch->n_children; i > 0; i--) {
+        fb_push(b, batch->children[i-1]->null_count, 8);
+        fb_push(b, batch->children[i-1]->length, 8);
+    }
+    size_t nodes = fb_end_vector(b, batch->n_children);
+
+    fb_start_table(b);
+    fb_add_scalar(b, 0, batch->length, 8);
+    fb_add_offset(b, 1, nodes);
+    fb_add_offset(b, 2, buffers);
+    size_t record_batch = fb_end_table(b);
+    fb_finish(b, arrow_message(b, ARROW_HEADER_RECORD_BATCH, record_batch, body_length));
+
+    if (f->num_blocks == f->blocks_capacity) {
+        f->blocks_capacity = f->blocks_capacity ? 2 * f->blocks_capacity : 16;
+        f->blocks = realloc(f->blocks, f->blocks_capacity * sizeof(arrow_block_t));
+    }
+    arrow_block_t *block = &f->blocks[f->num_blocks++];
+    block->offset = f->position;
+    block->metadata_length = write_message(f, b);
+    block->body_length = body_length;
+
+    for (size_t i = 0; i < num_buffers; i++) {
+        file_write(f, data[i], lengths[i]);
+        file_pad(f);
+    }
+}
+
+static int open_file(arrow_file_t *f, fb_builder_t *b) {
+    f->stream = fopen(f->path, "wb");
+    if (!f->stream) {
+        fprintf(stderr, "Couldn't open file for writing: %s\n", f->path);
+        return -1;
+    }
+    file_write(f, ARROW_MAGIC "\0\0", 8);
+
+    fb_reset(b);
+    size_t schema = arrow_schema_table(b, &f->schema);
+    fb_finish(b, arrow_message(b, ARROW_HEADER_SCHEMA, schema, 0));
+    write_message(f, b);
+    return 0;
+}
+
+static void close_file(arrow_file_t *f, fb_builder_t *b) {
+    uint8_t eos[8];
+    put_le(eos, ARROW_CONTINUATION, 4);
+    put_le(eos + 4, 0, 4);
+    file_write(f, eos, sizeof(eos));
+
+    fb_reset(b);
+    size_t schema = arrow_schema_table(b, &f->schema);
+    fb_start_vector(b, 24, f->num_blocks, 8);
+    for (size_t i = f->num_blocks; i > 0; i--) {
+        arrow_block_t *block = &f->blocks[i-1];
+        fb_push(b, block->body_length, 8);
+        fb_push(b, 0, 4);
+        fb_push(b, block->metadata_length, 4);
+        fb_push(b, block->offset, 8);
+    }
+    size_t record_batches = fb_end_vector(b, f->num_blocks);
+    fb_start_vector(b, 24, 0, 8);
+    size_t dictionaries = fb_end_vector(b, 0);
+
+    fb_start_table(b);
+    fb_add_offset(b, 1, schema);
+    fb_add_offset(b, 2, dictionaries);
+    fb_add_offset(b, 3, record_batches);
+    fb_add_scalar(b, 0, ARROW_METADATA_V5, 2);
+    fb_finish(b, fb_end_table(b));
+
+    uint8_t trailer[4];
+    put_le(trailer, b->size, 4);
+    file_write(f, b->buf + b->capacity - b->size, b->size);
+    file_write(f, trailer, sizeof(trailer));
+    file_write(f, ARROW_MAGIC, 6);
+
+    if (fclose(f->stream) != 0 && !f->error) {
+        fprintf(stderr, "Error writing %s: %s\n", f->path, strerror(errno));
+        f->error = 1;
+    }
+}
+
+static fmp_handler_status_t handle_batch(int table_index, struct ArrowArray *batch, void *ctxp) {
+    arrow_ctx_t *ctx = (arrow_ctx_t *)ctxp;
+    arrow_file_t *f = ctx->files_by_index[table_index];
+    if (!f->error)
+        write_record_batch(f, &ctx->fb, batch);
+    batch->release(batch);
+    return FMP_HANDLER_OK;
+}
+
+static void print_help(const char *prog) {
+    printf("Usage: %s [options] input.fmp output-directory\n", prog);
+    printf("Writes one Arrow IPC file (Feather v2) per table, named after the table\n");
+    printf("Options:\n");
+    printf("  --batch-rows N  Rows per record batch (default 65536)\n");
+    printf("  --typed-values  Write number, date and time columns as Arrow types; values\n");
+    printf("                  that don't parse are written as null and reported\n");
+    printf("  --help, -h      Show this help message\n");
+}
+
+int main(int argc, char *argv[]) {
+    arrow_ctx_t ctx = { .files = NULL };
+    size_t batch_rows = 65536;
+    int flags = 0;
+
+    const char *args[2] = { NULL, NULL };
+    int num_args = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--batch-rows") == 0 && i + 1 < argc) {
+            long value = atol(argv[++i]);
+            if (value < 1) {
+                fprintf(stderr, "Invalid value for --batch-rows: %s\n", argv[i]);
+                return 1;
+            }
+            batch_rows = value;
+        } else if (strcmp(argv[i], "--typed-values") == 0) {
+            flags |= FMP_ARROW_TYPED_VALUES;
+        } else if (strcmp(argv[i], "--text-values") == 0) {
+            /* The default; still accepted */
+        } else if (strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-h") == 0) {
+            print_help(argv[0]);
+            return 0;
+        } else if (num_args < 2 && argv[i][0] != '-') {
+            args[num_args++] = argv[i];
+        } else {
+            print_usage_and_exit(argc, argv);
+        }
+    }
+
+    if (num_args != 2) {
+        print_usage_and_exit(argc, argv);
+    }
+
+    fmp_error_t error = FMP_OK;
+    fmp_unparsed_array_t *unparsed = NULL;
+    fmp_file_t *file = fmp_open_file(args[0], &error);
+    if (!file) {
+        fprintf(stderr, "Error code: %d\n", error);
+        return 1;
+    }
+
+    fmp_metadata_t *metadata = fmp_discover_all_metadata(file, &error);
+    if (!metadata) {
+        fprintf(stderr, "Error code: %d\n", error);
+        return 1;
+    }
+
+    table_files_t files;
+    if (table_files_init(&files, args[1], ".arrow") != 0)
+        return 1;
+
+    fmp_table_array_t *tables = metadata->tables;
+    ctx.files = calloc(tables->count, sizeof(arrow_file_t));
+    for (int i = 0; i < tables->count; i++) {
+        if (tables->tables[i].index >= ctx.num_indexes)
+            ctx.num_indexes = tables->tables[i].index + 1;
+    }
+    ctx.files_by_index = calloc(ctx.num_indexes, sizeof(arrow_file_t *));
+
+    /* The same tables fmp_read_all_arrow produces batches for */
+    int num_files = 0;
+    for (int i = 0; i < tables->count; i++) {
+        fmp_column_array_t *columns = i < metadata->columns_capacity ? metadata->columns[i] : NULL;
+        if (tables->tables[i].skip || !columns || columns->count == 0)
+            continue;
+
+        arrow_file_t *f = &ctx.files[num_files++];
+        f->table = &tables->tables[i];
+        f->path = table_files_path(&files, f->table);
+        error = fmp_arrow_schema(columns, flags, &f->schema);
+        if (error != FMP_OK) {
+            fprintf(stderr, "Error code: %d\n", error);
+            return 1;
+        }
+        if (open_file(f, &ctx.fb) != 0)
+            return 1;
+        ctx.files_by_index[f->table->index] = f;
+    }
+
+    error = fmp_read_all_arrow(file, metadata, batch_rows, flags, &handle_batch, &ctx, &unparsed);
+
+    int retval = 0;
+    if (error != FMP_OK) {
+        fprintf(stderr, "Error code: %d\n", error);
+        retval = 1;
+    } else if (table_files_report_unparsed(metadata, unparsed)) {
+        retval = 1;
+    }
+    for (int i = 0; i < num_files; i++) {
+        arrow_file_t *f = &ctx.files[i];
+        close_file(f, &ctx.fb);
+        if (f->error)
+            retval = 1;
+        f->schema.release(&f->schema);
+        free(f->blocks);
+    }
+    free(ctx.fb.buf);
+    free(ctx.files);
+    free(ctx.files_by_index);
+    table_files_free(&files);
+    fmp_free_unparsed(unparsed);
+    fmp_free_metadata(metadata);
+    fmp_close_file(file);
+
+    return retval;
+}
@@ -0,0 +1,499 @@
+/* FMP Tools - A library for reading FileMaker Pro databases
+ * Copyright (c) 2020 Evan Miller (except where otherwise noted)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/* Writes one CSV (or tab-separated) file per table from a single scan.
+ * Values are collected per table until a row is complete; the row is then
+ * quoted and appended to the table's output buffer, either on the scanning
+ * thread or, with --jobs, on a writer thread that owns the table. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <pthread.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "../fmp.h"
+#include "table_files.h"
+#include "usage.h"
+
+/* Output is written to the table's file in chunks of about this size */
+#define CSV_BUFFER_SIZE (1 << 20)
+
+/* Rows are handed to writer threads in batches of about this size */
+#define CSV_BATCH_SIZE (256 * 1024)
+
+typedef struct buffer_s {
+    char *data;
+    size_t len;
+    size_t capacity;
+} buffer_t;
+
+typedef struct csv_field_s {
+    size_t offset;
+    size_t len;
+    int set;
+} csv_field_t;
+
+typedef struct csv_batch_s {
+    struct csv_batch_s *next;
+    struct csv_table_s *table;
+    buffer_t rows;  /* Per field: a uint32_t length, then the bytes */
+} csv_batch_t;
+
+typedef struct csv_table_s {
+    fmp_table_t *table;
+    fmp_column_array_t *columns;
+    int *positions;         /* Output position by column index */
+    size_t num_indexes;
+    FILE *stream;
+    const char *path;
+    int error;
+
+    /* The row being collected */
+    int last_row;
+    csv_field_t *fields;
+    buffer_t values;
+
+    buffer_t out;
+    csv_batch_t *batch;
+    struct csv_writer_s *writer;
+} csv_table_t;
+
+typedef struct csv_writer_s {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    csv_batch_t *head;
+    csv_batch_t *tail;
+    int done;
+} csv_writer_t;
+
+typedef struct csv_ctx_s {
+    char delimiter;
+    csv_table_t *tables;
+    csv_table_t **tables_by_index;
+    size_t num_indexes;
+    csv_writer_t *writers;
+    int jobs;
+} csv_ctx_t;
+
+static void buffer_reserve(buffer_t *b, size_t extra) {
+    if (b->len + extra <= b->capacity)
+        return;
+    b->capacity = 2 * (b->len + extra);
+    b->data = realloc(b->data, b->capacity);
+}
+
+static void buffer_append(buffer_t *b, const void *data, size_t len) {
+    buffer_reserve(b, len);
+    memcpy(b->data + b->len, data, len);
+    b->len += len;
+}
+
+/* Returns the offset of the first byte that forces the field to be quoted,
+ * or len if there is none. Sixteen bytes are checked at a time where the
+ * platform has vector compares. */
+static size_t find_special(const char *s, size_t len, char delimiter) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128i d = _mm_set1_epi8(delimiter);
+    const __m128i q = _mm_set1_epi8('"');
+    const __m128i n = _mm_set1_epi8('\n');
+    const __m128i r = _mm_set1_epi8('\r');
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+        __m128i m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, d), _mm_cmpeq_epi8(v, q)),
+                                 _mm_or_si128(_mm_cmpeq_epi8(v, n), _mm_cmpeq_epi8(v, r)));
+        int mask = _mm_movemask_epi8(m);
+        if (mask)
+            return i + __builtin_ctz(mask);
+    }
+#elif defined(__ARM_NEON)
+    const uint8x16_t d = vdupq_n_u8(delimiter);
+    const uint8x16_t q = vdupq_n_u8('"');
+    const uint8x16_t n = vdupq_n_u8('\n');
+    const uint8x16_t r = vdupq_n_u8('\r');
+    for (; i + 16 <= len; i += 16) {
+        uint8x16_t v = vld1q_u8((const uint8_t *)(s + i));
+        uint8x16_t m = vorrq_u8(vorrq_u8(vceqq_u8(v, d), vceqq_u8(v, q)),
+                                vorrq_u8(vceqq_u8(v, n), vceqq_u8(v, r)));
+        if (vmaxvq_u8(m))
+            break;
+    }
+#endif
+    for (; i < len; i++) {
+        char c = s[i];
+        if (c == delimiter || c == '"' || c == '\n' || c == '\r')
+            return i;
+    }
+    return len;
+}
+
+static void append_field(buffer_t *out, const char *s, size_t len, char delimiter) {
+    size_t special = find_special(s, len, delimiter);
+    if (special == len) {
+        buffer_append(out, s, len);
+        return;
+    }
+    /* Quote the field and double any quotes inside it */
+    buffer_reserve(out, 2 * len + 2);
+    char *p = out->data + out->len;
+    *p++ = '"';
+    memcpy(p, s, special);
+    p += special;
+    for (size_t i = special; i < len; i++) {
+        if (s[i] == '"')
+            *p++ = '"';
+        *p++ = s[i];
+    }
+    *p++ = '"';
+    out->len = p - out->data;
+}
+
+static int flush_table(csv_table_t *t, size_t threshold) {
+    if (t->out.len < threshold || t->out.len == 0)
+        return 0;
+    if (!t->error && fwrite(t->out.data, t->out.len, 1, t->stream) != 1) {
+        fprintf(stderr, "Error writing %s: %s\n", t->path, strerror(errno));
+        t->error = 1;
+    }
+    t->out.len = 0;
+    return t->error ? -1 : 0;
+}
+
+static void append_row(csv_table_t *t, const char **values, const size_t *lens, char delimiter) {
+    for (size_t i = 0; i < t->columns->count; i++) {
+        if (i)
+            buffer_append(&t->out, &delimiter, 1);
+        append_field(&t->out, values[i], lens[i], delimiter);
+    }
+    buffer_append(&t->out, "\n", 1);
+    flush_table(t, CSV_BUFFER_SIZE);
+}
+
+/* Formats the rows of a batch; runs on the writer thread that owns the table */
+static void write_batch(csv_batch_t *batch, char delimiter) {
+    csv_table_t *t = batch->table;
+    size_t count = t->columns->count;
+    const char *values[count];
+    size_t lens[count];
+    size_t offset = 0;
+    while (offset < batch->rows.len) {
+        for (size_t i = 0; i < count; i++) {
+            uint32_t len;
+            memcpy(&len, batch->rows.data + offset, sizeof(len));
+            offset += sizeof(len);
+            values[i] = batch->rows.data + offset;
+            lens[i] = len;
+            offset += len;
+        }
+        append_row(t, values, lens, delimiter);
+    }
+}
+
+static void free_batch(csv_batch_t *batch) {
+    free(batch->rows.data);
+    free(batch);
+}
+
+static void *writer_main(void *arg) {
+    csv_ctx_t *ctx = (csv_ctx_t *)((void **)arg)[0];
+    csv_writer_t *w = (csv_writer_t *)((void **)arg)[1];
+    free(arg);
+
+    pthread_mutex_lock(&w->lock);
+    while (1) {
+        while (!w->head && !w->done)
+            pthread_cond_wait(&w->cond, &w->lock);
+        csv_batch_t *batch = w->head;
+        if (!batch)
+            break;
+        w->head = batch->next;
+        if (!w->head)
+            w->tail = NULL;
+        pthread_mutex_unlock(&w->lock);
+
+        write_batch(batch, ctx->delimiter);
+        free_batch(batch);
+
+        pthread_mutex_lock(&w->lock);
+    }
+    pthread_mutex_unlock(&w->lock);
+    return NULL;
+}
+
+static void submit_batch(csv_table_t *t) {
+    csv_batch_t *batch = t->batch;
+    csv_writer_t *w = t->writer;
+    if (!batch)
+        return;
+    t->batch = NULL;
+    pthread_mutex_lock(&w->lock);
+    if (w->tail) {
+        w->tail->next = batch;
+    } else {
+        w->head = batch;
+    }
+    w->tail = batch;
+    pthread_cond_signal(&w->cond);
+    pthread_mutex_unlock(&w->lock);
+}
+
+static void end_row(csv_ctx_t *ctx, csv_table_t *t) {
+    size_t count = t->columns->count;
+    if (!t->last_row)
+        return;
+
+    if (t->writer) {
+        if (!t->batch) {
+            t->batch = calloc(1, sizeof(csv_batch_t));
+            t->batch->table = t;
+        }
+        for (size_t i = 0; i < count; i++) {
+            uint32_t len = t->fields[i].set ? t->fields[i].len : 0;
+            buffer_append(&t->batch->rows, &len, sizeof(len));
+            buffer_append(&t->batch->rows, t->values.data + t->fields[i].offset, len);
+        }
+        if (t->batch->rows.len >= CSV_BATCH_SIZE)
+            submit_batch(t);
+    } else {
+        const char *values[count];
+        size_t lens[count];
+        for (size_t i = 0; i < count; i++) {
+            values[i] = t->values.data + t->fields[i].offset;
+            lens[i] = t->fields[i].set ? t->fields[i].len : 0;
+        }
+        append_row(t, values, lens, ctx->delimiter);
+    }
+
+    memset(t->fields, 0, count * sizeof(csv_field_t));
+    t->values.len = 0;
+    t->last_row = 0;
+}
+
+fmp_handler_status_t handle_value(int table_index, int row, fmp_column_t *column, const char *value, void *ctxp) {
+    csv_ctx_t *ctx = (csv_ctx_t *)ctxp;
+    if (table_index >= ctx->num_indexes || !ctx->tables_by_index[table_index])
+        return FMP_HANDLER_OK;
+
+    csv_table_t *t = ctx->tables_by_index[table_index];
+    if (!t->writer && t->error)
+        return FMP_HANDLER_ABORT;
+    if (column->index >= t->num_indexes || t->positions[column->index] < 0)
+        return FMP_HANDLER_OK;
+
+    if (row != t->last_row) {
+        end_row(ctx, t);
+        t->last_row = row;
+    }
+    csv_field_t *field = &t->fields[t->positions[column->index]];
+    field->offset = t->values.len;
+    field->len = strlen(value);
+    field->set = 1;
+    buffer_append(&t->values, value, field->len);
+    return FMP_HANDLER_OK;
+}
+
+static int open_table(csv_table_t *t, const char *path, char delimiter) {
+    t->path = path;
+    t->stream = fopen(path, "wb");
+    if (!t->stream) {
+        fprintf(stderr, "Couldn't open file for writing: %s\n", path);
+        return -1;
+    }
+
+    for (size_t i = 0; i < t->columns->count; i++) {
+        if (t->columns->columns[i].index >= t->num_indexes)
+            t->num_indexes = t->columns->columns[i].index + 1;
+    }
+    t->positions = malloc(t->num_indexes * sizeof(int));
+    for (size_t i = 0; i < t->num_indexes; i++)
+        t->positions[i] = -1;
+    t->fields = calloc(t->columns->count, sizeof(csv_field_t));
+
+    const char *names[t->columns->count];
+    size_t lens[t->columns->count];
+    for (size_t i = 0; i < t->columns->count; i++) {
+        fmp_column_t *column = &t->columns->columns[i];
+        t->positions[column->index] = i;
+        names[i] = column->utf8_name;
+        lens[i] = strlen(column->utf8_name);
+    }
+    append_row(t, names, lens, delimiter);
+    return 0;
+}
+
+static void print_help(const char *prog) {
+    printf("Usage: %s [options] input.fmp output-directory\n", prog);
+    printf("Writes one file per table, named after the table\n");
+    printf("Options:\n");
+    printf("  --tsv           Separate values with tabs and write .tsv files\n");
+    printf("  --jobs N        Format and write tables on N threads (default 1)\n");
+    printf("  --help, -h      Show this help message\n");
+}
+
+int main(int argc, char *argv[]) {
+    csv_ctx_t ctx = { .delimiter = ',', .jobs = 1 };
+
+    const char *args[2] = { NULL, NULL };
+    int num_args = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--tsv") == 0) {
+            ctx.delimiter = '\t';
+        } else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) {
+            ctx.jobs = atoi(argv[++i]);
+            if (ctx.jobs < 1) {
+                fprintf(stderr, "Invalid value for --jobs: %s\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-h") == 0) {
+            print_help(argv[0]);
+            return 0;
+        } else if (num_args < 2 && argv[i][0] != '-') {
+            args[num_args++] = argv[i];
+        } else {
+            print_usage_and_exit(argc, argv);
+        }
+    }
+
+    if (num_args != 2) {
+        print_usage_and_exit(argc, argv);
+    }
+
+    const char *input_file = args[0];
+    const char *output_dir = args[1];
+    const char *extension = ctx.delimiter == '\t' ? ".tsv" : ".csv";
+
+    fmp_error_t error = FMP_OK;
+    fmp_file_t *file = fmp_open_file(input_file, &error);
+    if (!file) {
+        fprintf(stderr, "Error code: %d\n", error);
+        return 1;
+    }
+
+    fmp_metadata_t *metadata = fmp_discover_all_metadata(file, &error);
+    if (!metadata) {
+        fprintf(stderr, "Error code: %d\n", error);
+        return 1;
+    }
+
+    table_files_t files;
+    if (table_files_init(&files, output_dir, extension) != 0)
+        return 1;
+
+    fmp_table_array_t *tables = metadata->tables;
+    ctx.tables = calloc(tables->count, sizeof(csv_table_t));
+    for (int i = 0; i < tables->count; i++) {
+        if (tables->tables[i].index >= ctx.num_indexes)
+            ctx.num_indexes = tables->tables[i].index + 1;
+    }
+    ctx.tables_by_index = calloc(ctx.num_indexes, sizeof(csv_table_t *));
+
+    int num_tables = 0;
+    for (int i = 0; i < tables->count; i++) {
+        fmp_column_array_t *columns = i < metadata->columns_capacity ? metadata->columns[i] : NULL;
+        if (!columns || columns->count == 0)
+            continue;
+
+        csv_table_t *t = &ctx.tables[num_tables];
+        t->table = &tables->tables[i];
+        t->columns = columns;
+        if (open_table(t, table_files_path(&files, t->table), ctx.delimiter) != 0)
+            return 1;
+        ctx.tables_by_index[t->table->index] = t;
+        num_tables++;
+    }
+
+    /* Each table is bound to one writer, which keeps its rows in order */
+    if (ctx.jobs > num_tables)
+        ctx.jobs = num_tables;
+    if (ctx.jobs > 1) {
+        ctx.writers = calloc(ctx.jobs, sizeof(csv_writer_t));
+        for (int i = 0; i < ctx.jobs; i++) {
+            csv_writer_t *w = &ctx.writers[i];
+            void **arg = malloc(2 * sizeof(void *));
+            arg[0] = &ctx;
+            arg[1] = w;
+            pthread_mutex_init(&w->lock, NULL);
+            pthread_cond_init(&w->cond, NULL);
+            if (pthread_create(&w->thread, NULL, &writer_main, arg) != 0) {
+                fprintf(stderr, "Error starting writer thread\n");
+                return 1;
+            }
+        }
+        for (int i = 0; i < num_tables; i++)
+            ctx.tables[i].writer = &ctx.writers[i % ctx.jobs];
+    }
+
+    error = fmp_read_all_values(file, metadata, &handle_value, &ctx);
+
+    for (int i = 0; i < num_tables; i++) {
+        end_row(&ctx, &ctx.tables[i]);
+        if (ctx.tables[i].writer)
+            submit_batch(&ctx.tables[i]);
+    }
+    for (int i = 0; ctx.writers && i < ctx.jobs; i++) {
+        csv_writer_t *w = &ctx.writers[i];
+        pthread_mutex_lock(&w->lock);
+        w->done = 1;
+        pthread_cond_signal(&w->cond);
+        pthread_mutex_unlock(&w->lock);
+        pthread_join(w->thread, NULL);
+        pthread_mutex_destroy(&w->lock);
+        pthread_cond_destroy(&w->cond);
+    }
+
+    int retval = 0;
+    if (error != FMP_OK) {
+        fprintf(stderr, "Error code: %d\n", error);
+        retval = 1;
+    }
+    for (int i = 0; i < num_tables; i++) {
+        csv_table_t *t = &ctx.tables[i];
+        flush_table(t, 0);
+        if (fclose(t->stream) != 0 && !t->error) {
+            fprintf(stderr, "Error writing %s: %s\n", t->path, strerror(errno));
+            t->error = 1;
+        }
+        if (t->error)
+            retval = 1;
+        free(t->positions);
+        free(t->fields);
+        free(t->values.data);
+        free(t->out.data);
+    }
+    free(ctx.writers);
+    free(ctx.tables);
+    free(ctx.tables_by_index);
+    table_files_free(&files);
+    fmp_free_metadata(metadata);
+    fmp_close_file(file);
+
+    return retval;
+}
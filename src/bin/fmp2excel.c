@@ -22,39 +22,117 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <libgen.h>
 #include <xlsxwriter.h>
 
 #include "../fmp.h"
 #include "usage.h"
 
-fmp_handler_status_t handle_value(int row, fmp_column_t *column, const char *value, void *ctxp) {
-    lxw_worksheet *ws = (lxw_worksheet *)ctxp;
-    worksheet_write_string(ws, row, column->index-1, value, NULL);
+typedef struct my_ctx_s {
+    lxw_worksheet **worksheets;  /* By table index */
+    size_t num_indexes;
+    lxw_format *date_format;
+    lxw_format *time_format;
+    lxw_format *timestamp_format;
+    int text_values;
+} my_ctx_t;
+
+/* Numbers are written as numbers and dates and times as Excel date values;
+ * anything that doesn't parse is left as the original text */
+fmp_handler_status_t handle_value(int table_index, int row, fmp_column_t *column, const char *value, void *ctxp) {
+    my_ctx_t *ctx = (my_ctx_t *)ctxp;
+    if (table_index >= ctx->num_indexes || !ctx->worksheets[table_index])
+        return FMP_HANDLER_OK;
+
+    lxw_worksheet *ws = ctx->worksheets[table_index];
+    fmp_value_t parsed = { .type = FMP_VALUE_TEXT };
+    fmp_value_type_t type = FMP_VALUE_TEXT;
+    if (!ctx->text_values && column->type != FMP_COLUMN_TYPE_TEXT && column->type != FMP_COLUMN_TYPE_UNKNOWN)
+        type = fmp_parse_value(column->type, value, &parsed);
+
+    lxw_datetime datetime = {
+        .year = parsed.year, .month = parsed.month, .day = parsed.day,
+        .hour = parsed.hour, .min = parsed.minute, .sec = parsed.second + parsed.usec / 1e6
+    };
+    switch (type) {
+    case FMP_VALUE_INTEGER:
+    case FMP_VALUE_REAL:
+        worksheet_write_number(ws, row, column->index-1, parsed.real, NULL);
+        break;
+    case FMP_VALUE_DATE:
+        worksheet_write_datetime(ws, row, column->index-1, &datetime, ctx->date_format);
+        break;
+    case FMP_VALUE_TIME:
+        worksheet_write_datetime(ws, row, column->index-1, &datetime, ctx->time_format);
+        break;
+    case FMP_VALUE_TIMESTAMP:
+        worksheet_write_datetime(ws, row, column->index-1, &datetime, ctx->timestamp_format);
+        break;
+    default:
+        worksheet_write_string(ws, row, column->index-1, value, NULL);
+        break;
+    }
     return FMP_HANDLER_OK;
 }
 
 int main(int argc, char *argv[]) {
-    if (argc != 3) {
-        print_usage_and_exit(argc, argv);
+    int text_values = 0;
+    const char *paths[2] = { NULL, NULL };
+    int num_paths = 0;
+    for (int i=1; i<argc; i++) {
+        if (strcmp(argv[i], "--text-values") == 0) {
+            text_values = 1;
+        } else if (num_paths < 2 && argv[i][0] != '-') {
+            paths[num_paths++] = argv[i];
+        } else {
+            num_paths = 0;
+            break;
+        }
+    }
+    if (num_paths != 2) {
+        if (argc == 2)
+            print_usage_and_exit(argc, argv);
+        printf("Usage: %s [--text-values] [input file] [output file]\n", basename(argv[0]));
+        printf("  --text-values  Write all values as strings, as entered in FileMaker\n");
+        exit(1);
     }
 
     fmp_error_t error = FMP_OK;
-    lxw_workbook *wb = workbook_new_opt(argv[2], &(lxw_workbook_options){ .constant_memory = 1 });
+    lxw_workbook *wb = workbook_new_opt(paths[1], &(lxw_workbook_options){ .constant_memory = 1 });
     if (!wb) {
-        fprintf(stderr, "Error opening workbook at %s\n", argv[2]);
+        fprintf(stderr, "Error opening workbook at %s\n", paths[1]);
         return 1;
     }
-    fmp_file_t *file = fmp_open_file(argv[1], &error);
+    fmp_file_t *file = fmp_open_file(paths[0], &error);
     if (!file) {
         fprintf(stderr, "Error code: %d\n", error);
         return 1;
     }
-    fmp_table_array_t *tables = fmp_list_tables(file, &error);
-    if (!tables) {
+    fmp_metadata_t *metadata = fmp_discover_all_metadata(file, &error);
+    if (!metadata) {
         fprintf(stderr, "Error code: %d\n", error);
         return 1;
     }
+
+    my_ctx_t ctx = { .text_values = text_values };
+    ctx.date_format = workbook_add_format(wb);
+    format_set_num_format(ctx.date_format, "yyyy-mm-dd");
+    ctx.time_format = workbook_add_format(wb);
+    format_set_num_format(ctx.time_format, "hh:mm:ss");
+    ctx.timestamp_format = workbook_add_format(wb);
+    format_set_num_format(ctx.timestamp_format, "yyyy-mm-dd hh:mm:ss");
+
+    fmp_table_array_t *tables = metadata->tables;
+    for (int i=0; i<tables->count; i++) {
+        if (tables->tables[i].index >= ctx.num_indexes)
+            ctx.num_indexes = tables->tables[i].index + 1;
+    }
+    ctx.worksheets = calloc(ctx.num_indexes, sizeof(lxw_worksheet *));
+
+    /* In constant memory mode each worksheet spools its rows to its own
+     * temporary file, so the sheets can be filled side by side as long as
+     * each one gets its rows in order, which fmp_read_all_values ensures */
     for (int i=0; i<tables->count; i++) {
         fmp_table_t *table = &tables->tables[i];
         lxw_worksheet *ws = workbook_add_worksheet(wb, table->utf8_name);
@@ -63,23 +141,22 @@ int main(int argc, char *argv[]) {
             return 1;
         }
         worksheet_freeze_panes(ws, 1, 0);
-        fmp_column_array_t *columns = fmp_list_columns(file, table, &error);
-        if (!columns) {
-            fprintf(stderr, "Error code: %d\n", error);
-            return 1;
-        }
-        for (int j=0; j<columns->count; j++) {
+        fmp_column_array_t *columns = i < metadata->columns_capacity ? metadata->columns[i] : NULL;
+        for (int j=0; columns && j<columns->count; j++) {
             fmp_column_t *column = &columns->columns[j];
             worksheet_write_string(ws, 0, column->index-1, column->utf8_name, NULL);
         }
-        error = fmp_read_values(file, table, &handle_value, ws);
-        if (error != FMP_OK) {
-            fprintf(stderr, "Error code: %d\n", error);
-            return 1;
-        }
+        ctx.worksheets[table->index] = ws;
+    }
+
+    error = fmp_read_all_values(file, metadata, &handle_value, &ctx);
+    if (error != FMP_OK) {
+        fprintf(stderr, "Error code: %d\n", error);
+        return 1;
     }
     workbook_close(wb);
-    fmp_free_tables(tables);
+    free(ctx.worksheets);
+    fmp_free_metadata(metadata);
     fmp_close_file(file);
 
     return 0;
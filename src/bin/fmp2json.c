@@ -23,14 +23,46 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <libgen.h>
 #include <yajl/yajl_gen.h>
 
 #include "../fmp.h"
 #include "usage.h"
 
-typedef struct my_ctx_s {
+/* Generated JSON is written out whenever this much has accumulated */
+#define FLUSH_THRESHOLD 65536
+
+/* stdio buffer for --ndjson, which writes one line per row */
+#define NDJSON_BUFFER_SIZE (1 << 20)
+
+typedef struct line_buffer_s {
+    char *data;
+    size_t len;
+    size_t capacity;
+} line_buffer_t;
+
+/* Tables are generated side by side during the single scan; each one has
+ * its own generator, and all but the first spill into a temporary file once
+ * their buffer grows past FLUSH_THRESHOLD. */
+typedef struct table_output_s {
     yajl_gen g;
+    FILE *spill;
+    size_t skip;    /* Leading bytes of the buffer that belong to the framing */
     int last_row;
+
+    /* With --ndjson, rows are assembled here and written once complete */
+    line_buffer_t name;     /* The escaped table name */
+    line_buffer_t line;
+    size_t values_start;    /* Length of the line before its first value */
+} table_output_t;
+
+typedef struct my_ctx_s {
+    FILE *stream;
+    table_output_t *outputs;
+    table_output_t **outputs_by_index;
+    size_t num_indexes;
+    int text_values;
+    int write_error;
 } my_ctx_t;
 
 const char types[][10] = {
@@ -41,7 +73,8 @@ const char types[][10] = {
     [FMP_COLUMN_TYPE_CONTAINER] = "container",
     [FMP_COLUMN_TYPE_CALC] = "calc",
     [FMP_COLUMN_TYPE_SUMMARY] = "summary",
-    [FMP_COLUMN_TYPE_GLOBAL] = "global"
+    [FMP_COLUMN_TYPE_GLOBAL] = "global",
+    [FMP_COLUMN_TYPE_TIMESTAMP] = "timestamp"
 };
 
 const char collations[][3] = {
@@ -73,106 +106,389 @@ const char collations[][3] = {
     [FMP_COLLATION_SPANISH_ALT] = "es",
 };
 
-fmp_handler_status_t handle_value(int row, fmp_column_t *column, const char *value, void *ws) {
+static int write_output(table_output_t *out, FILE *stream) {
+    const unsigned char *buf = NULL;
+    size_t len = 0;
+    yajl_gen_get_buf(out->g, &buf, &len);
+    if (len > out->skip && fwrite(buf + out->skip, len - out->skip, 1, stream) != 1) {
+        fprintf(stderr, "Error writing output\n");
+        return -1;
+    }
+    yajl_gen_clear(out->g);
+    out->skip = 0;
+    return 0;
+}
+
+static int flush_output(table_output_t *out) {
+    const unsigned char *buf = NULL;
+    size_t len = 0;
+    yajl_gen_get_buf(out->g, &buf, &len);
+    if (len < FLUSH_THRESHOLD)
+        return 0;
+    if (!out->spill && !(out->spill = tmpfile())) {
+        fprintf(stderr, "Couldn't create temporary file\n");
+        return -1;
+    }
+    return write_output(out, out->spill);
+}
+
+static int copy_spill(FILE *spill, FILE *stream) {
+    char buf[FLUSH_THRESHOLD];
+    size_t len;
+    rewind(spill);
+    while ((len = fread(buf, 1, sizeof(buf), spill)) > 0) {
+        if (fwrite(buf, len, 1, stream) != 1) {
+            fprintf(stderr, "Error writing output\n");
+            return -1;
+        }
+    }
+    if (ferror(spill)) {
+        fprintf(stderr, "Error reading temporary file\n");
+        return -1;
+    }
+    return 0;
+}
+
+/* Each generator starts inside the top-level array (after a placeholder
+ * element, for all but the first table) so that yajl emits the same
+ * separators and indentation as for a single document. The framing is
+ * then dropped from the buffer. */
+static void begin_table(table_output_t *out, fmp_table_t *table, fmp_column_array_t *columns, int first) {
+    yajl_gen g = out->g = yajl_gen_alloc(NULL);
+    yajl_gen_config(g, yajl_gen_beautify, 1);
+
+    yajl_gen_array_open(g);
+    if (!first) {
+        const unsigned char *buf = NULL;
+        yajl_gen_null(g);
+        yajl_gen_get_buf(g, &buf, &out->skip);
+    }
+
+    yajl_gen_map_open(g);
+    yajl_gen_string(g, (const unsigned char *)"name", sizeof("name")-1);
+    yajl_gen_string(g, (const unsigned char *)table->utf8_name, strlen(table->utf8_name));
+    yajl_gen_string(g, (const unsigned char *)"columns", sizeof("columns")-1);
+    yajl_gen_array_open(g);
+    for (int k=0; columns && k<columns->count; k++) {
+        fmp_column_t *column = &columns->columns[k];
+        yajl_gen_map_open(g);
+        yajl_gen_string(g, (const unsigned char *)"name", sizeof("name")-1);
+        yajl_gen_string(g, (const unsigned char *)column->utf8_name, strlen(column->utf8_name));
+        if (column->type
+                && column->type < sizeof(types)/sizeof(types[0]) 
+                && types[column->type][0]) {
+            yajl_gen_string(g, (const unsigned char *)"type", sizeof("type")-1);
+            yajl_gen_string(g, (const unsigned char *)types[column->type], strlen(types[column->type]));
+        }
+        if (column->collation
+                && column->collation < sizeof(collations)/sizeof(collations[0])
+                && collations[column->collation][0]) {
+            yajl_gen_string(g, (const unsigned char *)"collation", sizeof("collation")-1);
+            yajl_gen_string(g, (const unsigned char *)collations[column->collation], 2);
+        }
+        yajl_gen_map_close(g);
+    }
+    yajl_gen_array_close(g);
+    yajl_gen_string(g, (const unsigned char *)"values", sizeof("values")-1);
+    yajl_gen_array_open(g);
+}
+
+static void end_table(table_output_t *out) {
+    if (out->last_row)
+        yajl_gen_map_close(out->g);
+    yajl_gen_array_close(out->g);
+    yajl_gen_map_close(out->g);
+}
+
+/* Closes the top-level array, again letting yajl decide on the whitespace */
+static int write_trailer(FILE *stream, size_t num_tables) {
+    yajl_gen g = yajl_gen_alloc(NULL);
+    const unsigned char *buf = NULL;
+    size_t skip = 0, len = 0;
+    int retval = 0;
+
+    yajl_gen_config(g, yajl_gen_beautify, 1);
+    yajl_gen_array_open(g);
+    if (num_tables) {
+        yajl_gen_null(g);
+        yajl_gen_get_buf(g, &buf, &skip);
+    }
+    yajl_gen_array_close(g);
+    yajl_gen_get_buf(g, &buf, &len);
+    if (fwrite(buf + skip, len - skip, 1, stream) != 1) {
+        fprintf(stderr, "Error writing output\n");
+        retval = -1;
+    }
+    yajl_gen_free(g);
+    return retval;
+}
+
+/* Numbers that parse cleanly become JSON numbers and dates and times are
+ * normalized to ISO-8601; anything else is left as the original text */
+static fmp_value_type_t typed_value(my_ctx_t *ctx, fmp_column_t *column, const char *value,
+        char *dst, size_t dst_len) {
+    fmp_value_t parsed;
+    if (ctx->text_values || column->type == FMP_COLUMN_TYPE_TEXT || column->type == FMP_COLUMN_TYPE_UNKNOWN)
+        return FMP_VALUE_TEXT;
+    if (fmp_parse_value(column->type, value, &parsed) == FMP_VALUE_TEXT)
+        return FMP_VALUE_TEXT;
+    fmp_format_value(&parsed, dst, dst_len);
+    return parsed.type;
+}
+
+fmp_handler_status_t handle_value(int table_index, int row, fmp_column_t *column, const char *value, void *ws) {
     my_ctx_t *ctx = (my_ctx_t *)ws;
-    if (row != ctx->last_row) {
-        if (ctx->last_row)
-            yajl_gen_map_close(ctx->g);
-        yajl_gen_map_open(ctx->g);
-    }
-    yajl_gen_string(ctx->g, (const unsigned char *)column->utf8_name, strlen(column->utf8_name));
-    yajl_gen_string(ctx->g, (const unsigned char *)value, strlen(value));
-    ctx->last_row = row;
+    if (table_index >= ctx->num_indexes || !ctx->outputs_by_index[table_index])
+        return FMP_HANDLER_OK;
+
+    table_output_t *out = ctx->outputs_by_index[table_index];
+    if (row != out->last_row) {
+        if (out->last_row) {
+            yajl_gen_map_close(out->g);
+            if (flush_output(out) != 0) {
+                ctx->write_error = 1;
+                return FMP_HANDLER_ABORT;
+            }
+        }
+        yajl_gen_map_open(out->g);
+    }
+    yajl_gen_string(out->g, (const unsigned char *)column->utf8_name, strlen(column->utf8_name));
+
+    char formatted[64];
+    switch (typed_value(ctx, column, value, formatted, sizeof(formatted))) {
+    case FMP_VALUE_INTEGER:
+    case FMP_VALUE_REAL:
+        yajl_gen_number(out->g, formatted, strlen(formatted));
+        break;
+    case FMP_VALUE_TEXT:
+        yajl_gen_string(out->g, (const unsigned char *)value, strlen(value));
+        break;
+    default:
+        yajl_gen_string(out->g, (const unsigned char *)formatted, strlen(formatted));
+        break;
+    }
+    out->last_row = row;
+    return FMP_HANDLER_OK;
+}
+
+static void line_reserve(line_buffer_t *b, size_t extra) {
+    if (b->len + extra <= b->capacity)
+        return;
+    b->capacity = 2 * (b->len + extra);
+    b->data = realloc(b->data, b->capacity);
+}
+
+static void line_append(line_buffer_t *b, const char *s, size_t len) {
+    line_reserve(b, len);
+    memcpy(b->data + b->len, s, len);
+    b->len += len;
+}
+
+/* Appends a quoted JSON string. Runs of bytes that need no escaping (nearly
+ * all of them) are copied with memcpy; space for the worst case is reserved
+ * up front so the loop never checks the capacity. */
+static void line_append_string(line_buffer_t *b, const char *s, size_t len) {
+    static const char hex[] = "0123456789abcdef";
+    line_reserve(b, 6 * len + 2);
+    char *p = b->data + b->len;
+    size_t start = 0;
+    *p++ = '"';
+    for (size_t i=0; i<len; i++) {
+        unsigned char c = s[i];
+        if (c >= 0x20 && c != '"' && c != '\\')
+            continue;
+        memcpy(p, s + start, i - start);
+        p += i - start;
+        start = i + 1;
+        *p++ = '\\';
+        switch (c) {
+            case '"': *p++ = '"'; break;
+            case '\\': *p++ = '\\'; break;
+            case '\n': *p++ = 'n'; break;
+            case '\r': *p++ = 'r'; break;
+            case '\t': *p++ = 't'; break;
+            case '\b': *p++ = 'b'; break;
+            case '\f': *p++ = 'f'; break;
+            default:
+                *p++ = 'u'; *p++ = '0'; *p++ = '0';
+                *p++ = hex[c >> 4]; *p++ = hex[c & 0xF];
+                break;
+        }
+    }
+    memcpy(p, s + start, len - start);
+    p += len - start;
+    *p++ = '"';
+    b->len = p - b->data;
+}
+
+static int end_row_ndjson(my_ctx_t *ctx, table_output_t *out) {
+    if (!out->last_row)
+        return 0;
+    line_append(&out->line, "}}\n", 3);
+    if (fwrite(out->line.data, out->line.len, 1, ctx->stream) != 1) {
+        fprintf(stderr, "Error writing output\n");
+        return -1;
+    }
+    out->line.len = 0;
+    out->last_row = 0;
+    return 0;
+}
+
+fmp_handler_status_t handle_value_ndjson(int table_index, int row, fmp_column_t *column, const char *value, void *ws) {
+    my_ctx_t *ctx = (my_ctx_t *)ws;
+    if (table_index >= ctx->num_indexes || !ctx->outputs_by_index[table_index])
+        return FMP_HANDLER_OK;
+
+    table_output_t *out = ctx->outputs_by_index[table_index];
+    if (row != out->last_row) {
+        char row_str[32];
+        if (end_row_ndjson(ctx, out) != 0) {
+            ctx->write_error = 1;
+            return FMP_HANDLER_ABORT;
+        }
+        line_append(&out->line, "{\"table\":", sizeof("{\"table\":")-1);
+        line_append(&out->line, out->name.data, out->name.len);
+        int row_len = snprintf(row_str, sizeof(row_str), ",\"row\":%d", row);
+        line_append(&out->line, row_str, row_len);
+        line_append(&out->line, ",\"values\":{", sizeof(",\"values\":{")-1);
+        out->values_start = out->line.len;
+        out->last_row = row;
+    } else if (out->line.len > out->values_start) {
+        line_append(&out->line, ",", 1);
+    }
+    line_append_string(&out->line, column->utf8_name, strlen(column->utf8_name));
+    line_append(&out->line, ":", 1);
+
+    char formatted[64];
+    switch (typed_value(ctx, column, value, formatted, sizeof(formatted))) {
+    case FMP_VALUE_INTEGER:
+    case FMP_VALUE_REAL:
+        line_append(&out->line, formatted, strlen(formatted));
+        break;
+    case FMP_VALUE_TEXT:
+        line_append_string(&out->line, value, strlen(value));
+        break;
+    default:
+        line_append_string(&out->line, formatted, strlen(formatted));
+        break;
+    }
     return FMP_HANDLER_OK;
 }
 
 int main(int argc, char *argv[]) {
-    if (argc != 3) {
-        print_usage_and_exit(argc, argv);
+    int ndjson = 0;
+    int text_values = 0;
+    const char *paths[2] = { NULL, NULL };
+    int num_paths = 0;
+    for (int i=1; i<argc; i++) {
+        if (strcmp(argv[i], "--ndjson") == 0) {
+            ndjson = 1;
+        } else if (strcmp(argv[i], "--text-values") == 0) {
+            text_values = 1;
+        } else if (num_paths < 2 && (argv[i][0] != '-' || argv[i][1] == '\0')) {
+            paths[num_paths++] = argv[i];
+        } else {
+            num_paths = 0;
+            break;
+        }
+    }
+    if (num_paths != 2) {
+        if (argc == 2)
+            print_usage_and_exit(argc, argv);
+        printf("Usage: %s [--ndjson] [--text-values] [input file] [output file]\n", basename(argv[0]));
+        printf("  --ndjson       Write one compact JSON object per record and line\n");
+        printf("  --text-values  Write all values as strings, as entered in FileMaker\n");
+        exit(1);
     }
 
     fmp_error_t error = FMP_OK;
-    yajl_gen g = yajl_gen_alloc(NULL);
-    my_ctx_t ctx = { .g = g };
+    my_ctx_t ctx = { .stream = stdout, .text_values = text_values };
 
-    fmp_file_t *file = fmp_open_file(argv[1], &error);
+    fmp_file_t *file = fmp_open_file(paths[0], &error);
     if (!file) {
         fprintf(stderr, "Error code: %d\n", error);
         return 1;
     }
 
-    fmp_table_array_t *tables = fmp_list_tables(file, &error);
-    if (!tables) {
+    if (strcmp(paths[1], "-")) {
+        ctx.stream = fopen(paths[1], "w");
+        if (!ctx.stream) {
+            fprintf(stderr, "Couldn't open file for writing: %s\n", paths[1]);
+            return 1;
+        }
+    }
+    if (ndjson)
+        setvbuf(ctx.stream, NULL, _IOFBF, NDJSON_BUFFER_SIZE);
+
+    fmp_metadata_t *metadata = fmp_discover_all_metadata(file, &error);
+    if (!metadata) {
         fprintf(stderr, "Error code: %d\n", error);
         return 1;
     }
 
-    yajl_gen_config(ctx.g, yajl_gen_beautify, 1);
+    fmp_table_array_t *tables = metadata->tables;
+    ctx.outputs = calloc(tables->count, sizeof(table_output_t));
+    for (int j=0; j<tables->count; j++) {
+        if (tables->tables[j].index >= ctx.num_indexes)
+            ctx.num_indexes = tables->tables[j].index + 1;
+    }
+    ctx.outputs_by_index = calloc(ctx.num_indexes, sizeof(table_output_t *));
 
-    yajl_gen_array_open(g);
     for (int j=0; j<tables->count; j++) {
         fmp_table_t *table = &tables->tables[j];
-        yajl_gen_map_open(g);
-        yajl_gen_string(g, (const unsigned char *)"name", sizeof("name")-1);
-        yajl_gen_string(g, (const unsigned char *)table->utf8_name, strlen(table->utf8_name));
-        yajl_gen_string(g, (const unsigned char *)"columns", sizeof("columns")-1);
-        yajl_gen_array_open(g);
-        fmp_column_array_t *columns = fmp_list_columns(file, table, &error);
-        for (int k=0; k<columns->count; k++) {
-            fmp_column_t *column = &columns->columns[k];
-            yajl_gen_map_open(g);
-            yajl_gen_string(g, (const unsigned char *)"name", sizeof("name")-1);
-            yajl_gen_string(g, (const unsigned char *)column->utf8_name, strlen(column->utf8_name));
-            if (column->type
-                    && column->type < sizeof(types)/sizeof(types[0]) 
-                    && types[column->type][0]) {
-                yajl_gen_string(g, (const unsigned char *)"type", sizeof("type")-1);
-                yajl_gen_string(g, (const unsigned char *)types[column->type], strlen(types[column->type]));
-            }
-            if (column->collation
-                    && column->collation < sizeof(collations)/sizeof(collations[0])
-                    && collations[column->collation][0]) {
-                yajl_gen_string(g, (const unsigned char *)"collation", sizeof("collation")-1);
-                yajl_gen_string(g, (const unsigned char *)collations[column->collation], 2);
-            }
-            yajl_gen_map_close(g);
+        fmp_column_array_t *columns = j < metadata->columns_capacity ? metadata->columns[j] : NULL;
+        if (ndjson) {
+            line_append_string(&ctx.outputs[j].name, table->utf8_name, strlen(table->utf8_name));
+        } else {
+            begin_table(&ctx.outputs[j], table, columns, j == 0);
         }
-        fmp_free_columns(columns);
-        yajl_gen_array_close(g);
-        yajl_gen_string(g, (const unsigned char *)"values", sizeof("values")-1);
-
-        yajl_gen_array_open(g);
-        ctx.last_row = 0;
-        error = fmp_read_values(file, table, &handle_value, &ctx);
-        if (error != FMP_OK) {
-            fprintf(stderr, "Error code: %d\n", error);
-            return 1;
-        }
-        if (ctx.last_row)
-            yajl_gen_map_close(g);
-        yajl_gen_array_close(g);
+        ctx.outputs_by_index[table->index] = &ctx.outputs[j];
+    }
+    /* The first table comes first in the output anyway */
+    if (tables->count)
+        ctx.outputs[0].spill = ctx.stream;
 
-        yajl_gen_map_close(g);
+    error = fmp_read_all_values(file, metadata, ndjson ? &handle_value_ndjson : &handle_value, &ctx);
+    if (error != FMP_OK && !ctx.write_error) {
+        fprintf(stderr, "Error code: %d\n", error);
+        return 1;
     }
-    yajl_gen_array_close(g);
-    fmp_free_tables(tables);
+    if (ctx.write_error)
+        return 1;
+
+    int retval = 0;
+    for (int j=0; ndjson && j<tables->count; j++) {
+        table_output_t *out = &ctx.outputs[j];
+        if (retval == 0)
+            retval = end_row_ndjson(&ctx, out);
+        free(out->name.data);
+        free(out->line.data);
+    }
+    for (int j=0; !ndjson && j<tables->count; j++) {
+        table_output_t *out = &ctx.outputs[j];
+        end_table(out);
+        if (retval == 0 && out->spill && out->spill != ctx.stream)
+            retval = copy_spill(out->spill, ctx.stream);
+        if (retval == 0)
+            retval = write_output(out, ctx.stream);
+        if (out->spill && out->spill != ctx.stream)
+            fclose(out->spill);
+        yajl_gen_free(out->g);
+    }
+    if (retval == 0 && !ndjson)
+        retval = write_trailer(ctx.stream, tables->count);
+
+    free(ctx.outputs);
+    free(ctx.outputs_by_index);
+    fmp_free_metadata(metadata);
     fmp_close_file(file);
 
-    FILE *stream = NULL;
-    if (strcmp(argv[2], "-")) {
-        stream = fopen(argv[2], "w");
-        if (!stream) {
-            fprintf(stderr, "Couldn't open file for writing: %s\n", argv[2]);
-            return 1;
+    if (ctx.stream != stdout) {
+        if (fclose(ctx.stream) != 0) {
+            fprintf(stderr, "Error writing output\n");
+            retval = -1;
         }
     }
-    const unsigned char * buf = NULL;
-    size_t len = 0;
-    yajl_gen_get_buf(g, &buf, &len);
-    fwrite(buf, len, 1, stream ? stream : stdout);
-    yajl_gen_free(ctx.g);
-    if (stream)
-        fclose(stream);
 
-    return 0;
+    return retval == 0 ? 0 : 1;
 }
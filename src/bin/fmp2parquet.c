@@ -0,0 +1,722 @@
+/* FMP Tools - A library for reading FileMaker Pro databases
+ * Copyright (c) 2020 Evan Miller (except where otherwise noted)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/* Writes one Parquet file per table from a single scan. Each record batch
+ * from fmp_read_all_arrow becomes a row group with one page per column.
+ * Columns are text unless --typed-values asks for numbers, dates and
+ * times, which are PLAIN-encoded; text columns with few distinct values
+ * in the row group get a dictionary page and RLE-encoded indices. Metadata is written with a minimal Thrift compact protocol
+ * encoder, so no Parquet library is needed. Pages are not compressed. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+
+#include "../fmp.h"
+#include "../fmp_arrow.h"
+#include "table_files.h"
+#include "usage.h"
+
+#define PARQUET_MAGIC "PAR1"
+
+/* A text column is dictionary-encoded when each distinct value repeats
+ * at least this many times on average, and the dictionary is small */
+#define DICTIONARY_MIN_REPEATS 2
+#define DICTIONARY_MAX_BYTES (1 << 20)
+
+/* parquet.thrift enumerations */
+enum {
+    PARQUET_INT32 = 1,
+    PARQUET_INT64 = 2,
+    PARQUET_DOUBLE = 5,
+    PARQUET_BYTE_ARRAY = 6
+};
+
+enum {
+    PARQUET_PLAIN = 0,
+    PARQUET_RLE = 3,
+    PARQUET_RLE_DICTIONARY = 8
+};
+
+enum {
+    PARQUET_DATA_PAGE = 0,
+    PARQUET_DICTIONARY_PAGE = 2
+};
+
+#define PARQUET_OPTIONAL 1
+#define PARQUET_CONVERTED_UTF8 0
+#define PARQUET_CONVERTED_DATE 6
+
+/* Thrift compact protocol types */
+enum {
+    THRIFT_TRUE = 1,
+    THRIFT_FALSE = 2,
+    THRIFT_I32 = 5,
+    THRIFT_I64 = 6,
+    THRIFT_BINARY = 8,
+    THRIFT_LIST = 9,
+    THRIFT_STRUCT = 12
+};
+
+#define THRIFT_MAX_DEPTH 8
+
+typedef enum {
+    COLUMN_DOUBLE,
+    COLUMN_DATE,
+    COLUMN_TIME,
+    COLUMN_TIMESTAMP,
+    COLUMN_STRING
+} column_kind_t;
+
+typedef struct buffer_s {
+    uint8_t *data;
+    size_t len;
+    size_t capacity;
+} buffer_t;
+
+typedef struct thrift_s {
+    buffer_t *out;
+    int16_t last_id[THRIFT_MAX_DEPTH];
+    int depth;
+} thrift_t;
+
+typedef struct column_chunk_s {
+    int64_t offset;
+    int64_t data_page_offset;
+    int64_t size;
+    int64_t num_values;
+    int dictionary;
+} column_chunk_t;
+
+typedef struct row_group_s {
+    int64_t num_rows;
+    column_chunk_t *columns;
+} row_group_t;
+
+typedef struct parquet_file_s {
+    fmp_table_t *table;
+    struct ArrowSchema schema;
+    column_kind_t *kinds;
+    const char *path;
+    FILE *stream;
+    int64_t position;
+    row_group_t *row_groups;
+    size_t num_row_groups;
+    size_t row_groups_capacity;
+    int error;
+} parquet_file_t;
+
+typedef struct parquet_ctx_s {
+    parquet_file_t *files;
+    parquet_file_t **files_by_index;
+    size_t num_indexes;
+    int use_dictionary;
+
+    /* Scratch space, reused for every page */
+    buffer_t page;
+    buffer_t header;
+    uint32_t *levels;
+    size_t levels_capacity;
+} parquet_ctx_t;
+
+static uint8_t *buffer_alloc(buffer_t *b, size_t len) {
+    if (b->len + len > b->capacity) {
+        size_t capacity = b->capacity ? 2 * b->capacity : 4096;
+        while (capacity < b->len + len)
+            capacity *= 2;
+        b->data = realloc(b->data, capacity);
+        b->capacity = capacity;
+    }
+    uint8_t *p = b->data + b->len;
+    b->len += len;
+    return p;
+}
+
+static void buffer_append(buffer_t *b, const void *data, size_t len) {
+    if (len)
+        memcpy(buffer_alloc(b, len), data, len);
+}
+
+static void buffer_put_le(buffer_t *b, uint64_t value, int len) {
+    uint8_t *p = buffer_alloc(b, len);
+    for (int i = 0; i < len; i++)
+        p[i] = (value >> (8 * i)) & 0xFF;
+}
+
+static void buffer_varint(buffer_t *b, uint64_t value) {
+    while (value >= 0x80) {
+        *buffer_alloc(b, 1) = (value & 0x7F) | 0x80;
+        value >>= 7;
+    }
+    *buffer_alloc(b, 1) = value;
+}
+
+static uint64_t zigzag(int64_t value) {
+    return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static void thrift_begin(thrift_t *t, buffer_t *out) {
+    t->out = out;
+    t->depth = 0;
+    t->last_id[0] = 0;
+}
+
+static void thrift_field(thrift_t *t, int type, int16_t id) {
+    int delta = id - t->last_id[t->depth];
+    if (delta > 0 && delta <= 15) {
+        *buffer_alloc(t->out, 1) = (delta << 4) | type;
+    } else {
+        *buffer_alloc(t->out, 1) = type;
+        buffer_varint(t->out, zigzag(id));
+    }
+    t->last_id[t->depth] = id;
+}
+
+static void thrift_i32(thrift_t *t, int16_t id, int32_t value) {
+    thrift_field(t, THRIFT_I32, id);
+    buffer_varint(t->out, zigzag(value));
+}
+
+static void thrift_i64(thrift_t *t, int16_t id, int64_t value) {
+    thrift_field(t, THRIFT_I64, id);
+    buffer_varint(t->out, zigzag(value));
+}
+
+static void thrift_bool(thrift_t *t, int16_t id, int value) {
+    thrift_field(t, value ? THRIFT_TRUE : THRIFT_FALSE, id);
+}
+
+static void thrift_binary(thrift_t *t, int16_t id, const char *s) {
+    size_t len = strlen(s);
+    thrift_field(t, THRIFT_BINARY, id);
+    buffer_varint(t->out, len);
+    buffer_append(t->out, s, len);
+}
+
+static void thrift_list(thrift_t *t, int16_t id, int type, size_t count) {
+    thrift_field(t, THRIFT_LIST, id);
+    if (count < 15) {
+        *buffer_alloc(t->out, 1) = (count << 4) | type;
+    } else {
+        *buffer_alloc(t->out, 1) = 0xF0 | type;
+        buffer_varint(t->out, count);
+    }
+}
+
+/* Starts a struct that is a list element; use thrift_struct for fields */
+static void thrift_push(thrift_t *t) {
+    t->last_id[++t->depth] = 0;
+}
+
+static void thrift_struct(thrift_t *t, int16_t id) {
+    thrift_field(t, THRIFT_STRUCT, id);
+    thrift_push(t);
+}
+
+static void thrift_end(thrift_t *t) {
+    *buffer_alloc(t->out, 1) = 0;
+    t->depth--;
+}
+
+static void thrift_empty_struct(thrift_t *t, int16_t id) {
+    thrift_struct(t, id);
+    thrift_end(t);
+}
+
+/* The RLE / bit-packing hybrid encoding, for definition levels and
+ * dictionary indices. Runs of 8 or more equal values are run-length
+ * encoded; everything else is bit-packed in groups of 8. */
+static size_t repeat_length(const uint32_t *values, size_t i, size_t n) {
+    size_t j = i + 1;
+    while (j < n && values[j] == values[i])
+        j++;
+    return j - i;
+}
+
+static void rle_encode(buffer_t *out, const uint32_t *values, size_t n, int bit_width) {
+    size_t i = 0;
+    while (i < n) {
+        size_t run = repeat_length(values, i, n);
+        if (run >= 8) {
+            buffer_varint(out, run << 1);
+            buffer_put_le(out, values[i], (bit_width + 7) / 8);
+            i += run;
+            continue;
+        }
+
+        size_t start = i;
+        while (i < n && repeat_length(values, i, n) < 8)
+            i += 8;
+        size_t groups = (i - start) / 8;
+        buffer_varint(out, (groups << 1) | 1);
+        uint8_t *p = buffer_alloc(out, groups * bit_width);
+        memset(p, 0, groups * bit_width);
+        for (size_t k = 0; k < groups * 8 && start + k < n; k++) {
+            uint32_t value = values[start + k];
+            size_t bit = k * bit_width;
+            for (int b = 0; b < bit_width; b++, bit++) {
+                if ((value >> b) & 1)
+                    p[bit / 8] |= 1 << (bit % 8);
+            }
+        }
+        if (i > n)
+            i = n;
+    }
+}
+
+static int bit_width(uint32_t max_value) {
+    int width = 1;
+    while (width < 32 && (max_value >> width))
+        width++;
+    return width;
+}
+
+static uint32_t *levels_reserve(parquet_ctx_t *ctx, size_t count) {
+    if (count > ctx->levels_capacity) {
+        ctx->levels = realloc(ctx->levels, count * sizeof(uint32_t));
+        ctx->levels_capacity = count;
+    }
+    return ctx->levels;
+}
+
+static int is_valid(const struct ArrowArray *array, int64_t i) {
+    const uint8_t *validity = array->buffers[0];
+    return !validity || (validity[i / 8] >> (i % 8)) & 1;
+}
+
+static column_kind_t column_kind(const struct ArrowSchema *schema) {
+    if (strcmp(schema->format, "g") == 0)
+        return COLUMN_DOUBLE;
+    if (strcmp(schema->format, "tdD") == 0)
+        return COLUMN_DATE;
+    if (strcmp(schema->format, "ttu") == 0)
+        return COLUMN_TIME;
+    if (strcmp(schema->format, "tsu:") == 0)
+        return COLUMN_TIMESTAMP;
+    return COLUMN_STRING;
+}
+
+static int physical_type(column_kind_t kind) {
+    switch (kind) {
+        case COLUMN_DOUBLE: return PARQUET_DOUBLE;
+        case COLUMN_DATE: return PARQUET_INT32;
+        case COLUMN_TIME: return PARQUET_INT64;
+        case COLUMN_TIMESTAMP: return PARQUET_INT64;
+        default: return PARQUET_BYTE_ARRAY;
+    }
+}
+
+static void append_string(buffer_t *out, const struct ArrowArray *strings, int64_t i) {
+    const int32_t *offsets = strings->buffers[1];
+    const char *data = strings->buffers[2];
+    buffer_put_le(out, offsets[i+1] - offsets[i], 4);
+    buffer_append(out, data + offsets[i], offsets[i+1] - offsets[i]);
+}
+
+/* PLAIN values of the non-null entries. Dictionary-encoded text is looked
+ * up, for columns whose dictionary isn't worth writing. */
+static void append_plain_values(buffer_t *out, const struct ArrowArray *array, column_kind_t kind) {
+    for (int64_t i = 0; i < array->length; i++) {
+        if (!is_valid(array, i))
+            continue;
+        if (kind == COLUMN_STRING) {
+            if (array->dictionary) {
+                const int32_t *indices = array->buffers[1];
+                append_string(out, array->dictionary, indices[i]);
+            } else {
+                append_string(out, array, i);
+            }
+        } else if (kind == COLUMN_DATE) {
+            buffer_put_le(out, ((const int32_t *)array->buffers[1])[i], 4);
+        } else if (kind == COLUMN_DOUBLE) {
+            uint64_t bits;
+            memcpy(&bits, &((const double *)array->buffers[1])[i], sizeof(bits));
+            buffer_put_le(out, bits, 8);
+        } else {
+            buffer_put_le(out, ((const int64_t *)array->buffers[1])[i], 8);
+        }
+    }
+}
+
+static int use_dictionary(const struct ArrowArray *array) {
+    const struct ArrowArray *dictionary = array->dictionary;
+    if (!dictionary || dictionary->length == 0)
+        return 0;
+    const int32_t *offsets = dictionary->buffers[1];
+    return dictionary->length * DICTIONARY_MIN_REPEATS <= array->length - array->null_count &&
+        offsets[dictionary->length] <= DICTIONARY_MAX_BYTES;
+}
+
+static void write_bytes(parquet_file_t *f, const void *data, size_t len) {
+    if (f->error || len == 0)
+        return;
+    if (fwrite(data, 1, len, f->stream) != len) {
+        fprintf(stderr, "Error writing %s: %s\n", f->path, strerror(errno));
+        f->error = 1;
+    }
+    f->position += len;
+}
+
+/* Writes a page header followed by the page in ctx->page */
+static void write_page(parquet_ctx_t *ctx, parquet_file_t *f, int page_type, int32_t num_values, int encoding) {
+    thrift_t t;
+    ctx->header.len = 0;
+    thrift_begin(&t, &ctx->header);
+    thrift_i32(&t, 1, page_type);
+    thrift_i32(&t, 2, ctx->page.len);
+    thrift_i32(&t, 3, ctx->page.len);
+    if (page_type == PARQUET_DICTIONARY_PAGE) {
+        thrift_struct(&t, 7);
+        thrift_i32(&t, 1, num_values);
+        thrift_i32(&t, 2, encoding);
+        thrift_end(&t);
+    } else {
+        thrift_struct(&t, 5);
+        thrift_i32(&t, 1, num_values);
+        thrift_i32(&t, 2, encoding);
+        thrift_i32(&t, 3, PARQUET_RLE);
+        thrift_i32(&t, 4, PARQUET_RLE);
+        thrift_end(&t);
+    }
+    *buffer_alloc(&ctx->header, 1) = 0;
+
+    write_bytes(f, ctx->header.data, ctx->header.len);
+    write_bytes(f, ctx->page.data, ctx->page.len);
+}
+
+static void write_column_chunk(parquet_ctx_t *ctx, parquet_file_t *f, const struct ArrowArray *array,
+        column_kind_t kind, column_chunk_t *chunk) {
+    chunk->offset = f->position;
+    chunk->num_values = array->length;
+    chunk->dictionary = kind == COLUMN_STRING && use_dictionary(array);
+
+    if (chunk->dictionary) {
+        const struct ArrowArray *dictionary = array->dictionary;
+        ctx->page.len = 0;
+        for (int64_t i = 0; i < dictionary->length; i++)
+            append_string(&ctx->page, dictionary, i);
+        write_page(ctx, f, PARQUET_DICTIONARY_PAGE, dictionary->length, PARQUET_PLAIN);
+    }
+    chunk->data_page_offset = f->position;
+
+    /* Definition levels: 1 for values, 0 for nulls, with a length prefix */
+    uint32_t *levels = levels_reserve(ctx, array->length);
+    for (int64_t i = 0; i < array->length; i++)
+        levels[i] = is_valid(array, i);
+    ctx->page.len = 0;
+    buffer_alloc(&ctx->page, 4);
+    rle_encode(&ctx->page, levels, array->length, 1);
+    for (int i = 0; i < 4; i++)
+        ctx->page.data[i] = ((ctx->page.len - 4) >> (8 * i)) & 0xFF;
+
+    if (chunk->dictionary) {
+        const int32_t *indices = array->buffers[1];
+        size_t n = 0;
+        for (int64_t i = 0; i < array->length; i++) {
+            if (is_valid(array, i))
+                levels[n++] = indices[i];
+        }
+        int width = bit_width(array->dictionary->length - 1);
+        *buffer_alloc(&ctx->page, 1) = width;
+        rle_encode(&ctx->page, levels, n, width);
+        write_page(ctx, f, PARQUET_DATA_PAGE, array->length, PARQUET_RLE_DICTIONARY);
+    } else {
+        append_plain_values(&ctx->page, array, kind);
+        write_page(ctx, f, PARQUET_DATA_PAGE, array->length, PARQUET_PLAIN);
+    }
+    chunk->size = f->position - chunk->offset;
+}
+
+static void write_row_group(parquet_ctx_t *ctx, parquet_file_t *f, struct ArrowArray *batch) {
+    if (f->num_row_groups == f->row_groups_capacity) {
+        f->row_groups_capacity = f->row_groups_capacity ? 2 * f->row_groups_capacity : 16;
+        f->row_groups = realloc(f->row_groups, f->row_groups_capacity * sizeof(row_group_t));
+    }
+    row_group_t *group = &f->row_groups[f->num_row_groups++];
+    group->num_rows = batch->length;
+    group->columns = calloc(batch->n_children, sizeof(column_chunk_t));
+    for (int64_t i = 0; i < batch->n_children; i++)
+        write_column_chunk(ctx, f, batch->children[i], f->kinds[i], &group->columns[i]);
+}
+
+static void write_schema_element(thrift_t *t, const struct ArrowSchema *column, column_kind_t kind) {
+    thrift_push(t);
+    thrift_i32(t, 1, physical_type(kind));
+    thrift_i32(t, 3, PARQUET_OPTIONAL);
+    thrift_binary(t, 4, column->name);
+    if (kind == COLUMN_STRING)
+        thrift_i32(t, 6, PARQUET_CONVERTED_UTF8);
+    if (kind == COLUMN_DATE)
+        thrift_i32(t, 6, PARQUET_CONVERTED_DATE);
+
+    /* LogicalType; times come from the file without a time zone */
+    if (kind != COLUMN_DOUBLE) {
+        thrift_struct(t, 10);
+        if (kind == COLUMN_STRING) {
+            thrift_empty_struct(t, 1);
+        } else if (kind == COLUMN_DATE) {
+            thrift_empty_struct(t, 6);
+        } else {
+            thrift_struct(t, kind == COLUMN_TIME ? 7 : 8);
+            thrift_bool(t, 1, 0);
+            thrift_struct(t, 2);
+            thrift_empty_struct(t, 2); /* MICROS */
+            thrift_end(t);
+            thrift_end(t);
+        }
+        thrift_end(t);
+    }
+    thrift_end(t);
+}
+
+static void write_column_meta_data(thrift_t *t, const struct ArrowSchema *column, column_kind_t kind,
+        const column_chunk_t *chunk) {
+    thrift_struct(t, 3);
+    thrift_i32(t, 1, physical_type(kind));
+    thrift_list(t, 2, THRIFT_I32, chunk->dictionary ? 3 : 2);
+    buffer_varint(t->out, zigzag(PARQUET_PLAIN));
+    buffer_varint(t->out, zigzag(PARQUET_RLE));
+    if (chunk->dictionary)
+        buffer_varint(t->out, zigzag(PARQUET_RLE_DICTIONARY));
+    thrift_list(t, 3, THRIFT_BINARY, 1);
+    buffer_varint(t->out, strlen(column->name));
+    buffer_append(t->out, column->name, strlen(column->name));
+    thrift_i32(t, 4, 0); /* UNCOMPRESSED */
+    thrift_i64(t, 5, chunk->num_values);
+    thrift_i64(t, 6, chunk->size);
+    thrift_i64(t, 7, chunk->size);
+    thrift_i64(t, 9, chunk->data_page_offset);
+    if (chunk->dictionary)
+        thrift_i64(t, 11, chunk->offset);
+    thrift_end(t);
+}
+
+static void write_footer(parquet_ctx_t *ctx, parquet_file_t *f) {
+    struct ArrowSchema *schema = &f->schema;
+    int64_t num_rows = 0;
+    for (size_t i = 0; i < f->num_row_groups; i++)
+        num_rows += f->row_groups[i].num_rows;
+
+    thrift_t t;
+    ctx->header.len = 0;
+    thrift_begin(&t, &ctx->header);
+    thrift_i32(&t, 1, 2);
+    thrift_list(&t, 2, THRIFT_STRUCT, schema->n_children + 1);
+    thrift_push(&t);
+    thrift_binary(&t, 4, "schema");
+    thrift_i32(&t, 5, schema->n_children);
+    thrift_end(&t);
+    for (int64_t i = 0; i < schema->n_children; i++)
+        write_schema_element(&t, schema->children[i], f->kinds[i]);
+    thrift_i64(&t, 3, num_rows);
+
+    thrift_list(&t, 4, THRIFT_STRUCT, f->num_row_groups);
+    for (size_t i = 0; i < f->num_row_groups; i++) {
+        row_group_t *group = &f->row_groups[i];
+        int64_t size = 0;
+        thrift_push(&t);
+        thrift_list(&t, 1, THRIFT_STRUCT, schema->n_children);
+        for (int64_t j = 0; j < schema->n_children; j++) {
+            thrift_push(&t);
+            thrift_i64(&t, 2, group->columns[j].offset);
+            write_column_meta_data(&t, schema->children[j], f->kinds[j], &group->columns[j]);
+            thrift_end(&t);
+            size += group->columns[j].size;
+        }
+        thrift_i64(&t, 2, size);
+        thrift_i64(&t, 3, group->num_rows);
+        if (schema->n_children)
+            thrift_i64(&t, 5, group->columns[0].offset);
+        thrift_i64(&t, 6, size);
+        thrift_field(&t, 4 /* I16 */, 7);
+        buffer_varint(t.out, zigzag(i));
+        thrift_end(&t);
+    }
+    thrift_binary(&t, 6, "fmptools version " VERSION);
+    *buffer_alloc(&ctx->header, 1) = 0;
+
+    uint8_t trailer[4];
+    for (int i = 0; i < 4; i++)
+        trailer[i] = (ctx->header.len >> (8 * i)) & 0xFF;
+    write_bytes(f, ctx->header.data, ctx->header.len);
+    write_bytes(f, trailer, sizeof(trailer));
+    write_bytes(f, PARQUET_MAGIC, 4);
+}
+
+static fmp_handler_status_t handle_batch(int table_index, struct ArrowArray *batch, void *ctxp) {
+    parquet_ctx_t *ctx = (parquet_ctx_t *)ctxp;
+    parquet_file_t *f = ctx->files_by_index[table_index];
+    if (!f->error)
+        write_row_group(ctx, f, batch);
+    batch->release(batch);
+    return FMP_HANDLER_OK;
+}
+
+static int open_file(parquet_file_t *f) {
+    f->stream = fopen(f->path, "wb");
+    if (!f->stream) {
+        fprintf(stderr, "Couldn't open file for writing: %s\n", f->path);
+        return -1;
+    }
+    f->kinds = malloc(f->schema.n_children * sizeof(column_kind_t));
+    for (int64_t i = 0; i < f->schema.n_children; i++)
+        f->kinds[i] = column_kind(f->schema.children[i]);
+    write_bytes(f, PARQUET_MAGIC, 4);
+    return 0;
+}
+
+static void close_file(parquet_ctx_t *ctx, parquet_file_t *f) {
+    write_footer(ctx, f);
+    if (fclose(f->stream) != 0 && !f->error) {
+        fprintf(stderr, "Error writing %s: %s\n", f->path, strerror(errno));
+        f->error = 1;
+    }
+}
+
+static void print_help(const char *prog) {
+    printf("Usage: %s [options] input.fmp output-directory\n", prog);
+    printf("Writes one Parquet file per table, named after the table\n");
+    printf("Options:\n");
+    printf("  --row-group-rows N  Rows per row group (default 65536)\n");
+    printf("  --no-dictionary     Write all text with plain encoding\n");
+    printf("  --typed-values      Write number, date and time columns as Parquet types;\n");
+    printf("                      values that don't parse are written as null and reported\n");
+    printf("  --help, -h          Show this help message\n");
+}
+
+int main(int argc, char *argv[]) {
+    parquet_ctx_t ctx = { .use_dictionary = 1 };
+    size_t row_group_rows = 65536;
+    int flags = 0;
+
+    const char *args[2] = { NULL, NULL };
+    int num_args = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--row-group-rows") == 0 && i + 1 < argc) {
+            long value = atol(argv[++i]);
+            if (value < 1) {
+                fprintf(stderr, "Invalid value for --row-group-rows: %s\n", argv[i]);
+                return 1;
+            }
+            row_group_rows = value;
+        } else if (strcmp(argv[i], "--no-dictionary") == 0) {
+            ctx.use_dictionary = 0;
+        } else if (strcmp(argv[i], "--typed-values") == 0) {
+            flags |= FMP_ARROW_TYPED_VALUES;
+        } else if (strcmp(argv[i], "--text-values") == 0) {
+            /* The default; still accepted */
+        } else if (strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-h") == 0) {
+            print_help(argv[0]);
+            return 0;
+        } else if (num_args < 2 && argv[i][0] != '-') {
+            args[num_args++] = argv[i];
+        } else {
+            print_usage_and_exit(argc, argv);
+        }
+    }
+
+    if (num_args != 2) {
+        print_usage_and_exit(argc, argv);
+    }
+    if (ctx.use_dictionary)
+        flags |= FMP_ARROW_DICTIONARY;
+
+    fmp_error_t error = FMP_OK;
+    fmp_unparsed_array_t *unparsed = NULL;
+    fmp_file_t *file = fmp_open_file(args[0], &error);
+    if (!file) {
+        fprintf(stderr, "Error code: %d\n", error);
+        return 1;
+    }
+
+    fmp_metadata_t *metadata = fmp_discover_all_metadata(file, &error);
+    if (!metadata) {
+        fprintf(stderr, "Error code: %d\n", error);
+        return 1;
+    }
+
+    table_files_t files;
+    if (table_files_init(&files, args[1], ".parquet") != 0)
+        return 1;
+
+    fmp_table_array_t *tables = metadata->tables;
+    ctx.files = calloc(tables->count, sizeof(parquet_file_t));
+    for (int i = 0; i < tables->count; i++) {
+        if (tables->tables[i].index >= ctx.num_indexes)
+            ctx.num_indexes = tables->tables[i].index + 1;
+    }
+    ctx.files_by_index = calloc(ctx.num_indexes, sizeof(parquet_file_t *));
+
+    /* The same tables fmp_read_all_arrow produces batches for */
+    int num_files = 0;
+    for (int i = 0; i < tables->count; i++) {
+        fmp_column_array_t *columns = i < metadata->columns_capacity ? metadata->columns[i] : NULL;
+        if (tables->tables[i].skip || !columns || columns->count == 0)
+            continue;
+
+        parquet_file_t *f = &ctx.files[num_files++];
+        f->table = &tables->tables[i];
+        f->path = table_files_path(&files, f->table);
+        error = fmp_arrow_schema(columns, flags & ~FMP_ARROW_DICTIONARY, &f->schema);
+        if (error != FMP_OK) {
+            fprintf(stderr, "Error code: %d\n", error);
+            return 1;
+        }
+        if (open_file(f) != 0)
+            return 1;
+        ctx.files_by_index[f->table->index] = f;
+    }
+
+    error = fmp_read_all_arrow(file, metadata, row_group_rows, flags, &handle_batch, &ctx, &unparsed);
+
+    int retval = 0;
+    if (error != FMP_OK) {
+        fprintf(stderr, "Error code: %d\n", error);
+        retval = 1;
+    } else if (table_files_report_unparsed(metadata, unparsed)) {
+        retval = 1;
+    }
+    for (int i = 0; i < num_files; i++) {
+        parquet_file_t *f = &ctx.files[i];
+        close_file(&ctx, f);
+        if (f->error)
+            retval = 1;
+        for (size_t j = 0; j < f->num_row_groups; j++)
+            free(f->row_groups[j].columns);
+        free(f->row_groups);
+        free(f->kinds);
+        f->schema.release(&f->schema);
+    }
+    free(ctx.page.data);
+    free(ctx.header.data);
+    free(ctx.levels);
+    free(ctx.files);
+    free(ctx.files_by_index);
+    table_files_free(&files);
+    fmp_free_unparsed(unparsed);
+    fmp_free_metadata(metadata);
+    fmp_close_file(file);
+
+    return retval;
+}
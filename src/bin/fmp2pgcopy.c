@@ -0,0 +1,411 @@
+/* FMP Tools - A library for reading FileMaker Pro databases
+ * Copyright (c) 2020 Evan Miller (except where otherwise noted)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/* Writes PostgreSQL binary COPY streams from a single scan: one file per
+ * table plus a load.sql with the CREATE TABLE statements and the \copy
+ * commands that load them, or a single table's stream on stdout. Columns
+ * are typed as in the Arrow export: text unless --typed-values is given,
+ * in which case values that don't parse as their column's type are
+ * written as NULL and reported. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+
+#include "../fmp.h"
+#include "../fmp_arrow.h"
+#include "table_files.h"
+#include "usage.h"
+
+/* The signature ends with a NUL byte */
+#define PGCOPY_SIGNATURE "PGCOPY\n\377\r\n"
+#define PGCOPY_SIGNATURE_LEN 11
+
+/* PostgreSQL dates and timestamps count from 2000-01-01 */
+#define POSTGRES_EPOCH_DAYS 10957
+#define POSTGRES_EPOCH_USEC (POSTGRES_EPOCH_DAYS * INT64_C(86400000000))
+
+#define OUTPUT_BUFFER_SIZE (1 << 20)
+
+typedef enum {
+    COLUMN_FLOAT8,
+    COLUMN_DATE,
+    COLUMN_TIME,
+    COLUMN_TIMESTAMP,
+    COLUMN_TEXT
+} column_kind_t;
+
+typedef struct buffer_s {
+    uint8_t *data;
+    size_t len;
+    size_t capacity;
+} buffer_t;
+
+typedef struct pg_table_s {
+    fmp_table_t *table;
+    struct ArrowSchema schema;
+    column_kind_t *kinds;
+    const char *path;
+    FILE *stream;
+    int error;
+} pg_table_t;
+
+typedef struct pg_ctx_s {
+    pg_table_t *tables;
+    pg_table_t **tables_by_index;
+    size_t num_indexes;
+    buffer_t out;
+} pg_ctx_t;
+
+static uint8_t *buffer_alloc(buffer_t *b, size_t len) {
+    if (b->len + len > b->capacity) {
+        size_t capacity = b->capacity ? 2 * b->capacity : 4096;
+        while (capacity < b->len + len)
+            capacity *= 2;
+        b->data = realloc(b->data, capacity);
+        b->capacity = capacity;
+    }
+    uint8_t *p = b->data + b->len;
+    b->len += len;
+    return p;
+}
+
+static void buffer_put_be(buffer_t *b, uint64_t value, int len) {
+    uint8_t *p = buffer_alloc(b, len);
+    for (int i = 0; i < len; i++)
+        p[i] = (value >> (8 * (len - 1 - i))) & 0xFF;
+}
+
+static column_kind_t column_kind(const struct ArrowSchema *schema) {
+    if (strcmp(schema->format, "g") == 0)
+        return COLUMN_FLOAT8;
+    if (strcmp(schema->format, "tdD") == 0)
+        return COLUMN_DATE;
+    if (strcmp(schema->format, "ttu") == 0)
+        return COLUMN_TIME;
+    if (strcmp(schema->format, "tsu:") == 0)
+        return COLUMN_TIMESTAMP;
+    return COLUMN_TEXT;
+}
+
+static const char *postgres_type(column_kind_t kind) {
+    switch (kind) {
+        case COLUMN_FLOAT8: return "double precision";
+        case COLUMN_DATE: return "date";
+        case COLUMN_TIME: return "time";
+        case COLUMN_TIMESTAMP: return "timestamp";
+        default: return "text";
+    }
+}
+
+static void write_identifier(FILE *out, const char *name) {
+    fputc('"', out);
+    for (const char *p = name; *p; p++) {
+        if (*p == '"')
+            fputc('"', out);
+        fputc(*p, out);
+    }
+    fputc('"', out);
+}
+
+static void write_create_table(FILE *out, pg_table_t *t) {
+    fprintf(out, "CREATE TABLE ");
+    write_identifier(out, t->table->utf8_name);
+    fprintf(out, " (");
+    for (int64_t i = 0; i < t->schema.n_children; i++) {
+        fprintf(out, i ? ",\n    " : "\n    ");
+        write_identifier(out, t->schema.children[i]->name);
+        fprintf(out, " %s", postgres_type(t->kinds[i]));
+    }
+    fprintf(out, "\n);\n");
+}
+
+/* psql's \copy reads the file relative to the current directory */
+static void write_copy_command(FILE *out, pg_table_t *t) {
+    const char *name = strrchr(t->path, '/') ? strrchr(t->path, '/') + 1 : t->path;
+    fprintf(out, "\\copy ");
+    write_identifier(out, t->table->utf8_name);
+    fprintf(out, " FROM '");
+    for (const char *p = name; *p; p++) {
+        if (*p == '\'')
+            fputc('\'', out);
+        fputc(*p, out);
+    }
+    fprintf(out, "' WITH (FORMAT binary)\n");
+}
+
+static void write_bytes(pg_table_t *t, const void *data, size_t len) {
+    if (t->error || len == 0)
+        return;
+    if (fwrite(data, 1, len, t->stream) != len) {
+        fprintf(stderr, "Error writing %s: %s\n", t->path, strerror(errno));
+        t->error = 1;
+    }
+}
+
+static void write_header(pg_table_t *t) {
+    uint8_t header[PGCOPY_SIGNATURE_LEN + 8] = PGCOPY_SIGNATURE;
+    /* Flags and header extension length are both zero */
+    write_bytes(t, header, sizeof(header));
+}
+
+static void write_trailer(pg_table_t *t) {
+    const uint8_t trailer[2] = { 0xFF, 0xFF };
+    write_bytes(t, trailer, sizeof(trailer));
+}
+
+static int is_valid(const struct ArrowArray *array, int64_t i) {
+    const uint8_t *validity = array->buffers[0];
+    return !validity || (validity[i / 8] >> (i % 8)) & 1;
+}
+
+static void append_field(buffer_t *out, const struct ArrowArray *array, column_kind_t kind, int64_t i) {
+    if (!is_valid(array, i)) {
+        buffer_put_be(out, UINT32_MAX, 4);
+        return;
+    }
+    const void *values = array->buffers[1];
+    if (kind == COLUMN_TEXT) {
+        const int32_t *offsets = values;
+        int32_t len = offsets[i+1] - offsets[i];
+        buffer_put_be(out, len, 4);
+        if (len)
+            memcpy(buffer_alloc(out, len), (const char *)array->buffers[2] + offsets[i], len);
+    } else if (kind == COLUMN_DATE) {
+        buffer_put_be(out, 4, 4);
+        buffer_put_be(out, (uint32_t)(((const int32_t *)values)[i] - POSTGRES_EPOCH_DAYS), 4);
+    } else if (kind == COLUMN_FLOAT8) {
+        uint64_t bits;
+        memcpy(&bits, &((const double *)values)[i], sizeof(bits));
+        buffer_put_be(out, 8, 4);
+        buffer_put_be(out, bits, 8);
+    } else {
+        int64_t usec = ((const int64_t *)values)[i];
+        if (kind == COLUMN_TIMESTAMP)
+            usec -= POSTGRES_EPOCH_USEC;
+        buffer_put_be(out, 8, 4);
+        buffer_put_be(out, (uint64_t)usec, 8);
+    }
+}
+
+static fmp_handler_status_t handle_batch(int table_index, struct ArrowArray *batch, void *ctxp) {
+    pg_ctx_t *ctx = (pg_ctx_t *)ctxp;
+    pg_table_t *t = table_index < ctx->num_indexes ? ctx->tables_by_index[table_index] : NULL;
+    if (t && !t->error) {
+        for (int64_t row = 0; row < batch->length; row++) {
+            buffer_put_be(&ctx->out, batch->n_children, 2);
+            for (int64_t i = 0; i < batch->n_children; i++)
+                append_field(&ctx->out, batch->children[i], t->kinds[i], row);
+            if (ctx->out.len >= OUTPUT_BUFFER_SIZE) {
+                write_bytes(t, ctx->out.data, ctx->out.len);
+                ctx->out.len = 0;
+            }
+        }
+        write_bytes(t, ctx->out.data, ctx->out.len);
+        ctx->out.len = 0;
+    }
+    batch->release(batch);
+    return FMP_HANDLER_OK;
+}
+
+static void print_help(const char *prog) {
+    printf("Usage: %s [options] input.fmp output-directory\n", prog);
+    printf("       %s [options] --table NAME input.fmp -\n", prog);
+    printf("Writes a PostgreSQL binary COPY file per table, named after the table, and\n");
+    printf("a load.sql that creates and loads the tables (run psql in the directory).\n");
+    printf("With - as the output, writes one table's COPY stream to stdout.\n");
+    printf("Options:\n");
+    printf("  --table NAME    Export only this table\n");
+    printf("  --ddl-only      Write only the CREATE TABLE statements, to load.sql or stdout\n");
+    printf("  --typed-values  Declare number, date and time columns with PostgreSQL types;\n");
+    printf("                  values that don't parse are written as NULL and reported\n");
+    printf("  --help, -h      Show this help message\n");
+}
+
+int main(int argc, char *argv[]) {
+    pg_ctx_t ctx = { .tables = NULL };
+    const char *only_table = NULL;
+    int ddl_only = 0;
+    int flags = 0;
+
+    const char *args[2] = { NULL, NULL };
+    int num_args = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--table") == 0 && i + 1 < argc) {
+            only_table = argv[++i];
+        } else if (strcmp(argv[i], "--ddl-only") == 0) {
+            ddl_only = 1;
+        } else if (strcmp(argv[i], "--typed-values") == 0) {
+            flags |= FMP_ARROW_TYPED_VALUES;
+        } else if (strcmp(argv[i], "--text-values") == 0) {
+            /* The default; still accepted */
+        } else if (strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-h") == 0) {
+            print_help(argv[0]);
+            return 0;
+        } else if (num_args < 2 && (argv[i][0] != '-' || strcmp(argv[i], "-") == 0)) {
+            args[num_args++] = argv[i];
+        } else {
+            print_usage_and_exit(argc, argv);
+        }
+    }
+
+    if (num_args != 2) {
+        print_usage_and_exit(argc, argv);
+    }
+
+    int to_stdout = strcmp(args[1], "-") == 0;
+    if (to_stdout && !only_table && !ddl_only) {
+        fprintf(stderr, "Writing to stdout requires --table or --ddl-only\n");
+        return 1;
+    }
+
+    fmp_error_t error = FMP_OK;
+    fmp_unparsed_array_t *unparsed = NULL;
+    fmp_file_t *file = fmp_open_file(args[0], &error);
+    if (!file) {
+        fprintf(stderr, "Error code: %d\n", error);
+        return 1;
+    }
+
+    fmp_metadata_t *metadata = fmp_discover_all_metadata(file, &error);
+    if (!metadata) {
+        fprintf(stderr, "Error code: %d\n", error);
+        return 1;
+    }
+
+    table_files_t files = { .count = 0 };
+    if (!to_stdout && table_files_init(&files, args[1], ".pgcopy") != 0)
+        return 1;
+
+    fmp_table_array_t *tables = metadata->tables;
+    ctx.tables = calloc(tables->count, sizeof(pg_table_t));
+    for (int i = 0; i < tables->count; i++) {
+        if (tables->tables[i].index >= ctx.num_indexes)
+            ctx.num_indexes = tables->tables[i].index + 1;
+    }
+    ctx.tables_by_index = calloc(ctx.num_indexes, sizeof(pg_table_t *));
+
+    /* The same tables fmp_read_all_arrow produces batches for */
+    int num_tables = 0;
+    for (int i = 0; i < tables->count; i++) {
+        fmp_column_array_t *columns = i < metadata->columns_capacity ? metadata->columns[i] : NULL;
+        /* Skipped tables aren't read at all */
+        if (only_table && strcmp(tables->tables[i].utf8_name, only_table) != 0)
+            tables->tables[i].skip = 1;
+        if (tables->tables[i].skip || !columns || columns->count == 0)
+            continue;
+
+        pg_table_t *t = &ctx.tables[num_tables++];
+        t->table = &tables->tables[i];
+        error = fmp_arrow_schema(columns, flags, &t->schema);
+        if (error != FMP_OK) {
+            fprintf(stderr, "Error code: %d\n", error);
+            return 1;
+        }
+        t->kinds = malloc(t->schema.n_children * sizeof(column_kind_t));
+        for (int64_t j = 0; j < t->schema.n_children; j++)
+            t->kinds[j] = column_kind(t->schema.children[j]);
+        ctx.tables_by_index[t->table->index] = t;
+    }
+
+    if (only_table && num_tables == 0) {
+        fprintf(stderr, "Table not found: %s\n", only_table);
+        return 1;
+    }
+
+    FILE *ddl = stdout;
+    char *ddl_path = NULL;
+    if (!to_stdout) {
+        ddl_path = malloc(strlen(args[1]) + sizeof("/load.sql"));
+        sprintf(ddl_path, "%s/load.sql", args[1]);
+        if (!(ddl = fopen(ddl_path, "w"))) {
+            fprintf(stderr, "Couldn't open file for writing: %s\n", ddl_path);
+            return 1;
+        }
+    }
+    if (ddl_only || !to_stdout) {
+        for (int i = 0; i < num_tables; i++) {
+            if (!to_stdout)
+                ctx.tables[i].path = table_files_path(&files, ctx.tables[i].table);
+            write_create_table(ddl, &ctx.tables[i]);
+        }
+    }
+
+    int retval = 0;
+    if (!ddl_only) {
+        for (int i = 0; i < num_tables; i++) {
+            pg_table_t *t = &ctx.tables[i];
+            if (to_stdout) {
+                t->path = "stdout";
+                t->stream = stdout;
+            } else if (!(t->stream = fopen(t->path, "wb"))) {
+                fprintf(stderr, "Couldn't open file for writing: %s\n", t->path);
+                return 1;
+            } else {
+                write_copy_command(ddl, t);
+            }
+            setvbuf(t->stream, NULL, _IOFBF, OUTPUT_BUFFER_SIZE);
+            write_header(t);
+        }
+
+        error = fmp_read_all_arrow(file, metadata, 0, flags, &handle_batch, &ctx, &unparsed);
+        if (error != FMP_OK) {
+            fprintf(stderr, "Error code: %d\n", error);
+            retval = 1;
+        } else if (table_files_report_unparsed(metadata, unparsed)) {
+            retval = 1;
+        }
+
+        for (int i = 0; i < num_tables; i++) {
+            pg_table_t *t = &ctx.tables[i];
+            write_trailer(t);
+            if (fclose(t->stream) != 0 && !t->error) {
+                fprintf(stderr, "Error writing %s: %s\n", t->path, strerror(errno));
+                t->error = 1;
+            }
+            if (t->error)
+                retval = 1;
+        }
+    }
+
+    if (ddl != stdout && fclose(ddl) != 0) {
+        fprintf(stderr, "Error writing %s: %s\n", ddl_path, strerror(errno));
+        retval = 1;
+    }
+
+    for (int i = 0; i < num_tables; i++) {
+        ctx.tables[i].schema.release(&ctx.tables[i].schema);
+        free(ctx.tables[i].kinds);
+    }
+    free(ddl_path);
+    free(ctx.out.data);
+    free(ctx.tables);
+    free(ctx.tables_by_index);
+    table_files_free(&files);
+    fmp_free_unparsed(unparsed);
+    fmp_free_metadata(metadata);
+    fmp_close_file(file);
+
+    return retval;
+}
@@ -26,91 +26,210 @@
 #include <libgen.h>
 #include <sys/stat.h>
 #include <time.h>
+#include <pthread.h>
 #include <unistd.h>
 
 #include <sqlite3.h>
 
 #include "../fmp.h"
+#include "sqlite_export.h"
 #include "usage.h"
 
-typedef struct fmp_sqlite_ctx_s {
-    sqlite3 *db;
-    sqlite3_stmt *insert_stmt;
-    char *table_name;
-    int last_row;
-    int *column_index_map;  /* Maps FileMaker column index to SQLite parameter position */
-    int max_column_index;   /* Maximum column index we've seen */
-} fmp_sqlite_ctx_t;
-
 fmp_handler_status_t handle_value(int row, fmp_column_t *column, const char *value, void *ctxp) {
-    fmp_sqlite_ctx_t *ctx = (fmp_sqlite_ctx_t *)ctxp;
-    if (ctx->last_row != row && ctx->last_row > 0) {
-        int rc = sqlite3_step(ctx->insert_stmt);
-        if (rc != SQLITE_DONE) {
-            fprintf(stderr, "Error inserting data into SQLite table: %s\n", sqlite3_errmsg(ctx->db));
-            return FMP_HANDLER_ABORT;
-        }
-        rc = sqlite3_reset(ctx->insert_stmt);
-        if (rc != SQLITE_OK) {
-            fprintf(stderr, "Error resetting INSERT statement: %s\n", sqlite3_errmsg(ctx->db));
-            return FMP_HANDLER_ABORT;
-        }
-        sqlite3_clear_bindings(ctx->insert_stmt);
-    }
-    /* Map FileMaker column index to SQLite parameter position */
-    int param_pos = 0;
-    if (ctx->column_index_map && column->index <= ctx->max_column_index) {
-        param_pos = ctx->column_index_map[column->index];
+    sqlite_table_writer_t *writer = (sqlite_table_writer_t *)ctxp;
+    if (sqlite_table_writer_add(writer, row, column, value) != SQLITE_OK)
+        return FMP_HANDLER_ABORT;
+    return FMP_HANDLER_OK;
+}
+
+static fmp_column_array_t *table_columns(fmp_metadata_t *metadata, int i) {
+    fmp_table_t *table = &metadata->tables->tables[i];
+    if (table->skip)
+        return NULL;
+    /* Columns are stored at the table's position in the metadata */
+    fmp_column_array_t *columns = i < metadata->columns_capacity ? metadata->columns[i] : NULL;
+    if (!columns || columns->count == 0) {
+        fprintf(stderr, "Skipping table %s (no columns)\n", table->utf8_name);
+        return NULL;
     }
+    return columns;
+}
 
-    if (param_pos == 0) {
-        /* Skip columns that weren't discovered in the schema - these might be deleted columns with leftover data */
-        return FMP_HANDLER_OK;  /* Skip this column silently */
+static int export_table(fmp_file_t *file, sqlite_export_t *exp,
+        fmp_table_t *table, fmp_column_array_t *columns) {
+    fprintf(stderr, "CREATE TABLE \"%s\"\n", table->utf8_name);
+    sqlite_table_writer_t *writer = sqlite_table_writer_new(exp, table, columns);
+    if (!writer) {
+        return -1;
     }
 
-    int rc = sqlite3_bind_text(ctx->insert_stmt, param_pos, value, strlen(value), SQLITE_TRANSIENT);
-    if (rc != SQLITE_OK) {
-        fprintf(stderr, "Error binding parameter at position %d (column index %d): %s\n",
-                param_pos, column->index, sqlite3_errmsg(ctx->db));
-        return FMP_HANDLER_ABORT;
+    fmp_error_t error = fmp_read_values(file, table, &handle_value, writer);
+    if (error != FMP_OK && error != FMP_ERROR_USER_ABORTED) {
+        fprintf(stderr, "Error code: %d\n", error);
     }
-    ctx->last_row = row;
-    return FMP_HANDLER_OK;
+    int failed = (error == FMP_ERROR_USER_ABORTED || sqlite_table_writer_finish(writer) != SQLITE_OK);
+    sqlite_table_writer_free(writer);
+    return failed ? -1 : 0;
+}
+
+/* Parallel export: each worker opens its own copy of the input file (file
+ * handles are not shared between threads), takes tables from a common
+ * queue and writes them to its own shard database. The shards are then
+ * merged into the output with ATTACH. */
+typedef struct shard_queue_s {
+    pthread_mutex_t lock;
+    const char *input_file;
+    fmp_metadata_t *metadata;
+    int next_table;
+    int *table_shards;
+    int failed;
+} shard_queue_t;
+
+typedef struct shard_worker_s {
+    pthread_t thread;
+    int id;
+    char *path;
+    sqlite_export_options_t opts;
+    shard_queue_t *queue;
+} shard_worker_t;
+
+static int next_shard_table(shard_queue_t *queue) {
+    int i = -1;
+    pthread_mutex_lock(&queue->lock);
+    if (!queue->failed && queue->next_table < queue->metadata->tables->count)
+        i = queue->next_table++;
+    pthread_mutex_unlock(&queue->lock);
+    return i;
 }
 
-static size_t create_query_length(fmp_table_t *table, fmp_column_array_t *columns) {
-    size_t len = 0;
-    len += sizeof("CREATE TABLE \"\" ();");
-    len += strlen(table->utf8_name);
-    for (int j=0; j<columns->count; j++) {
-        len += sizeof("\"\" TEXT")-1;
-        len += strlen(columns->columns[j].utf8_name);
-        if (j < columns->count) {
-            len += sizeof(", ")-1;
+static void fail_shard_queue(shard_queue_t *queue) {
+    pthread_mutex_lock(&queue->lock);
+    queue->failed = 1;
+    pthread_mutex_unlock(&queue->lock);
+}
+
+static void *shard_worker_main(void *arg) {
+    shard_worker_t *w = (shard_worker_t *)arg;
+    shard_queue_t *queue = w->queue;
+    fmp_error_t error = FMP_OK;
+
+    fmp_file_t *file = fmp_open_file(queue->input_file, &error);
+    if (!file) {
+        fprintf(stderr, "Error code: %d\n", error);
+        fail_shard_queue(queue);
+        return NULL;
+    }
+
+    sqlite_export_t exp;
+    if (sqlite_export_open(&exp, w->path, &w->opts) != SQLITE_OK) {
+        fail_shard_queue(queue);
+        sqlite_export_close(&exp);
+        fmp_close_file(file);
+        return NULL;
+    }
+
+    int i;
+    while ((i = next_shard_table(queue)) >= 0) {
+        fmp_column_array_t *columns = table_columns(queue->metadata, i);
+        if (!columns)
+            continue;
+        if (export_table(file, &exp, &queue->metadata->tables->tables[i], columns) != 0) {
+            fail_shard_queue(queue);
+            break;
         }
+        queue->table_shards[i] = w->id;
     }
-    return len;
+
+    if (sqlite_export_close(&exp) != SQLITE_OK)
+        fail_shard_queue(queue);
+    fmp_close_file(file);
+    return NULL;
 }
 
-static size_t insert_query_length(fmp_table_t *table, fmp_column_array_t *columns) {
-    size_t len = 0;
-    len += sizeof("INSERT INTO \"\" () VALUES ();");
-    len += strlen(table->utf8_name);
-    for (int j=0; j<columns->count; j++) {
-        len += sizeof("\"\"")-1;
-        len += strlen(columns->columns[j].utf8_name);
-        len += sizeof("\"\"")-1;
-        len += sizeof("?NNNNN")-1;
-        if (j < columns->count) {
-            len += sizeof(", ")-1;
-            len += sizeof(", ")-1;
+static int export_sharded(const char *input_file, const char *output_file,
+        fmp_metadata_t *metadata, sqlite_export_t *exp, int jobs) {
+    int num_tables = metadata->tables->count;
+    shard_queue_t queue = {
+        .input_file = input_file,
+        .metadata = metadata,
+        .table_shards = malloc(num_tables * sizeof(int))
+    };
+    shard_worker_t *workers = calloc(jobs, sizeof(shard_worker_t));
+    char **shard_paths = calloc(jobs, sizeof(char *));
+    const char **table_names = malloc(num_tables * sizeof(char *));
+    int num_started = 0;
+    int failed = 1;
+
+    if (!queue.table_shards || !workers || !shard_paths || !table_names) {
+        fprintf(stderr, "Out of memory\n");
+        goto cleanup;
+    }
+
+    pthread_mutex_init(&queue.lock, NULL);
+    for (int i=0; i<num_tables; i++) {
+        queue.table_shards[i] = -1;
+    }
+
+    fprintf(stderr, "Exporting tables with %d workers\n", jobs);
+    for (int i=0; i<jobs; i++) {
+        shard_worker_t *w = &workers[i];
+        w->id = i;
+        w->queue = &queue;
+        if (!(w->path = malloc(strlen(output_file) + 32))) {
+            fprintf(stderr, "Out of memory\n");
+            fail_shard_queue(&queue);
+            break;
+        }
+        sprintf(w->path, "%s.shard%d", output_file, i);
+        shard_paths[i] = w->path;
+        unlink(w->path);
+        /* Shards are scratch space: no indexes, and one transaction each */
+        w->opts = exp->opts;
+        w->opts.indexes = NULL;
+        w->opts.num_indexes = 0;
+        w->opts.batch_rows = 0;
+        if (pthread_create(&w->thread, NULL, &shard_worker_main, w) != 0) {
+            fprintf(stderr, "Error starting worker thread\n");
+            fail_shard_queue(&queue);
+            break;
+        }
+        num_started++;
+    }
+    for (int i=0; i<num_started; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
+
+    failed = queue.failed;
+    if (!failed) {
+        fprintf(stderr, "Merging %d shards into %s\n", num_started, output_file);
+        for (int i=0; i<num_tables; i++) {
+            table_names[i] = metadata->tables->tables[i].utf8_name;
         }
+        failed = (sqlite_export_merge_shards(exp, shard_paths, num_started,
+                    table_names, queue.table_shards, num_tables) != SQLITE_OK);
     }
-    return len;
+    pthread_mutex_destroy(&queue.lock);
+
+cleanup:
+    /* Shards that a failed worker left behind go too */
+    for (int i=0; workers && i<jobs; i++) {
+        if (workers[i].path) {
+            unlink(workers[i].path);
+            free(workers[i].path);
+        }
+    }
+    free(table_names);
+    free(shard_paths);
+    free(workers);
+    free(queue.table_shards);
+    return failed ? -1 : 0;
 }
 
 /* Cache management functions */
+#define CACHE_VERSION 4  /* Columns by table position; v7 column types */
 static int use_cache = 1;  /* Global flag to control cache usage */
+static int jobs = 1;       /* Number of parallel export workers */
+static int sync_tables = 0; /* Only re-export tables that changed */
 
 static char* get_cache_filename(const char* fmp_path) {
     struct stat st;
@@ -157,15 +276,13 @@ static int save_metadata_cache(const char* cache_file, fmp_metadata_t* metadata)
 
     /* Write simple JSON format */
     fprintf(fp, "{\n");
-    fprintf(fp, "  \"version\": 2,\n");  /* Version 2 for new format */
+    fprintf(fp, "  \"version\": %d,\n", CACHE_VERSION);
     fprintf(fp, "  \"created\": %ld,\n", (long)time(NULL));
     fprintf(fp, "  \"tables\": [\n");
 
     for (int i = 0; i < metadata->tables->count; i++) {
         fmp_table_t* table = &metadata->tables->tables[i];
-        /* Get columns for this table (indexed by table->index) */
-        fmp_column_array_t* columns = (table->index < metadata->columns_capacity && metadata->columns[table->index])
-                                      ? metadata->columns[table->index] : NULL;
+        fmp_column_array_t* columns = i < metadata->columns_capacity ? metadata->columns[i] : NULL;
 
         fprintf(fp, "    {\n");
         fprintf(fp, "      \"index\": %d,\n", table->index);
@@ -230,6 +347,14 @@ static fmp_metadata_t* load_metadata_cache(const char* cache_file) {
     /* Simple JSON parsing - very basic, assumes well-formed cache */
     char* p = buffer;
 
+    int version = 0;
+    char* version_field = strstr(p, "\"version\":");
+    if (!version_field || sscanf(version_field, "\"version\": %d", &version) != 1 || version != CACHE_VERSION) {
+        free(buffer);
+        fmp_free_metadata(metadata);
+        return NULL;
+    }
+
     /* Count tables - look for table objects, not all index fields */
     int table_count = 0;
     char* scan = p;
@@ -302,8 +427,8 @@ static fmp_metadata_t* load_metadata_cache(const char* cache_file) {
             }
         }
 
-        /* Ensure columns capacity for this table index */
-        int t_idx = table->index > 0 ? table->index : table_idx + 1;
+        /* Columns are stored at the table's position, as in fmp_discover_all_metadata */
+        int t_idx = table_idx;
         if (t_idx >= metadata->columns_capacity) {
             size_t new_cap = t_idx + 10;
             metadata->columns = realloc(metadata->columns, new_cap * sizeof(fmp_column_array_t*));
@@ -378,61 +503,136 @@ static fmp_metadata_t* load_metadata_cache(const char* cache_file) {
     return metadata;
 }
 
+/* Incremental export: compare each table's block fingerprint and export
+ * options with the ones stored by the previous run, mark unchanged tables
+ * as skipped, and drop the changed ones so they can be exported again */
+static int sync_prepare(fmp_file_t *file, fmp_metadata_t *metadata,
+        sqlite_export_t *exp, uint64_t *fingerprints) {
+    fmp_error_t error = FMP_OK;
+    fmp_fingerprint_array_t *array = fmp_fingerprint_tables(file, &error);
+    if (!array) {
+        fprintf(stderr, "Error computing table fingerprints: %d\n", error);
+        return -1;
+    }
+
+    int num_tables = metadata->tables->count;
+    const char **names = malloc(num_tables * sizeof(char *));
+    int rc = sqlite_export_sync_begin(exp);
+    for (int i=0; i<num_tables && rc == SQLITE_OK; i++) {
+        fmp_table_t *table = &metadata->tables->tables[i];
+        names[i] = table->utf8_name;
+        fingerprints[i] = 0;
+        for (size_t j=0; j<array->count; j++) {
+            if (array->fingerprints[j].index == table->index)
+                fingerprints[i] = array->fingerprints[j].hash;
+        }
+        if (sqlite_export_sync_unchanged(exp, table->utf8_name, fingerprints[i])) {
+            fprintf(stderr, "Table %s is unchanged\n", table->utf8_name);
+            table->skip = 1;
+        } else {
+            rc = sqlite_export_drop_table(exp, table->utf8_name);
+        }
+    }
+    if (rc == SQLITE_OK)
+        rc = sqlite_export_sync_prune(exp, names, num_tables);
+
+    free(names);
+    fmp_free_fingerprints(array);
+    return rc == SQLITE_OK ? 0 : -1;
+}
+
+static int sync_finish(fmp_metadata_t *metadata, sqlite_export_t *exp, uint64_t *fingerprints) {
+    for (int i=0; i<metadata->tables->count; i++) {
+        fmp_table_t *table = &metadata->tables->tables[i];
+        fmp_column_array_t *columns = i < metadata->columns_capacity ? metadata->columns[i] : NULL;
+        if (table->skip || !columns || columns->count == 0)
+            continue;
+        if (sqlite_export_sync_update(exp, table->utf8_name, fingerprints[i]) != SQLITE_OK)
+            return -1;
+    }
+    return 0;
+}
+
+static void print_help(const char *prog) {
+    printf("Usage: %s [options] input.fmp output.db\n", prog);
+    printf("Options:\n");
+    printf("  --no-cache      Skip metadata cache, force fresh scan\n");
+    printf("  --jobs N        Export tables with N parallel workers (default 1)\n");
+    printf("  --sync          Update an existing output, re-exporting only tables whose\n");
+    printf("                  blocks or column options changed since the last --sync run\n");
+    sqlite_export_print_options(stdout);
+    printf("  --help, -h      Show this help message\n");
+}
+
 int main(int argc, char *argv[]) {
+    sqlite_export_options_t opts;
+    sqlite_export_default_options(&opts);
+    opts.underscore_names = 1;
+
     /* Parse command line options */
-    int arg_offset = 0;
+    const char *args[2] = { NULL, NULL };
+    int num_args = 0;
     for (int i = 1; i < argc; i++) {
-        if (strcmp(argv[i], "--no-cache") == 0) {
+        int consumed = sqlite_export_parse_option(&opts, argc, argv, &i);
+        if (consumed < 0) {
+            return 1;
+        } else if (consumed) {
+            continue;
+        } else if (strcmp(argv[i], "--no-cache") == 0) {
             use_cache = 0;
-            arg_offset++;
+        } else if (strcmp(argv[i], "--sync") == 0) {
+            sync_tables = 1;
+        } else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) {
+            jobs = atoi(argv[++i]);
+            if (jobs < 1) {
+                fprintf(stderr, "Invalid value for --jobs: %s\n", argv[i]);
+                return 1;
+            }
         } else if (strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-h") == 0) {
-            printf("Usage: %s [options] input.fmp output.db\n", argv[0]);
-            printf("Options:\n");
-            printf("  --no-cache    Skip metadata cache, force fresh scan\n");
-            printf("  --help, -h    Show this help message\n");
+            print_help(argv[0]);
             return 0;
+        } else if (num_args < 2 && (argv[i][0] != '-' || argv[i][1] == '\0')) {
+            args[num_args++] = argv[i];
+        } else {
+            print_usage_and_exit(argc, argv);
         }
     }
 
-    if (argc - arg_offset != 3) {
+    if (num_args != 2) {
         print_usage_and_exit(argc, argv);
     }
 
-    const char* input_file = argv[1 + arg_offset];
-    const char* output_file = argv[2 + arg_offset];
+    const char* input_file = args[0];
+    const char* output_file = args[1];
 
-    sqlite3 *db = NULL;
-    char *zErrMsg = NULL;
     fmp_error_t error = FMP_OK;
+    fmp_metadata_t *metadata = NULL;
+    char *cache_file = NULL;
+    uint64_t *fingerprints = NULL;
+    sqlite_export_t exp = { .db = NULL };
+    int failed = 1;
 
     fmp_file_t *file = fmp_open_file(input_file, &error);
     if (!file) {
         fprintf(stderr, "Error code: %d\n", error);
-        return 1;
+        goto cleanup;
     }
 
-    fmp_metadata_t *metadata = NULL;
-    int cache_loaded = 0;
-
     /* Try to use cache if enabled */
-    char* cache_file = get_cache_filename(input_file);
+    cache_file = get_cache_filename(input_file);
     if (cache_file && is_cache_valid(cache_file, input_file)) {
         metadata = load_metadata_cache(cache_file);
-        if (metadata) {
-            cache_loaded = 1;
+        if (metadata)
             fprintf(stderr, "Using cached metadata, skipping table/column discovery\n");
-        }
     }
 
     /* If cache not loaded, do the single-scan discovery */
-    if (!cache_loaded) {
+    if (!metadata) {
         fprintf(stderr, "Discovering all tables and columns in a single scan...\n");
         metadata = fmp_discover_all_metadata(file, &error);
         if (!metadata) {
             fprintf(stderr, "Error discovering metadata: %d\n", error);
-            if (cache_file) free(cache_file);
-            fmp_close_file(file);
-            return 1;
+            goto cleanup;
         }
         fprintf(stderr, "Discovered %zu tables\n", metadata->tables->count);
 
@@ -442,131 +642,50 @@ int main(int argc, char *argv[]) {
         }
     }
 
-    int rc = sqlite3_open_v2(output_file, &db,
-            SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, NULL);
-    if (rc != SQLITE_OK) {
-        fprintf(stderr, "Error opening SQLite file\n");
-        return 1;
-    }
-
-    rc = sqlite3_exec(db, "PRAGMA journal_mode = OFF;\n", NULL, NULL, &zErrMsg);
-    if (rc != SQLITE_OK) {
-        fprintf(stderr, "Error setting journal_mode = OFF\n");
-        return 1;
-    }
+    if (sqlite_export_open(&exp, output_file, &opts) != SQLITE_OK)
+        goto cleanup;
 
-    rc = sqlite3_exec(db, "PRAGMA synchronous = 0;\n", NULL, NULL, &zErrMsg);
-    if (rc != SQLITE_OK) {
-        fprintf(stderr, "Error setting synchronous = 0\n");
-        return 1;
+    if (sync_tables) {
+        fingerprints = calloc(metadata->tables->count + 1, sizeof(uint64_t));
+        if (!fingerprints || sync_prepare(file, metadata, &exp, fingerprints) != 0)
+            goto cleanup;
     }
 
-    char *create_query = NULL;
-    char *insert_query = NULL;
-
+    int max_jobs = sqlite3_limit(exp.db, SQLITE_LIMIT_ATTACHED, -1);
+    if (jobs > max_jobs)
+        jobs = max_jobs;
+    int num_pending = 0;
     for (int i=0; i<metadata->tables->count; i++) {
-        fmp_table_t *table = &metadata->tables->tables[i];
-        /* Get columns for this table (indexed by table->index) */
-        fmp_column_array_t *columns = (table->index < metadata->columns_capacity && metadata->columns[table->index])
-                                      ? metadata->columns[table->index] : NULL;
-        if (!columns || columns->count == 0) {
-            fprintf(stderr, "Skipping table %s (no columns)\n", table->utf8_name);
-            continue;
-        }
-        size_t create_query_len = create_query_length(table, columns);
-        size_t insert_query_len = insert_query_length(table, columns);
-        create_query = realloc(create_query, create_query_len);
-        insert_query = realloc(insert_query, insert_query_len);
-
-        char *p = create_query;
-        char *q = insert_query;
-        p += snprintf(p, create_query_len, "CREATE TABLE \"%s\" (", table->utf8_name);
-        q += snprintf(q, insert_query_len, "INSERT INTO \"%s\" (", table->utf8_name);
-        for (int j=0; j<columns->count; j++) {
-            fmp_column_t *column = &columns->columns[j];
-            char *colname = strdup(column->utf8_name);
-            size_t colname_len = strlen(colname);
-            for (int k=0; k<colname_len; k++) {
-                if (colname[k] == ' ')
-                    colname[k] = '_';
-            }
-            p += snprintf(p, create_query_len - (p - create_query), "\"%s\" TEXT", colname);
-            q += snprintf(q, insert_query_len - (q - insert_query), "\"%s\"", colname);
-            if (j < columns->count - 1) {
-                p += snprintf(p, create_query_len - (p - create_query), ", ");
-                q += snprintf(q, insert_query_len - (q - insert_query), ", ");
-            }
-            free(colname);
-        }
-        p += snprintf(p, create_query_len - (p - create_query), ");");
-        q += snprintf(q, insert_query_len - (q - insert_query), ") VALUES (");
-        for (int j=0; j<columns->count; j++) {
-            /* Use sequential parameter positions, not column indices */
-            q += snprintf(q, insert_query_len - (q - insert_query), "?");
-            if (j < columns->count - 1)
-                q += snprintf(q, insert_query_len - (q - insert_query), ", ");
-        }
-        q += snprintf(q, insert_query_len - (q - insert_query), ");");
-
-        fprintf(stderr, "CREATE TABLE \"%s\"\n", table->utf8_name);
-        rc = sqlite3_exec(db, create_query, NULL, NULL, &zErrMsg);
-        if (rc != SQLITE_OK) {
-            fprintf(stderr, "Error creating SQL table: %s\n", zErrMsg);
-            fprintf(stderr, "Statement was: %s\n", create_query);
-            return 1;
-        }
-
-        sqlite3_stmt *stmt = NULL;
-        rc = sqlite3_prepare_v2(db, insert_query, -1, &stmt, NULL);
-        if (rc != SQLITE_OK) {
-            fprintf(stderr, "Error preparing SQL statement: %d\n", rc);
-            fprintf(stderr, "Statement was: %s\n", insert_query);
-            return 1;
-        }
-
-        /* Create column index map for this table */
-        int max_idx = 0;
-        for (int j = 0; j < columns->count; j++) {
-            if (columns->columns[j].index > max_idx) {
-                max_idx = columns->columns[j].index;
-            }
-        }
-
-        int *col_map = calloc(max_idx + 1, sizeof(int));
-        for (int j = 0; j < columns->count; j++) {
-            col_map[columns->columns[j].index] = j + 1;  /* SQLite params are 1-based */
-        }
-
-        fmp_sqlite_ctx_t ctx = {
-            .db = db,
-            .table_name = table->utf8_name,
-            .insert_stmt = stmt,
-            .column_index_map = col_map,
-            .max_column_index = max_idx
-        };
-        fmp_read_values(file, table, &handle_value, &ctx);
-        if (ctx.last_row) {
-            int rc = sqlite3_step(stmt);
-            if (rc != SQLITE_DONE) {
-                fprintf(stderr, "Error inserting data into SQLite table: %s\n", sqlite3_errmsg(db));
-                free(col_map);
-                return 1;
-            }
+        num_pending += !metadata->tables->tables[i].skip;
+    }
+    if (jobs > num_pending)
+        jobs = num_pending;
+
+    if (jobs > 1) {
+        if (export_sharded(input_file, output_file, metadata, &exp, jobs) != 0)
+            goto cleanup;
+    } else {
+        for (int i=0; i<metadata->tables->count; i++) {
+            fmp_column_array_t *columns = table_columns(metadata, i);
+            if (columns && export_table(file, &exp, &metadata->tables->tables[i], columns) != 0)
+                goto cleanup;
         }
-        sqlite3_finalize(stmt);
-        free(col_map);
-        /* Don't free columns here anymore - we'll free them all at the end */
     }
 
-    free(create_query);
-    free(insert_query);
+    if (sync_tables && sync_finish(metadata, &exp, fingerprints) != 0)
+        goto cleanup;
 
-    /* Clean up */
-    fmp_free_metadata(metadata);
-    sqlite3_close(db);
-    fmp_close_file(file);
+    failed = (sqlite_export_create_indexes(&exp) != SQLITE_OK);
 
-    if (cache_file) free(cache_file);
+cleanup:
+    if (sqlite_export_close(&exp) != SQLITE_OK)
+        failed = 1;
+    free(fingerprints);
+    fmp_free_metadata(metadata);
+    sqlite_export_free_options(&opts);
+    if (file)
+        fmp_close_file(file);
+    free(cache_file);
 
-    return 0;
+    return failed;
 }
@@ -13,22 +13,14 @@
 #include <sqlite3.h>
 
 #include "../fmp.h"
+#include "sqlite_export.h"
 #include "usage.h"
 
-typedef struct table_context_s {
-    sqlite3_stmt *insert_stmt;
-    int *column_index_map;
-    int max_column_index;
-    int last_row;
-    fmp_table_t *table;
-    fmp_column_array_t *columns;
-} table_context_t;
-
 typedef struct fmp_sqlite_all_ctx_s {
-    sqlite3 *db;
+    sqlite_export_t *exp;
     fmp_metadata_t *metadata;
-    table_context_t *table_contexts;  /* Array indexed by table index */
-    size_t table_contexts_capacity;
+    sqlite_table_writer_t **writers;  /* Array indexed by table index */
+    size_t writers_capacity;
 } fmp_sqlite_all_ctx_t;
 
 /* Handler for all table values in single scan */
@@ -36,102 +28,53 @@ fmp_handler_status_t handle_all_values(int table_index, int row, fmp_column_t *c
                                        const char *value, void *ctxp) {
     fmp_sqlite_all_ctx_t *ctx = (fmp_sqlite_all_ctx_t *)ctxp;
 
-    if (table_index >= ctx->table_contexts_capacity || !ctx->table_contexts[table_index].insert_stmt) {
+    if (table_index >= ctx->writers_capacity || !ctx->writers[table_index]) {
         return FMP_HANDLER_OK;  /* Skip tables we're not processing */
     }
 
-    table_context_t *tctx = &ctx->table_contexts[table_index];
-
-    /* Check if we need to execute the previous row */
-    if (tctx->last_row != row && tctx->last_row > 0) {
-        int rc = sqlite3_step(tctx->insert_stmt);
-        if (rc != SQLITE_DONE) {
-            fprintf(stderr, "Error inserting data into table %s: %s\n",
-                    tctx->table ? tctx->table->utf8_name : "(unknown)", sqlite3_errmsg(ctx->db));
-            return FMP_HANDLER_ABORT;
-        }
-        rc = sqlite3_reset(tctx->insert_stmt);
-        if (rc != SQLITE_OK) {
-            fprintf(stderr, "Error resetting INSERT statement for table %s: %s\n",
-                    tctx->table ? tctx->table->utf8_name : "(unknown)", sqlite3_errmsg(ctx->db));
-            return FMP_HANDLER_ABORT;
-        }
-        sqlite3_clear_bindings(tctx->insert_stmt);
-    }
-
-    /* Map column index to parameter position */
-    int param_pos = 0;
-    if (tctx->column_index_map && column->index <= tctx->max_column_index) {
-        param_pos = tctx->column_index_map[column->index];
-    }
-
-    if (param_pos == 0) {
-        /* Skip columns not in schema */
-        return FMP_HANDLER_OK;
-    }
-
-    int rc = sqlite3_bind_text(tctx->insert_stmt, param_pos, value, strlen(value), SQLITE_TRANSIENT);
-    if (rc != SQLITE_OK) {
-        fprintf(stderr, "Error binding parameter for table %s at position %d: %s\n",
-                tctx->table ? tctx->table->utf8_name : "(unknown)", param_pos, sqlite3_errmsg(ctx->db));
+    if (sqlite_table_writer_add(ctx->writers[table_index], row, column, value) != SQLITE_OK)
         return FMP_HANDLER_ABORT;
-    }
 
-    tctx->last_row = row;
     return FMP_HANDLER_OK;
 }
 
-static char *create_table_query(fmp_table_t *table, fmp_column_array_t *columns) {
-    size_t len = 100 + strlen(table->utf8_name);
-    for (int i = 0; i < columns->count; i++) {
-        len += strlen(columns->columns[i].utf8_name) + 20;
-    }
-
-    char *query = malloc(len);
-    char *p = query;
-
-    p += sprintf(p, "CREATE TABLE \"%s\" (", table->utf8_name);
-    for (int i = 0; i < columns->count; i++) {
-        if (i > 0) p += sprintf(p, ", ");
-        p += sprintf(p, "\"%s\" TEXT", columns->columns[i].utf8_name);
-    }
-    p += sprintf(p, ")");
-
-    return query;
+static void print_help(const char *prog) {
+    printf("Usage: %s [options] input.fmp output.db\n", prog);
+    printf("Options:\n");
+    sqlite_export_print_options(stdout);
+    printf("  --help, -h      Show this help message\n");
 }
 
-static char *create_insert_query(fmp_table_t *table, fmp_column_array_t *columns) {
-    size_t len = 100 + strlen(table->utf8_name);
-    for (int i = 0; i < columns->count; i++) {
-        len += strlen(columns->columns[i].utf8_name) + 10;
-    }
-
-    char *query = malloc(len);
-    char *p = query;
-
-    p += sprintf(p, "INSERT INTO \"%s\" (", table->utf8_name);
-    for (int i = 0; i < columns->count; i++) {
-        if (i > 0) p += sprintf(p, ", ");
-        p += sprintf(p, "\"%s\"", columns->columns[i].utf8_name);
-    }
-    p += sprintf(p, ") VALUES (");
-    for (int i = 0; i < columns->count; i++) {
-        if (i > 0) p += sprintf(p, ", ");
-        p += sprintf(p, "?");
+int main(int argc, char *argv[]) {
+    sqlite_export_options_t opts;
+    sqlite_export_default_options(&opts);
+
+    const char *args[2] = { NULL, NULL };
+    int num_args = 0;
+    for (int i = 1; i < argc; i++) {
+        int consumed = sqlite_export_parse_option(&opts, argc, argv, &i);
+        if (consumed < 0) {
+            return 1;
+        } else if (consumed) {
+            continue;
+        } else if (strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-h") == 0) {
+            print_help(argv[0]);
+            return 0;
+        } else if (num_args < 2 && (argv[i][0] != '-' || argv[i][1] == '\0')) {
+            args[num_args++] = argv[i];
+        } else {
+            print_help(argv[0]);
+            return 1;
+        }
     }
-    p += sprintf(p, ")");
 
-    return query;
-}
-
-int main(int argc, char *argv[]) {
-    if (argc != 3) {
-        fprintf(stderr, "Usage: %s input.fmp output.db\n", argv[0]);
+    if (num_args != 2) {
+        fprintf(stderr, "Usage: %s [options] input.fmp output.db\n", argv[0]);
         return 1;
     }
 
-    const char *input_file = argv[1];
-    const char *output_file = argv[2];
+    const char *input_file = args[0];
+    const char *output_file = args[1];
 
     fmp_error_t error = FMP_OK;
 
@@ -152,27 +95,21 @@ int main(int argc, char *argv[]) {
     }
     fprintf(stderr, "Found %zu tables\n", metadata->tables->count);
 
-    /* Open SQLite database */
-    sqlite3 *db = NULL;
-    int rc = sqlite3_open_v2(output_file, &db,
-            SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, NULL);
-    if (rc != SQLITE_OK) {
-        fprintf(stderr, "Error opening SQLite file: %s\n", sqlite3_errmsg(db));
+    /* Open SQLite database; pragmas for speed and the first transaction */
+    sqlite_export_t exp;
+    if (sqlite_export_open(&exp, output_file, &opts) != SQLITE_OK) {
+        sqlite_export_close(&exp);
         fmp_free_metadata(metadata);
         fmp_close_file(file);
         return 1;
     }
 
-    /* Set SQLite pragmas for speed */
-    sqlite3_exec(db, "PRAGMA journal_mode = OFF;", NULL, NULL, NULL);
-    sqlite3_exec(db, "PRAGMA synchronous = 0;", NULL, NULL, NULL);
-
     /* Prepare context for all tables */
     fmp_sqlite_all_ctx_t ctx = {
-        .db = db,
+        .exp = &exp,
         .metadata = metadata,
-        .table_contexts = NULL,
-        .table_contexts_capacity = 0
+        .writers = NULL,
+        .writers_capacity = 0
     };
 
     /* Find max table index */
@@ -183,13 +120,15 @@ int main(int argc, char *argv[]) {
         }
     }
 
-    /* Allocate table contexts */
-    ctx.table_contexts_capacity = max_table_index + 1;
-    ctx.table_contexts = calloc(ctx.table_contexts_capacity, sizeof(table_context_t));
+    /* Allocate table writers */
+    ctx.writers_capacity = max_table_index + 1;
+    ctx.writers = calloc(ctx.writers_capacity, sizeof(sqlite_table_writer_t *));
+
+    int failed = 0;
 
     /* Create tables and prepare statements */
     fprintf(stderr, "Creating tables and preparing statements...\n");
-    for (size_t i = 0; i < metadata->tables->count; i++) {
+    for (size_t i = 0; !failed && i < metadata->tables->count; i++) {
         fmp_table_t *table = &metadata->tables->tables[i];
 
         /* Get columns for this table - now stored at sequential position i */
@@ -203,87 +142,55 @@ int main(int argc, char *argv[]) {
             continue;
         }
 
-        /* Create table */
-        char *create_query = create_table_query(table, columns);
         fprintf(stderr, "Creating table %s...\n", table->utf8_name);
-        rc = sqlite3_exec(db, create_query, NULL, NULL, NULL);
-        if (rc != SQLITE_OK) {
-            fprintf(stderr, "Error creating table: %s\n", sqlite3_errmsg(db));
-            free(create_query);
-            continue;
-        }
-        free(create_query);
-
-        /* Prepare insert statement */
-        char *insert_query = create_insert_query(table, columns);
-        sqlite3_stmt *stmt = NULL;
-        rc = sqlite3_prepare_v2(db, insert_query, -1, &stmt, NULL);
-        if (rc != SQLITE_OK) {
-            fprintf(stderr, "Error preparing statement: %s\n", sqlite3_errmsg(db));
-            free(insert_query);
-            continue;
-        }
-        free(insert_query);
-
-        /* Create column index map */
-        int max_idx = 0;
-        for (int j = 0; j < columns->count; j++) {
-            if (columns->columns[j].index > max_idx) {
-                max_idx = columns->columns[j].index;
-            }
+        /* Stored under the original index for lookup during data read */
+        ctx.writers[table->index] = sqlite_table_writer_new(&exp, table, columns);
+        if (!ctx.writers[table->index])
+            failed = 1;
+    }
+
+    if (!failed) {
+        /* Read all data in a single scan */
+        fprintf(stderr, "Reading all table data in single scan...\n");
+        error = fmp_read_all_values(file, metadata, handle_all_values, &ctx);
+        /* A writer that aborted the scan has already reported why */
+        if (error != FMP_OK && error != FMP_ERROR_USER_ABORTED)
+            fprintf(stderr, "Error reading values: %d\n", error);
+        failed = (error != FMP_OK);
+    }
+
+    if (!failed) {
+        /* Execute any pending inserts */
+        fprintf(stderr, "Finalizing inserts...\n");
+        for (size_t i = 0; i < ctx.writers_capacity; i++) {
+            if (ctx.writers[i] && sqlite_table_writer_finish(ctx.writers[i]) != SQLITE_OK)
+                failed = 1;
         }
-
-        int *col_map = calloc(max_idx + 1, sizeof(int));
-        for (int j = 0; j < columns->count; j++) {
-            col_map[columns->columns[j].index] = j + 1;  /* SQLite params are 1-based */
-        }
-
-        /* Store context for this table using original index for lookup during data read */
-        ctx.table_contexts[table->index] = (table_context_t){
-            .insert_stmt = stmt,
-            .column_index_map = col_map,
-            .max_column_index = max_idx,
-            .last_row = 0,
-            .table = table,
-            .columns = columns
-        };
     }
 
-    /* Read all data in a single scan */
-    fprintf(stderr, "Reading all table data in single scan...\n");
-    error = fmp_read_all_values(file, metadata, handle_all_values, &ctx);
-    if (error != FMP_OK) {
-        fprintf(stderr, "Error reading values: %d\n", error);
-    }
-
-    /* Execute any pending inserts */
-    fprintf(stderr, "Finalizing inserts...\n");
-    for (size_t i = 0; i < ctx.table_contexts_capacity; i++) {
-        if (ctx.table_contexts[i].insert_stmt && ctx.table_contexts[i].last_row > 0) {
-            rc = sqlite3_step(ctx.table_contexts[i].insert_stmt);
-            if (rc != SQLITE_DONE) {
-                fprintf(stderr, "Error executing final insert for table: %s\n",
-                        sqlite3_errmsg(db));
-            }
-        }
+    if (!failed && opts.num_indexes) {
+        fprintf(stderr, "Creating indexes...\n");
+        if (sqlite_export_create_indexes(&exp) != SQLITE_OK)
+            failed = 1;
     }
 
     /* Clean up */
     fprintf(stderr, "Cleaning up...\n");
-    for (size_t i = 0; i < ctx.table_contexts_capacity; i++) {
-        if (ctx.table_contexts[i].insert_stmt) {
-            sqlite3_finalize(ctx.table_contexts[i].insert_stmt);
-        }
-        if (ctx.table_contexts[i].column_index_map) {
-            free(ctx.table_contexts[i].column_index_map);
-        }
+    for (size_t i = 0; i < ctx.writers_capacity; i++) {
+        sqlite_table_writer_free(ctx.writers[i]);
     }
-    free(ctx.table_contexts);
+    free(ctx.writers);
 
-    sqlite3_close(db);
+    if (sqlite_export_close(&exp) != SQLITE_OK)
+        failed = 1;
+    sqlite_export_free_options(&opts);
     fmp_free_metadata(metadata);
     fmp_close_file(file);
 
+    if (failed) {
+        fprintf(stderr, "Export failed; %s is incomplete\n", output_file);
+        return 1;
+    }
     fprintf(stderr, "Done!\n");
     return 0;
-}
\ No newline at end of file
+}
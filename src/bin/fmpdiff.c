@@ -0,0 +1,232 @@
+/* FMP Tools - A library for reading FileMaker Pro databases
+ * Copyright (c) 2020 Evan Miller (except where otherwise noted)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/* Compare two snapshots of the same FileMaker file and report which tables
+ * and record ranges changed. Blocks are matched by content hash, and only
+ * blocks without a match in the other file are decoded. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../fmp.h"
+#include "usage.h"
+
+typedef struct table_changes_s {
+    int index;
+    int other_changes;      /* Non-record data (e.g. definitions) changed */
+    size_t num_ranges;
+    fmp_block_range_t *ranges;
+} table_changes_t;
+
+static int compare_hashes(const void *a, const void *b) {
+    uint64_t h1 = *(const uint64_t *)a, h2 = *(const uint64_t *)b;
+    return (h1 > h2) - (h1 < h2);
+}
+
+static int compare_ranges(const void *a, const void *b) {
+    const fmp_block_range_t *r1 = a, *r2 = b;
+    if (r1->first_row != r2->first_row)
+        return (r1->first_row > r2->first_row) - (r1->first_row < r2->first_row);
+    return (r1->last_row > r2->last_row) - (r1->last_row < r2->last_row);
+}
+
+static int compare_tables(const void *a, const void *b) {
+    const table_changes_t *t1 = a, *t2 = b;
+    return (t1->index > t2->index) - (t1->index < t2->index);
+}
+
+/* Block ids in one file whose content doesn't appear anywhere in the other */
+static int *unmatched_blocks(fmp_block_hash_array_t *blocks, fmp_block_hash_array_t *other, size_t *count) {
+    uint64_t *hashes = malloc((other->count + 1) * sizeof(uint64_t));
+    int *ids = malloc((blocks->count + 1) * sizeof(int));
+    for (size_t i=0; i<other->count; i++) {
+        hashes[i] = other->blocks[i].hash;
+    }
+    qsort(hashes, other->count, sizeof(uint64_t), compare_hashes);
+
+    *count = 0;
+    for (size_t i=0; i<blocks->count; i++) {
+        if (!bsearch(&blocks->blocks[i].hash, hashes, other->count, sizeof(uint64_t), compare_hashes))
+            ids[(*count)++] = blocks->blocks[i].id;
+    }
+    free(hashes);
+    return ids;
+}
+
+static table_changes_t *find_table(table_changes_t **tables, size_t *num_tables, int index) {
+    for (size_t i=0; i<*num_tables; i++) {
+        if ((*tables)[i].index == index)
+            return &(*tables)[i];
+    }
+    *tables = realloc(*tables, (*num_tables + 1) * sizeof(table_changes_t));
+    table_changes_t *table = &(*tables)[(*num_tables)++];
+    memset(table, 0, sizeof(table_changes_t));
+    table->index = index;
+    return table;
+}
+
+static void add_ranges(table_changes_t **tables, size_t *num_tables, fmp_block_range_array_t *array) {
+    for (size_t i=0; i<array->count; i++) {
+        fmp_block_range_t *range = &array->ranges[i];
+        table_changes_t *table = find_table(tables, num_tables, range->table_index);
+        if (range->first_row == 0) {
+            table->other_changes = 1;
+            continue;
+        }
+        table->ranges = realloc(table->ranges, (table->num_ranges + 1) * sizeof(fmp_block_range_t));
+        table->ranges[table->num_ranges++] = *range;
+    }
+}
+
+static const char *table_name(fmp_table_array_t *new_tables, fmp_table_array_t *old_tables, int index) {
+    fmp_table_array_t *lists[2] = { new_tables, old_tables };
+    for (int i=0; i<2; i++) {
+        for (size_t j=0; lists[i] && j<lists[i]->count; j++) {
+            if (lists[i]->tables[j].index == index)
+                return lists[i]->tables[j].utf8_name;
+        }
+    }
+    return NULL;
+}
+
+static void print_table_changes(table_changes_t *table, const char *name) {
+    if (table->index == 0) {
+        printf("File metadata:");
+    } else if (name) {
+        printf("Table %d (%s):", table->index, name);
+    } else {
+        printf("Table %d:", table->index);
+    }
+
+    if (table->num_ranges) {
+        /* Merge overlapping and adjacent record ranges */
+        qsort(table->ranges, table->num_ranges, sizeof(fmp_block_range_t), compare_ranges);
+        int first = table->ranges[0].first_row;
+        int last = table->ranges[0].last_row;
+        printf(" records");
+        for (size_t i=1; i<=table->num_ranges; i++) {
+            if (i < table->num_ranges && table->ranges[i].first_row <= last + 1) {
+                if (table->ranges[i].last_row > last)
+                    last = table->ranges[i].last_row;
+                continue;
+            }
+            if (first == last) {
+                printf(" %d", first);
+            } else {
+                printf(" %d-%d", first, last);
+            }
+            if (i < table->num_ranges) {
+                printf(",");
+                first = table->ranges[i].first_row;
+                last = table->ranges[i].last_row;
+            }
+        }
+    }
+    if (table->other_changes)
+        printf("%s definitions or other data", table->num_ranges ? ";" : "");
+    printf("\n");
+}
+
+int main(int argc, char *argv[]) {
+    int read_names = 1;
+    const char *paths[2] = { NULL, NULL };
+    int num_paths = 0;
+    for (int i=1; i<argc; i++) {
+        if (strcmp(argv[i], "--no-names") == 0) {
+            read_names = 0;
+        } else if (num_paths < 2 && argv[i][0] != '-') {
+            paths[num_paths++] = argv[i];
+        } else {
+            num_paths = 0;
+            break;
+        }
+    }
+    /* Exit status 1 means the files differ, so bad usage is 2 as in diff(1) */
+    if (num_paths != 2)
+        print_usage_with_args_and_exit(argc, argv, "[--no-names] [old file] [new file]", 2);
+
+    fmp_error_t error = FMP_OK;
+    fmp_file_t *old_file = fmp_open_file(paths[0], &error);
+    if (!old_file) {
+        fprintf(stderr, "Error opening %s: %d\n", paths[0], error);
+        return 2;
+    }
+    fmp_file_t *new_file = fmp_open_file(paths[1], &error);
+    if (!new_file) {
+        fprintf(stderr, "Error opening %s: %d\n", paths[1], error);
+        return 2;
+    }
+
+    fmp_block_hash_array_t *old_blocks = fmp_hash_blocks(old_file, NULL, &error);
+    fmp_block_hash_array_t *new_blocks = old_blocks ? fmp_hash_blocks(new_file, NULL, &error) : NULL;
+    if (!old_blocks || !new_blocks) {
+        fprintf(stderr, "Error hashing blocks: %d\n", error);
+        return 2;
+    }
+
+    size_t num_removed = 0, num_added = 0;
+    int *removed = unmatched_blocks(old_blocks, new_blocks, &num_removed);
+    int *added = unmatched_blocks(new_blocks, old_blocks, &num_added);
+    printf("Blocks: %zu old, %zu new, %zu removed or changed, %zu added or changed\n",
+            old_blocks->count, new_blocks->count, num_removed, num_added);
+
+    int retval = (num_removed || num_added);
+    if (retval) {
+        fmp_block_range_array_t *old_ranges = fmp_block_ranges(old_file, removed, num_removed, &error);
+        fmp_block_range_array_t *new_ranges = old_ranges ? fmp_block_ranges(new_file, added, num_added, &error) : NULL;
+        if (!old_ranges || !new_ranges) {
+            fprintf(stderr, "Error reading changed blocks: %d\n", error);
+            return 2;
+        }
+
+        table_changes_t *tables = NULL;
+        size_t num_tables = 0;
+        add_ranges(&tables, &num_tables, old_ranges);
+        add_ranges(&tables, &num_tables, new_ranges);
+        qsort(tables, num_tables, sizeof(table_changes_t), compare_tables);
+
+        fmp_table_array_t *old_names = NULL, *new_names = NULL;
+        if (read_names) {
+            new_names = fmp_list_tables(new_file, NULL);
+            old_names = fmp_list_tables(old_file, NULL);
+        }
+        for (size_t i=0; i<num_tables; i++) {
+            print_table_changes(&tables[i], table_name(new_names, old_names, tables[i].index));
+            free(tables[i].ranges);
+        }
+
+        free(tables);
+        fmp_free_tables(new_names);
+        fmp_free_tables(old_names);
+        fmp_free_block_ranges(old_ranges);
+        fmp_free_block_ranges(new_ranges);
+    }
+
+    free(removed);
+    free(added);
+    fmp_free_block_hashes(old_blocks);
+    fmp_free_block_hashes(new_blocks);
+    fmp_close_file(old_file);
+    fmp_close_file(new_file);
+    return retval;
+}
@@ -1,23 +1,214 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "../fmp.h"
 
+#define MAX_PATH_PREFIX 64
+
+static const struct {
+    const char *name;
+    fmp_chunk_type_t type;
+} chunk_type_names[] = {
+    { "push",    FMP_CHUNK_PATH_PUSH },
+    { "pop",     FMP_CHUNK_PATH_POP },
+    { "simple",  FMP_CHUNK_DATA_SIMPLE },
+    { "field",   FMP_CHUNK_FIELD_REF_SIMPLE },
+    { "long",    FMP_CHUNK_FIELD_REF_LONG },
+    { "segment", FMP_CHUNK_DATA_SEGMENT },
+};
+
+static void print_usage(const char *prog) {
+    printf("Usage: %s [options] [file ...]\n", prog);
+    printf("Options:\n");
+    printf("  --blocks N[-M]  Dump only blocks N through M (or just N)\n");
+    printf("  --path PREFIX   Dump only chunks at or below a path, e.g. 3.17.5 or [3].[17].[5]\n");
+    printf("  --type LIST     Dump only these chunk types, comma-separated:\n");
+    printf("                  push, pop, simple, field, long, segment\n");
+    printf("  --stats         Print block and chunk statistics instead of the chunks\n");
+    printf("  --help, -h      Show this help message\n");
+}
+
+static int parse_blocks(const char *arg, fmp_dump_options_t *options) {
+    char *end = NULL;
+    long first = strtol(arg, &end, 10);
+    long last = first;
+    if (*end == '-') {
+        last = strtol(end + 1, &end, 10);
+    }
+    if (*end || first <= 0 || last < first)
+        return 0;
+    options->first_block = first;
+    options->last_block = last;
+    return 1;
+}
+
+static int parse_path(const char *arg, uint64_t *prefix, size_t *prefix_len) {
+    size_t len = 0;
+    const char *p = arg;
+    while (*p) {
+        int bracketed = (*p == '[');
+        if (bracketed)
+            p++;
+        char *end = NULL;
+        unsigned long long value = strtoull(p, &end, 10);
+        if (end == p || len == MAX_PATH_PREFIX)
+            return 0;
+        p = end;
+        if (bracketed && *p++ != ']')
+            return 0;
+        prefix[len++] = value;
+        if (*p == '.') {
+            p++;
+        } else if (*p) {
+            return 0;
+        }
+    }
+    *prefix_len = len;
+    return len > 0;
+}
+
+static int parse_types(const char *arg, unsigned int *mask) {
+    char *list = strdup(arg);
+    int ok = 1;
+    for (char *name = strtok(list, ","); name && ok; name = strtok(NULL, ",")) {
+        ok = 0;
+        for (int i=0; i<sizeof(chunk_type_names)/sizeof(chunk_type_names[0]); i++) {
+            if (strcmp(name, chunk_type_names[i].name) == 0) {
+                *mask |= 1u << chunk_type_names[i].type;
+                ok = 1;
+            }
+        }
+        if (!ok)
+            fprintf(stderr, "Unknown chunk type: %s\n", name);
+    }
+    free(list);
+    return ok && *mask;
+}
+
+static double percent(size_t part, size_t whole) {
+    return whole ? 100.0 * part / whole : 0.0;
+}
+
+static const char *table_name(fmp_table_array_t *tables, int index) {
+    if (index == 0)
+        return "(file metadata)";
+    for (size_t i=0; tables && i<tables->count; i++) {
+        if (tables->tables[i].index == index)
+            return tables->tables[i].utf8_name;
+    }
+    return "";
+}
+
+static fmp_error_t print_stats(fmp_file_t *file) {
+    fmp_error_t error = FMP_OK;
+    fmp_profile_t *profile = fmp_profile_blocks(file, &error);
+    if (!profile)
+        return error;
+    fmp_table_array_t *tables = fmp_list_tables(file, NULL);
+
+    printf("Blocks: %zu in chain, %zu in file, %zu not reached, %zu deleted\n",
+            profile->chain_blocks, profile->file_blocks, profile->unreached_blocks,
+            profile->deleted_blocks);
+    printf("Payload: %zu of %zu bytes (%.1f%% full)\n",
+            profile->payload_bytes, profile->payload_capacity,
+            percent(profile->payload_bytes, profile->payload_capacity));
+
+    printf("\nFill        Blocks\n");
+    for (int i=0; i<10; i++) {
+        if (profile->fill_blocks[i])
+            printf("%3d-%3d%%  %8zu\n", 10*i, 10*i+10, profile->fill_blocks[i]);
+    }
+
+    printf("\nLevel       Blocks\n");
+    for (int i=0; i<256; i++) {
+        if (profile->level_blocks[i])
+            printf("%5d     %8zu\n", i, profile->level_blocks[i]);
+    }
+
+    size_t total_chunks = 0;
+    printf("\nChunk type      Chunks\n");
+    for (int i=0; i<sizeof(chunk_type_names)/sizeof(chunk_type_names[0]); i++) {
+        size_t count = profile->type_chunks[chunk_type_names[i].type];
+        total_chunks += count;
+        printf("%-10s  %10zu\n", chunk_type_names[i].name, count);
+    }
+
+    printf("\nOpcode      Chunks      Data bytes\n");
+    for (int i=0; i<256; i++) {
+        if (profile->opcode_chunks[i]) {
+            printf("0x%02X    %10zu  %14zu  (%.1f%%)\n", i,
+                    profile->opcode_chunks[i], profile->opcode_bytes[i],
+                    percent(profile->opcode_chunks[i], total_chunks));
+        }
+    }
+
+    printf("\nTable   Blocks      Chunks      Data bytes  Name\n");
+    for (size_t i=0; i<profile->num_tables; i++) {
+        fmp_table_profile_t *table = &profile->tables[i];
+        printf("%5d %8zu  %10zu  %14zu  %s\n", table->index, table->num_blocks,
+                table->num_chunks, table->data_bytes, table_name(tables, table->index));
+    }
+
+    fmp_free_tables(tables);
+    fmp_free_profile(profile);
+    return FMP_OK;
+}
+
 int main(int argc, char *argv[]) {
-    if (argc < 2) {
-        printf("Usage: %s [file]\n", argv[0]);
+    uint64_t path_prefix[MAX_PATH_PREFIX];
+    fmp_dump_options_t options = { .stream = stdout, .path_prefix = path_prefix };
+    int num_files = 0;
+    int stats = 0;
+
+    for (int i=1; i<argc; i++) {
+        if (strcmp(argv[i], "--blocks") == 0 && i + 1 < argc) {
+            if (!parse_blocks(argv[++i], &options)) {
+                fprintf(stderr, "Invalid block range: %s\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--path") == 0 && i + 1 < argc) {
+            if (!parse_path(argv[++i], path_prefix, &options.path_prefix_len)) {
+                fprintf(stderr, "Invalid path: %s\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--type") == 0 && i + 1 < argc) {
+            if (!parse_types(argv[++i], &options.chunk_types)) {
+                fprintf(stderr, "Invalid chunk types: %s\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            stats = 1;
+        } else if (strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-h") == 0) {
+            print_usage(argv[0]);
+            return 0;
+        } else if (argv[i][0] == '-') {
+            print_usage(argv[0]);
+            exit(1);
+        } else {
+            argv[++num_files] = argv[i];
+        }
+    }
+
+    if (num_files == 0) {
+        print_usage(argv[0]);
         exit(1);
     }
 
     int i;
     fmp_error_t error = FMP_OK;
-    for (i=1; i<argc; i++) {
+    for (i=1; i<=num_files; i++) {
         fmp_file_t *file = fmp_open_file(argv[i], &error);
         if (!file) {
             fprintf(stderr, "Error code: %d\n", error);
             return 1;
         }
-        error = fmp_dump_file(file);
+        if (stats) {
+            error = print_stats(file);
+        } else {
+            error = fmp_dump_file_with_options(file, &options);
+        }
+        fmp_close_file(file);
         if (error != FMP_OK) {
             fprintf(stderr, "Error code: %d\n", error);
             return 1;
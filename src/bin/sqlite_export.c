@@ -0,0 +1,771 @@
+/* FMP Tools - A library for reading FileMaker Pro databases
+ * Copyright (c) 2020 Evan Miller (except where otherwise noted)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sqlite3.h>
+
+#include "../fmp.h"
+#include "sqlite_export.h"
+
+#define DEFAULT_BATCH_ROWS 100000
+
+typedef struct strbuf_s {
+    char *buf;
+    size_t len;
+    size_t cap;
+} strbuf_t;
+
+static void strbuf_append(strbuf_t *sb, const char *str, size_t len) {
+    if (sb->len + len + 1 > sb->cap) {
+        sb->cap = 2 * (sb->len + len + 1);
+        sb->buf = realloc(sb->buf, sb->cap);
+    }
+    memcpy(&sb->buf[sb->len], str, len);
+    sb->len += len;
+    sb->buf[sb->len] = '\0';
+}
+
+static void strbuf_append_str(strbuf_t *sb, const char *str) {
+    strbuf_append(sb, str, strlen(str));
+}
+
+/* Append a double-quoted SQL identifier */
+static void strbuf_append_name(strbuf_t *sb, const char *name, int underscore) {
+    strbuf_append(sb, "\"", 1);
+    for (const char *p = name; *p; p++) {
+        if (*p == '"') {
+            strbuf_append(sb, "\"\"", 2);
+        } else if (*p == ' ' && underscore) {
+            strbuf_append(sb, "_", 1);
+        } else {
+            strbuf_append(sb, p, 1);
+        }
+    }
+    strbuf_append(sb, "\"", 1);
+}
+
+void sqlite_export_default_options(sqlite_export_options_t *opts) {
+    memset(opts, 0, sizeof(sqlite_export_options_t));
+    opts->batch_rows = DEFAULT_BATCH_ROWS;
+    opts->insert_rows = 1;
+}
+
+static int parse_int_arg(int argc, char *argv[], int *i, int min, int *out) {
+    if (*i + 1 >= argc) {
+        fprintf(stderr, "Option %s requires a value\n", argv[*i]);
+        return -1;
+    }
+    char *end = NULL;
+    long val = strtol(argv[*i + 1], &end, 10);
+    if (!*argv[*i + 1] || *end || val < min || val > 0x7FFFFFFF) {
+        fprintf(stderr, "Invalid value for %s: %s\n", argv[*i], argv[*i + 1]);
+        return -1;
+    }
+    *out = val;
+    (*i)++;
+    return 1;
+}
+
+static int add_index_spec(sqlite_export_options_t *opts, int argc, char *argv[], int *i, int is_pattern) {
+    if (*i + 1 >= argc) {
+        fprintf(stderr, "Option %s requires a value\n", argv[*i]);
+        return -1;
+    }
+    opts->indexes = realloc(opts->indexes, (opts->num_indexes + 1) * sizeof(sqlite_index_spec_t));
+    opts->indexes[opts->num_indexes].name = argv[++(*i)];
+    opts->indexes[opts->num_indexes].is_pattern = is_pattern;
+    opts->num_indexes++;
+    return 1;
+}
+
+int sqlite_export_parse_option(sqlite_export_options_t *opts, int argc, char *argv[], int *i) {
+    if (strcmp(argv[*i], "--batch-size") == 0)
+        return parse_int_arg(argc, argv, i, 0, &opts->batch_rows);
+    if (strcmp(argv[*i], "--multi-row") == 0)
+        return parse_int_arg(argc, argv, i, 1, &opts->insert_rows);
+    if (strcmp(argv[*i], "--cache-size") == 0)
+        return parse_int_arg(argc, argv, i, -0x7FFFFFFF, &opts->cache_size);
+    if (strcmp(argv[*i], "--page-size") == 0)
+        return parse_int_arg(argc, argv, i, 512, &opts->page_size);
+    if (strcmp(argv[*i], "--text-columns") == 0) {
+        opts->text_columns = 1;
+        return 1;
+    }
+    if (strcmp(argv[*i], "--index") == 0)
+        return add_index_spec(opts, argc, argv, i, 0);
+    if (strcmp(argv[*i], "--index-pattern") == 0)
+        return add_index_spec(opts, argc, argv, i, 1);
+    return 0;
+}
+
+void sqlite_export_print_options(FILE *stream) {
+    fprintf(stream, "  --batch-size N  Commit every N rows (default %d, 0 = single transaction)\n", DEFAULT_BATCH_ROWS);
+    fprintf(stream, "  --multi-row N   Insert N rows per INSERT statement (default 1)\n");
+    fprintf(stream, "  --cache-size N  Set PRAGMA cache_size (pages, or -KiB if negative)\n");
+    fprintf(stream, "  --page-size N   Set PRAGMA page_size for a new database\n");
+    fprintf(stream, "  --text-columns  Store every column as TEXT instead of using column types\n");
+    fprintf(stream, "  --index COL     Index column COL (or TABLE.COL) after loading; may be repeated\n");
+    fprintf(stream, "  --index-pattern GLOB\n");
+    fprintf(stream, "                  Index every column matching GLOB, e.g. '*RecID'; may be repeated\n");
+}
+
+void sqlite_export_free_options(sqlite_export_options_t *opts) {
+    free(opts->indexes);
+    opts->indexes = NULL;
+    opts->num_indexes = 0;
+}
+
+static const char *declared_type(fmp_column_type_e type) {
+    switch (type) {
+    case FMP_COLUMN_TYPE_NUMBER: return "NUMERIC";
+    case FMP_COLUMN_TYPE_DATE: return "DATE";
+    case FMP_COLUMN_TYPE_TIME: return "TIME";
+    case FMP_COLUMN_TYPE_TIMESTAMP: return "TIMESTAMP";
+    default: return "TEXT";
+    }
+}
+
+static int exec_pragma(sqlite3 *db, const char *pragma, int value) {
+    char query[128];
+    snprintf(query, sizeof(query), "PRAGMA %s = %d;", pragma, value);
+    int rc = sqlite3_exec(db, query, NULL, NULL, NULL);
+    if (rc != SQLITE_OK)
+        fprintf(stderr, "Error setting %s = %d: %s\n", pragma, value, sqlite3_errmsg(db));
+    return rc;
+}
+
+int sqlite_export_open(sqlite_export_t *exp, const char *path, const sqlite_export_options_t *opts) {
+    memset(exp, 0, sizeof(sqlite_export_t));
+    exp->opts = *opts;
+
+    int rc = sqlite3_open_v2(path, &exp->db,
+            SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, NULL);
+    if (rc != SQLITE_OK) {
+        fprintf(stderr, "Error opening SQLite file: %s\n", sqlite3_errmsg(exp->db));
+        return rc;
+    }
+
+    /* page_size only takes effect before the first table is created */
+    if (opts->page_size && (rc = exec_pragma(exp->db, "page_size", opts->page_size)) != SQLITE_OK)
+        return rc;
+
+    rc = sqlite3_exec(exp->db, "PRAGMA journal_mode = OFF;", NULL, NULL, NULL);
+    if (rc != SQLITE_OK) {
+        fprintf(stderr, "Error setting journal_mode = OFF\n");
+        return rc;
+    }
+
+    if ((rc = exec_pragma(exp->db, "synchronous", 0)) != SQLITE_OK)
+        return rc;
+
+    if (opts->cache_size && (rc = exec_pragma(exp->db, "cache_size", opts->cache_size)) != SQLITE_OK)
+        return rc;
+
+    rc = sqlite3_exec(exp->db, "BEGIN;", NULL, NULL, NULL);
+    if (rc != SQLITE_OK)
+        fprintf(stderr, "Error starting transaction: %s\n", sqlite3_errmsg(exp->db));
+    return rc;
+}
+
+static int index_wanted(const sqlite_export_options_t *opts, const char *table, const char *column) {
+    size_t table_len = strlen(table);
+    for (int i=0; i<opts->num_indexes; i++) {
+        const char *name = opts->indexes[i].name;
+        if (opts->indexes[i].is_pattern) {
+            if (sqlite3_strglob(name, column) == 0)
+                return 1;
+        } else if (strcmp(name, column) == 0) {
+            return 1;
+        } else if (strncmp(name, table, table_len) == 0 && name[table_len] == '.' &&
+                strcmp(&name[table_len + 1], column) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int create_index(sqlite_export_t *exp, const char *table, const char *column) {
+    strbuf_t sb = { 0 };
+    char *index_name = sqlite3_mprintf("%s_%s_idx", table, column);
+    strbuf_append_str(&sb, "CREATE INDEX IF NOT EXISTS ");
+    strbuf_append_name(&sb, index_name, 0);
+    strbuf_append_str(&sb, " ON ");
+    strbuf_append_name(&sb, table, 0);
+    strbuf_append_str(&sb, " (");
+    strbuf_append_name(&sb, column, 0);
+    strbuf_append_str(&sb, ");");
+    sqlite3_free(index_name);
+
+    fprintf(stderr, "CREATE INDEX ON \"%s\" (\"%s\")\n", table, column);
+    int rc = sqlite3_exec(exp->db, sb.buf, NULL, NULL, NULL);
+    if (rc != SQLITE_OK) {
+        fprintf(stderr, "Error creating index: %s\n", sqlite3_errmsg(exp->db));
+        fprintf(stderr, "Statement was: %s\n", sb.buf);
+    }
+    free(sb.buf);
+    return rc;
+}
+
+/* Indexes are built once the tables are fully loaded, which is much cheaper
+ * than maintaining them row by row during the INSERTs. Columns are matched
+ * by their names as they appear in the output database. */
+int sqlite_export_create_indexes(sqlite_export_t *exp) {
+    if (exp->opts.num_indexes == 0)
+        return SQLITE_OK;
+
+    /* Collect the matches first so no statement is reading the schema
+     * while it is being changed */
+    sqlite3_stmt *stmt = NULL;
+    char **matches = NULL; /* table, column pairs */
+    int num_matches = 0;
+    int rc = sqlite3_prepare_v2(exp->db,
+            "SELECT m.name, c.name FROM sqlite_master AS m, pragma_table_info(m.name) AS c "
+            "WHERE m.type = 'table' AND m.name NOT LIKE 'sqlite_%' "
+            "AND m.name != '" SQLITE_EXPORT_SYNC_TABLE "' ORDER BY m.rowid, c.cid;",
+            -1, &stmt, NULL);
+    if (rc != SQLITE_OK) {
+        fprintf(stderr, "Error listing columns: %s\n", sqlite3_errmsg(exp->db));
+        return rc;
+    }
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        const char *table = (const char *)sqlite3_column_text(stmt, 0);
+        const char *column = (const char *)sqlite3_column_text(stmt, 1);
+        if (!index_wanted(&exp->opts, table, column))
+            continue;
+        matches = realloc(matches, 2 * (num_matches + 1) * sizeof(char *));
+        matches[2 * num_matches] = strdup(table);
+        matches[2 * num_matches + 1] = strdup(column);
+        num_matches++;
+    }
+    if (rc == SQLITE_DONE) {
+        rc = SQLITE_OK;
+    } else {
+        fprintf(stderr, "Error listing columns: %s\n", sqlite3_errmsg(exp->db));
+    }
+    sqlite3_finalize(stmt);
+
+    for (int i=0; rc == SQLITE_OK && i<num_matches; i++) {
+        rc = create_index(exp, matches[2 * i], matches[2 * i + 1]);
+    }
+
+    if (rc == SQLITE_OK) {
+        if (num_matches == 0) {
+            fprintf(stderr, "Warning: no columns matched the requested indexes\n");
+        } else if ((rc = sqlite3_exec(exp->db, "ANALYZE;", NULL, NULL, NULL)) != SQLITE_OK) {
+            fprintf(stderr, "Error running ANALYZE: %s\n", sqlite3_errmsg(exp->db));
+        }
+    }
+
+    for (int i=0; i<2 * num_matches; i++) {
+        free(matches[i]);
+    }
+    free(matches);
+    return rc;
+}
+
+static int exec_with_error(sqlite3 *db, const char *sql, const char *what) {
+    int rc = sqlite3_exec(db, sql, NULL, NULL, NULL);
+    if (rc != SQLITE_OK)
+        fprintf(stderr, "Error %s: %s\n", what, sqlite3_errmsg(db));
+    return rc;
+}
+
+static int copy_shard_table(sqlite_export_t *exp, int shard, const char *table) {
+    char schema[32];
+    snprintf(schema, sizeof(schema), "shard%d", shard);
+
+    strbuf_t sb = { 0 };
+    strbuf_append_str(&sb, "SELECT sql FROM ");
+    strbuf_append_str(&sb, schema);
+    strbuf_append_str(&sb, ".sqlite_master WHERE type = 'table' AND name = ?;");
+
+    sqlite3_stmt *stmt = NULL;
+    int rc = sqlite3_prepare_v2(exp->db, sb.buf, -1, &stmt, NULL);
+    if (rc == SQLITE_OK) {
+        sqlite3_bind_text(stmt, 1, table, -1, SQLITE_STATIC);
+        rc = sqlite3_step(stmt);
+        if (rc == SQLITE_ROW) {
+            /* The stored CREATE TABLE is unqualified, so it lands in main */
+            rc = exec_with_error(exp->db, (const char *)sqlite3_column_text(stmt, 0), "creating SQL table");
+        } else {
+            fprintf(stderr, "Error finding table %s in %s: %s\n", table, schema, sqlite3_errmsg(exp->db));
+            rc = SQLITE_ERROR;
+        }
+    } else {
+        fprintf(stderr, "Error preparing SQL statement: %s\n", sqlite3_errmsg(exp->db));
+    }
+    sqlite3_finalize(stmt);
+
+    if (rc == SQLITE_OK) {
+        sb.len = 0;
+        strbuf_append_str(&sb, "INSERT INTO main.");
+        strbuf_append_name(&sb, table, 0);
+        strbuf_append_str(&sb, " SELECT * FROM ");
+        strbuf_append_str(&sb, schema);
+        strbuf_append_str(&sb, ".");
+        strbuf_append_name(&sb, table, 0);
+        strbuf_append_str(&sb, ";");
+        rc = exec_with_error(exp->db, sb.buf, "copying table");
+        if (rc == SQLITE_OK)
+            exp->rows_total += sqlite3_changes(exp->db);
+    }
+    free(sb.buf);
+    return rc;
+}
+
+/* Copy tables written by parallel workers into the export database. Each
+ * table is taken from the shard given by table_shards (negative = skip) and
+ * tables are created in the order given, so the result does not depend on
+ * which worker happened to write which table. Since the new tables are
+ * empty and have identical schemas, SQLite copies the pages over without
+ * decoding the rows. */
+int sqlite_export_merge_shards(sqlite_export_t *exp, char **shard_paths, int num_shards,
+        const char **table_names, const int *table_shards, int num_tables) {
+    int num_attached = 0;
+    int rc = SQLITE_OK;
+    char sql[64];
+
+    /* ATTACH is not allowed inside a transaction */
+    if (sqlite3_get_autocommit(exp->db) == 0 &&
+            (rc = exec_with_error(exp->db, "COMMIT;", "committing transaction")) != SQLITE_OK)
+        return rc;
+
+    for (int i=0; i<num_shards; i++) {
+        sqlite3_stmt *stmt = NULL;
+        snprintf(sql, sizeof(sql), "ATTACH DATABASE ? AS shard%d;", i);
+        if ((rc = sqlite3_prepare_v2(exp->db, sql, -1, &stmt, NULL)) == SQLITE_OK) {
+            sqlite3_bind_text(stmt, 1, shard_paths[i], -1, SQLITE_STATIC);
+            if ((rc = sqlite3_step(stmt)) == SQLITE_DONE)
+                rc = SQLITE_OK;
+        }
+        if (rc != SQLITE_OK)
+            fprintf(stderr, "Error attaching %s: %s\n", shard_paths[i], sqlite3_errmsg(exp->db));
+        sqlite3_finalize(stmt);
+        if (rc != SQLITE_OK)
+            goto cleanup;
+        num_attached++;
+    }
+
+    if ((rc = exec_with_error(exp->db, "BEGIN;", "starting transaction")) != SQLITE_OK)
+        goto cleanup;
+
+    for (int i=0; i<num_tables; i++) {
+        if (table_shards[i] < 0)
+            continue;
+        if ((rc = copy_shard_table(exp, table_shards[i], table_names[i])) != SQLITE_OK)
+            break;
+    }
+
+    if (rc == SQLITE_OK) {
+        rc = exec_with_error(exp->db, "COMMIT;", "committing transaction");
+    } else {
+        sqlite3_exec(exp->db, "ROLLBACK;", NULL, NULL, NULL);
+    }
+
+cleanup:
+    for (int i=0; i<num_attached; i++) {
+        snprintf(sql, sizeof(sql), "DETACH DATABASE shard%d;", i);
+        sqlite3_exec(exp->db, sql, NULL, NULL, NULL);
+    }
+    if (rc == SQLITE_OK)
+        rc = exec_with_error(exp->db, "BEGIN;", "starting transaction");
+    return rc;
+}
+
+int sqlite_export_close(sqlite_export_t *exp) {
+    int rc = SQLITE_OK;
+    /* sqlite3_open_v2 leaves no handle when it runs out of memory */
+    if (!exp->db)
+        return rc;
+    if (sqlite3_get_autocommit(exp->db) == 0) {
+        rc = sqlite3_exec(exp->db, "COMMIT;", NULL, NULL, NULL);
+        if (rc != SQLITE_OK)
+            fprintf(stderr, "Error committing transaction: %s\n", sqlite3_errmsg(exp->db));
+    }
+    sqlite3_close(exp->db);
+    exp->db = NULL;
+    return rc;
+}
+
+static int rows_inserted(sqlite_export_t *exp, int rows) {
+    exp->rows_total += rows;
+    exp->rows_in_transaction += rows;
+    if (exp->opts.batch_rows == 0 || exp->rows_in_transaction < exp->opts.batch_rows)
+        return SQLITE_OK;
+
+    exp->rows_in_transaction = 0;
+    int rc = sqlite3_exec(exp->db, "COMMIT; BEGIN;", NULL, NULL, NULL);
+    if (rc != SQLITE_OK)
+        fprintf(stderr, "Error committing transaction: %s\n", sqlite3_errmsg(exp->db));
+    return rc;
+}
+
+static sqlite3_stmt *prepare_insert(sqlite_table_writer_t *w, int rows) {
+    strbuf_t sb = { 0 };
+    strbuf_append_str(&sb, w->insert_prefix);
+    for (int i=0; i<rows; i++) {
+        strbuf_append_str(&sb, i ? ", (" : " (");
+        for (int j=0; j<w->num_columns; j++) {
+            strbuf_append_str(&sb, j ? ", ?" : "?");
+        }
+        strbuf_append_str(&sb, ")");
+    }
+    strbuf_append_str(&sb, ";");
+
+    sqlite3_stmt *stmt = NULL;
+    int rc = sqlite3_prepare_v2(w->exp->db, sb.buf, -1, &stmt, NULL);
+    if (rc != SQLITE_OK) {
+        fprintf(stderr, "Error preparing SQL statement: %s\n", sqlite3_errmsg(w->exp->db));
+        fprintf(stderr, "Statement was: %s\n", sb.buf);
+    }
+    free(sb.buf);
+    return stmt;
+}
+
+sqlite_table_writer_t *sqlite_table_writer_new(sqlite_export_t *exp,
+        fmp_table_t *table, fmp_column_array_t *columns) {
+    sqlite_table_writer_t *w = calloc(1, sizeof(sqlite_table_writer_t));
+    strbuf_t create = { 0 };
+    strbuf_t insert = { 0 };
+    int underscore = exp->opts.underscore_names;
+
+    w->exp = exp;
+    w->table = table;
+    w->num_columns = columns->count;
+    w->column_types = calloc(columns->count, sizeof(fmp_column_type_e));
+
+    strbuf_append_str(&create, "CREATE TABLE ");
+    strbuf_append_name(&create, table->utf8_name, 0);
+    strbuf_append_str(&create, " (");
+    strbuf_append_str(&insert, "INSERT INTO ");
+    strbuf_append_name(&insert, table->utf8_name, 0);
+    strbuf_append_str(&insert, " (");
+    for (int j=0; j<columns->count; j++) {
+        fmp_column_t *column = &columns->columns[j];
+        if (j) {
+            strbuf_append_str(&create, ", ");
+            strbuf_append_str(&insert, ", ");
+        }
+        if (!exp->opts.text_columns)
+            w->column_types[j] = column->type;
+        strbuf_append_name(&create, column->utf8_name, underscore);
+        strbuf_append_str(&create, " ");
+        strbuf_append_str(&create, declared_type(w->column_types[j]));
+        strbuf_append_name(&insert, column->utf8_name, underscore);
+    }
+    strbuf_append_str(&create, ");");
+    strbuf_append_str(&insert, ") VALUES");
+    w->insert_prefix = insert.buf;
+
+    char *zErrMsg = NULL;
+    int rc = sqlite3_exec(exp->db, create.buf, NULL, NULL, &zErrMsg);
+    if (rc != SQLITE_OK) {
+        fprintf(stderr, "Error creating SQL table: %s\n", zErrMsg);
+        fprintf(stderr, "Statement was: %s\n", create.buf);
+        sqlite3_free(zErrMsg);
+        goto error;
+    }
+
+    /* Stay under the bound-parameter limit when packing rows */
+    int max_vars = sqlite3_limit(exp->db, SQLITE_LIMIT_VARIABLE_NUMBER, -1);
+    w->rows_per_insert = exp->opts.insert_rows;
+    if (w->num_columns * w->rows_per_insert > max_vars)
+        w->rows_per_insert = max_vars / w->num_columns;
+    if (w->rows_per_insert < 1)
+        w->rows_per_insert = 1;
+
+    if ((w->insert_stmt = prepare_insert(w, w->rows_per_insert)) == NULL)
+        goto error;
+
+    for (int j=0; j<columns->count; j++) {
+        if (columns->columns[j].index > w->max_column_index)
+            w->max_column_index = columns->columns[j].index;
+    }
+    w->column_index_map = calloc(w->max_column_index + 1, sizeof(int));
+    for (int j=0; j<columns->count; j++) {
+        w->column_index_map[columns->columns[j].index] = j + 1; /* 0 = not in schema */
+    }
+
+    size_t num_values = (size_t)w->rows_per_insert * w->num_columns;
+    w->values = calloc(num_values, sizeof(sqlite_value_t));
+    for (size_t i=0; i<num_values; i++) {
+        w->values[i].len = -1;
+    }
+
+    free(create.buf);
+    return w;
+
+error:
+    free(create.buf);
+    sqlite_table_writer_free(w);
+    return NULL;
+}
+
+/* Bind numbers natively and dates/times as ISO-8601 text; anything that
+ * doesn't parse goes in as the original text */
+static int bind_value(sqlite3_stmt *stmt, int param,
+        fmp_column_type_e type, sqlite_value_t *value) {
+    fmp_value_t parsed;
+    char iso[64];
+    if (type == FMP_COLUMN_TYPE_TEXT || type == FMP_COLUMN_TYPE_UNKNOWN)
+        return sqlite3_bind_text(stmt, param, value->buf, value->len, SQLITE_STATIC);
+
+    switch (fmp_parse_value(type, value->buf, &parsed)) {
+    case FMP_VALUE_INTEGER:
+        return sqlite3_bind_int64(stmt, param, parsed.integer);
+    case FMP_VALUE_REAL:
+        return sqlite3_bind_double(stmt, param, parsed.real);
+    case FMP_VALUE_DATE:
+    case FMP_VALUE_TIME:
+    case FMP_VALUE_TIMESTAMP:
+        fmp_format_value(&parsed, iso, sizeof(iso));
+        return sqlite3_bind_text(stmt, param, iso, -1, SQLITE_TRANSIENT);
+    default:
+        return sqlite3_bind_text(stmt, param, value->buf, value->len, SQLITE_STATIC);
+    }
+}
+
+static int flush_rows(sqlite_table_writer_t *w) {
+    int rows = w->rows_buffered;
+    sqlite3_stmt *stmt = w->insert_stmt;
+    if (rows != w->rows_per_insert) {
+        if (w->tail_rows != rows) {
+            sqlite3_finalize(w->tail_stmt);
+            w->tail_rows = 0;
+            if ((w->tail_stmt = prepare_insert(w, rows)) == NULL)
+                return SQLITE_ERROR;
+            w->tail_rows = rows;
+        }
+        stmt = w->tail_stmt;
+    }
+
+    int rc = SQLITE_OK;
+    sqlite_value_t *values = w->values;
+    for (int i=0; i<rows * w->num_columns; i++) {
+        if (values[i].len < 0)
+            continue;
+        rc = bind_value(stmt, i + 1, w->column_types[i % w->num_columns], &values[i]);
+        if (rc != SQLITE_OK) {
+            fprintf(stderr, "Error binding parameter for table %s at position %d: %s\n",
+                    w->table->utf8_name, i + 1, sqlite3_errmsg(w->exp->db));
+            break;
+        }
+    }
+    if (rc == SQLITE_OK && (rc = sqlite3_step(stmt)) == SQLITE_DONE) {
+        rc = SQLITE_OK;
+    } else if (rc != SQLITE_OK) {
+        fprintf(stderr, "Error inserting data into table %s: %s\n",
+                w->table->utf8_name, sqlite3_errmsg(w->exp->db));
+    }
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+
+    for (int i=0; i<rows * w->num_columns; i++) {
+        values[i].len = -1;
+    }
+    w->rows_buffered = 0;
+
+    if (rc != SQLITE_OK)
+        return rc;
+    return rows_inserted(w->exp, rows);
+}
+
+static int end_row(sqlite_table_writer_t *w) {
+    if (++w->rows_buffered < w->rows_per_insert)
+        return SQLITE_OK;
+    return flush_rows(w);
+}
+
+int sqlite_table_writer_add(sqlite_table_writer_t *w, int row, fmp_column_t *column, const char *value) {
+    if (w->last_row != row && w->last_row > 0) {
+        int rc = end_row(w);
+        if (rc != SQLITE_OK)
+            return rc;
+    }
+    w->last_row = row;
+
+    /* Skip columns that weren't discovered in the schema - these might be deleted columns with leftover data */
+    if (column->index > w->max_column_index || !w->column_index_map[column->index])
+        return SQLITE_OK;
+
+    sqlite_value_t *slot = &w->values[w->rows_buffered * w->num_columns +
+        w->column_index_map[column->index] - 1];
+    size_t len = strlen(value);
+    if (len + 1 > slot->cap) {
+        slot->cap = len + 1 > 64 ? len + 1 : 64;
+        slot->buf = realloc(slot->buf, slot->cap);
+    }
+    memcpy(slot->buf, value, len + 1);
+    slot->len = len;
+    return SQLITE_OK;
+}
+
+int sqlite_table_writer_finish(sqlite_table_writer_t *w) {
+    int rc = SQLITE_OK;
+    if (w->last_row > 0) {
+        w->last_row = 0;
+        rc = end_row(w);
+    }
+    if (rc == SQLITE_OK && w->rows_buffered)
+        rc = flush_rows(w);
+    return rc;
+}
+
+void sqlite_table_writer_free(sqlite_table_writer_t *w) {
+    if (!w)
+        return;
+    sqlite3_finalize(w->insert_stmt);
+    sqlite3_finalize(w->tail_stmt);
+    if (w->values) {
+        for (size_t i=0; i<(size_t)w->rows_per_insert * w->num_columns; i++) {
+            free(w->values[i].buf);
+        }
+        free(w->values);
+    }
+    free(w->column_index_map);
+    free(w->column_types);
+    free(w->insert_prefix);
+    free(w);
+}
+
+int sqlite_export_drop_table(sqlite_export_t *exp, const char *table) {
+    strbuf_t sb = { 0 };
+    strbuf_append_str(&sb, "DROP TABLE IF EXISTS ");
+    strbuf_append_name(&sb, table, 0);
+    strbuf_append_str(&sb, ";");
+    int rc = exec_with_error(exp->db, sb.buf, "dropping table");
+    free(sb.buf);
+    return rc;
+}
+
+/* Incremental export: the output database remembers a fingerprint of each
+ * table's blocks (see fmp_fingerprint_tables), and tables whose fingerprint
+ * hasn't changed since the last run are left alone. Fingerprints are stored
+ * as the signed 64-bit view of the unsigned hash. */
+int sqlite_export_sync_begin(sqlite_export_t *exp) {
+    sqlite3_stmt *stmt = NULL;
+    int rc = exec_with_error(exp->db,
+            "CREATE TABLE IF NOT EXISTS " SQLITE_EXPORT_SYNC_TABLE
+            " (name TEXT PRIMARY KEY, fingerprint INTEGER NOT NULL, updated INTEGER NOT NULL,"
+            " options TEXT NOT NULL DEFAULT '');",
+            "creating sync table");
+    if (rc != SQLITE_OK)
+        return rc;
+    /* Tables synced before options were recorded get re-exported once */
+    if (sqlite3_prepare_v2(exp->db, "SELECT options FROM " SQLITE_EXPORT_SYNC_TABLE ";",
+                -1, &stmt, NULL) == SQLITE_OK) {
+        sqlite3_finalize(stmt);
+        return SQLITE_OK;
+    }
+    return exec_with_error(exp->db,
+            "ALTER TABLE " SQLITE_EXPORT_SYNC_TABLE " ADD COLUMN options TEXT NOT NULL DEFAULT '';",
+            "updating sync table");
+}
+
+/* The options that change what an exported table holds, so a table
+ * exported with others isn't up to date even if its blocks are */
+static void sync_options(sqlite_export_t *exp, char *dst, size_t dst_len) {
+    snprintf(dst, dst_len, "text_columns=%d underscore_names=%d",
+            exp->opts.text_columns, exp->opts.underscore_names);
+}
+
+static int sync_statement(sqlite_export_t *exp, const char *sql, const char *table,
+        uint64_t fingerprint, int bind_fingerprint) {
+    sqlite3_stmt *stmt = NULL;
+    char options[64];
+    int rc = sqlite3_prepare_v2(exp->db, sql, -1, &stmt, NULL);
+    if (rc != SQLITE_OK) {
+        fprintf(stderr, "Error preparing SQL statement: %s\n", sqlite3_errmsg(exp->db));
+        return rc;
+    }
+    sqlite3_bind_text(stmt, 1, table, -1, SQLITE_STATIC);
+    if (bind_fingerprint) {
+        sync_options(exp, options, sizeof(options));
+        sqlite3_bind_int64(stmt, 2, (sqlite3_int64)fingerprint);
+        sqlite3_bind_text(stmt, 3, options, -1, SQLITE_STATIC);
+    }
+    rc = sqlite3_step(stmt);
+    if (rc != SQLITE_ROW && rc != SQLITE_DONE)
+        fprintf(stderr, "Error updating sync table: %s\n", sqlite3_errmsg(exp->db));
+    sqlite3_finalize(stmt);
+    return rc;
+}
+
+/* Returns 1 if the table was exported with the same fingerprint and
+ * options and is still present in the database */
+int sqlite_export_sync_unchanged(sqlite_export_t *exp, const char *table, uint64_t fingerprint) {
+    return sync_statement(exp,
+            "SELECT 1 FROM " SQLITE_EXPORT_SYNC_TABLE " AS s, sqlite_master AS m "
+            "WHERE s.name = ?1 AND s.fingerprint = ?2 AND s.options = ?3 "
+            "AND m.type = 'table' AND m.name = s.name;",
+            table, fingerprint, 1) == SQLITE_ROW;
+}
+
+int sqlite_export_sync_update(sqlite_export_t *exp, const char *table, uint64_t fingerprint) {
+    int rc = sync_statement(exp,
+            "INSERT OR REPLACE INTO " SQLITE_EXPORT_SYNC_TABLE " (name, fingerprint, updated, options) "
+            "VALUES (?1, ?2, strftime('%s', 'now'), ?3);",
+            table, fingerprint, 1);
+    return rc == SQLITE_DONE ? SQLITE_OK : rc;
+}
+
+/* Drop tables from earlier runs that are no longer in the file */
+int sqlite_export_sync_prune(sqlite_export_t *exp, const char **tables, int num_tables) {
+    sqlite3_stmt *stmt = NULL;
+    char **stale = NULL;
+    int num_stale = 0;
+    int rc = sqlite3_prepare_v2(exp->db, "SELECT name FROM " SQLITE_EXPORT_SYNC_TABLE ";",
+            -1, &stmt, NULL);
+    if (rc != SQLITE_OK) {
+        fprintf(stderr, "Error preparing SQL statement: %s\n", sqlite3_errmsg(exp->db));
+        return rc;
+    }
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        const char *name = (const char *)sqlite3_column_text(stmt, 0);
+        int found = 0;
+        for (int i=0; i<num_tables && !found; i++) {
+            found = (strcmp(tables[i], name) == 0);
+        }
+        if (!found) {
+            stale = realloc(stale, (num_stale + 1) * sizeof(char *));
+            stale[num_stale++] = strdup(name);
+        }
+    }
+    sqlite3_finalize(stmt);
+    rc = (rc == SQLITE_DONE) ? SQLITE_OK : rc;
+
+    for (int i=0; i<num_stale; i++) {
+        if (rc == SQLITE_OK) {
+            fprintf(stderr, "DROP TABLE \"%s\"\n", stale[i]);
+            if ((rc = sqlite_export_drop_table(exp, stale[i])) == SQLITE_OK &&
+                    (rc = sync_statement(exp, "DELETE FROM " SQLITE_EXPORT_SYNC_TABLE " WHERE name = ?1;",
+                        stale[i], 0, 0)) == SQLITE_DONE)
+                rc = SQLITE_OK;
+        }
+        free(stale[i]);
+    }
+    free(stale);
+    return rc;
+}
@@ -0,0 +1,99 @@
+/* FMP Tools - A library for reading FileMaker Pro databases
+ * Copyright (c) 2020 Evan Miller (except where otherwise noted)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/* Shared bulk-loading code for the SQLite exporters: option parsing,
+ * pragmas, transaction batching, buffered multi-row INSERTs and
+ * post-load indexing. */
+
+#include <sqlite3.h>
+
+/* Fingerprints of the exported tables, for incremental re-export */
+#define SQLITE_EXPORT_SYNC_TABLE "_fmptools_sync"
+
+typedef struct sqlite_index_spec_s {
+    const char *name;      /* Column name, "table.column", or a GLOB pattern */
+    int is_pattern;
+} sqlite_index_spec_t;
+
+typedef struct sqlite_export_options_s {
+    int batch_rows;        /* Rows per transaction; 0 = one transaction */
+    int insert_rows;       /* Rows per INSERT statement */
+    int cache_size;        /* PRAGMA cache_size; 0 = SQLite default */
+    int page_size;         /* PRAGMA page_size; 0 = SQLite default */
+    int underscore_names;  /* Replace spaces in column names with '_' */
+    int text_columns;      /* Declare and bind every column as TEXT */
+    sqlite_index_spec_t *indexes; /* Columns to index after loading */
+    int num_indexes;
+} sqlite_export_options_t;
+
+typedef struct sqlite_export_s {
+    sqlite3 *db;
+    sqlite_export_options_t opts;
+    size_t rows_in_transaction;
+    size_t rows_total;
+} sqlite_export_t;
+
+typedef struct sqlite_value_s {
+    char *buf;
+    size_t cap;
+    int len; /* -1 = NULL */
+} sqlite_value_t;
+
+typedef struct sqlite_table_writer_s {
+    sqlite_export_t *exp;
+    fmp_table_t *table;
+    int num_columns;
+    fmp_column_type_e *column_types; /* By SQLite column position */
+    int *column_index_map;  /* Maps FileMaker column index to SQLite column position */
+    int max_column_index;
+    char *insert_prefix;    /* INSERT INTO "t" ("a", "b") VALUES */
+    int rows_per_insert;
+    sqlite3_stmt *insert_stmt;
+    sqlite3_stmt *tail_stmt;
+    int tail_rows;
+    sqlite_value_t *values; /* rows_per_insert x num_columns */
+    int rows_buffered;
+    int last_row;
+} sqlite_table_writer_t;
+
+void sqlite_export_default_options(sqlite_export_options_t *opts);
+int sqlite_export_parse_option(sqlite_export_options_t *opts, int argc, char *argv[], int *i);
+void sqlite_export_print_options(FILE *stream);
+void sqlite_export_free_options(sqlite_export_options_t *opts);
+
+int sqlite_export_open(sqlite_export_t *exp, const char *path, const sqlite_export_options_t *opts);
+int sqlite_export_create_indexes(sqlite_export_t *exp);
+int sqlite_export_merge_shards(sqlite_export_t *exp, char **shard_paths, int num_shards,
+        const char **table_names, const int *table_shards, int num_tables);
+int sqlite_export_close(sqlite_export_t *exp);
+
+int sqlite_export_drop_table(sqlite_export_t *exp, const char *table);
+int sqlite_export_sync_begin(sqlite_export_t *exp);
+int sqlite_export_sync_unchanged(sqlite_export_t *exp, const char *table, uint64_t fingerprint);
+int sqlite_export_sync_update(sqlite_export_t *exp, const char *table, uint64_t fingerprint);
+int sqlite_export_sync_prune(sqlite_export_t *exp, const char **tables, int num_tables);
+
+sqlite_table_writer_t *sqlite_table_writer_new(sqlite_export_t *exp,
+        fmp_table_t *table, fmp_column_array_t *columns);
+int sqlite_table_writer_add(sqlite_table_writer_t *w, int row, fmp_column_t *column, const char *value);
+int sqlite_table_writer_finish(sqlite_table_writer_t *w);
+void sqlite_table_writer_free(sqlite_table_writer_t *w);
@@ -0,0 +1,102 @@
+/* FMP Tools - A library for reading FileMaker Pro databases
+ * Copyright (c) 2020 Evan Miller (except where otherwise noted)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#include "../fmp.h"
+#include "table_files.h"
+
+int table_files_init(table_files_t *files, const char *dir, const char *extension) {
+    memset(files, 0, sizeof(table_files_t));
+    files->dir = dir;
+    files->extension = extension;
+    if (mkdir(dir, 0777) != 0 && errno != EEXIST) {
+        fprintf(stderr, "Couldn't create directory %s: %s\n", dir, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+/* Table names can contain anything, file names can't */
+static void sanitize_file_name(char *name) {
+    for (char *p = name; *p; p++) {
+        if (*p == '/' || *p == '\\' || *p == ':' || (unsigned char)*p < 0x20)
+            *p = '_';
+    }
+    if (name[0] == '.')
+        name[0] = '_';
+}
+
+const char *table_files_path(table_files_t *files, fmp_table_t *table) {
+    size_t len = strlen(files->dir) + strlen(table->utf8_name) + strlen(files->extension) + 32;
+    char *path = malloc(len);
+    int dir_len = snprintf(path, len, "%s/", files->dir);
+    snprintf(path + dir_len, len - dir_len, "%s%s", table->utf8_name, files->extension);
+    sanitize_file_name(path + dir_len);
+
+    /* Names that only differ in replaced characters get the table index */
+    for (int i = 0; i < files->count; i++) {
+        if (strcmp(files->paths[i], path) == 0) {
+            snprintf(path + dir_len, len - dir_len, "%s_%d%s", table->utf8_name, table->index, files->extension);
+            sanitize_file_name(path + dir_len);
+            break;
+        }
+    }
+
+    files->paths = realloc(files->paths, (files->count + 1) * sizeof(char *));
+    files->paths[files->count++] = path;
+    return path;
+}
+
+void table_files_free(table_files_t *files) {
+    for (int i = 0; i < files->count; i++)
+        free(files->paths[i]);
+    free(files->paths);
+    files->paths = NULL;
+    files->count = 0;
+}
+
+size_t table_files_report_unparsed(fmp_metadata_t *metadata, fmp_unparsed_array_t *unparsed) {
+    size_t total = 0;
+    for (size_t i = 0; i < metadata->tables->count && i < metadata->columns_capacity; i++) {
+        fmp_table_t *table = &metadata->tables->tables[i];
+        fmp_column_array_t *columns = metadata->columns[i];
+        for (size_t j = 0; columns && j < columns->count; j++) {
+            fmp_column_t *column = &columns->columns[j];
+            for (size_t k = 0; unparsed && k < unparsed->count; k++) {
+                fmp_unparsed_column_t *u = &unparsed->columns[k];
+                if (u->table_index != table->index || u->column_index != column->index)
+                    continue;
+                fprintf(stderr, "%s.%s: %zu values didn't parse as the column's type and were written as null\n",
+                        table->utf8_name, column->utf8_name, u->count);
+                total += u->count;
+            }
+        }
+    }
+    if (total)
+        fprintf(stderr, "Run without --typed-values to keep every value as text\n");
+    return total;
+}
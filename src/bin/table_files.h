@@ -0,0 +1,43 @@
+/* FMP Tools - A library for reading FileMaker Pro databases
+ * Copyright (c) 2020 Evan Miller (except where otherwise noted)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/* Output directories with one file per table, shared by the exporters
+ * that split a database into per-table files. */
+
+typedef struct table_files_s {
+    const char *dir;
+    const char *extension;
+    char **paths;
+    int count;
+} table_files_t;
+
+/* Creates the directory if needed; prints an error and returns -1 on failure */
+int table_files_init(table_files_t *files, const char *dir, const char *extension);
+
+/* The file name for a table, unique within the directory */
+const char *table_files_path(table_files_t *files, fmp_table_t *table);
+
+void table_files_free(table_files_t *files);
+
+/* Prints how many values of each column a typed export wrote as null and
+ * returns the total */
+size_t table_files_report_unparsed(fmp_metadata_t *metadata, fmp_unparsed_array_t *unparsed);
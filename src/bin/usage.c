@@ -3,12 +3,16 @@
 #include <stdlib.h>
 #include <libgen.h>
 
-void print_usage_and_exit(int argc, char *argv[]) {
+void print_usage_with_args_and_exit(int argc, char *argv[], const char *args, int status) {
     if (argc == 2 && strcmp(argv[1], "--version") == 0) {
         printf("FMP Tools version %s\n", VERSION);
         printf("Copyright 2020 Evan Miller\n");
         printf("https://github.com/evanmiller/fmptools\n\n");
     }
-    printf("Usage: %s [input file] [output file]\n", basename(argv[0]));
-    exit(1);
+    printf("Usage: %s %s\n", basename(argv[0]), args);
+    exit(status);
+}
+
+void print_usage_and_exit(int argc, char *argv[]) {
+    print_usage_with_args_and_exit(argc, argv, "[input file] [output file]", 1);
 }
@@ -1 +1,2 @@
 void print_usage_and_exit(int argc, char *argv[]);
+void print_usage_with_args_and_exit(int argc, char *argv[], const char *args, int status);
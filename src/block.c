@@ -362,7 +362,7 @@ static fmp_error_t process_block_v7(fmp_block_t *block) {
             chunk->data.bytes = p;
             p += chunk->data.len;
         } else {
-            fprintf(stderr, " **** UNRECOGNIZED CODE 0x%02x @ [%llu] *****\n", c, (unsigned long long)(p - block->payload));
+            log_message(FMP_LOG_ERROR, "Unrecognized code 0x%02x @ [%llu] in block %d", c, (unsigned long long)(p - block->payload), block->this_id);
             free(chunk);
             retval = FMP_ERROR_UNRECOGNIZED_CODE;
             break;
@@ -453,7 +453,7 @@ static fmp_error_t process_block_v3(fmp_block_t *block) {
             }
             c = *++p;
             if (!c) {
-                fprintf(stderr, "Bad 0xFF chunk: %02x!\n", c);
+                log_message(FMP_LOG_WARNING, "Bad 0xFF chunk: %02x", c);
                 free(chunk);
                 break;
             } else if (c <= 0x04) {
@@ -482,7 +482,7 @@ static fmp_error_t process_block_v3(fmp_block_t *block) {
                 p += chunk->data.len;
             } else {
                 /* For now, skip unknown 0xFF extended codes */
-                fprintf(stderr, "Warning: Skipping unknown 0xFF extended code: %02x @ [%llu]\n", c, (unsigned long long)(p - block->payload - 1));
+                log_message(FMP_LOG_WARNING, "Skipping unknown 0xFF extended code: %02x @ [%llu]", c, (unsigned long long)(p - block->payload - 1));
                 chunk->type = FMP_CHUNK_IGNORE;
                 /* Try to skip based on common patterns - assume 1 byte length + data */
                 if (p >= end) {
@@ -522,6 +522,9 @@ fmp_error_t process_block(fmp_file_t *file, fmp_block_t *block) {
     if (block->chunk) // already processed
         return FMP_OK;
 
+    if (file->stats)
+        file->stats->blocks_decoded++;
+
     if (file->version_num >= 7)
         return process_block_v7(block);
     return process_block_v3(block);
@@ -58,7 +58,7 @@ static void handle_table(fmp_chunk_t *chunk, fmp_discover_metadata_ctx_t *ctx, s
 
     fmp_table_t *current_table = &tables->tables[table_index - 1];
     if (chunk->ref_simple == 16) {
-        convert(ctx->file->converter, ctx->file->xor_mask,
+        convert_value(ctx->file,
                 current_table->utf8_name, sizeof(current_table->utf8_name),
                 chunk->data.bytes, chunk->data.len);
         current_table->index = table_index;
@@ -84,16 +84,20 @@ static void handle_column(fmp_chunk_t *chunk, fmp_discover_metadata_ctx_t *ctx,
 
     if (chunk->ref_simple == 16) {
         /* Column name (v7+) */
-        convert(ctx->file->converter, ctx->file->xor_mask,
+        convert_value(ctx->file,
                 current_column->utf8_name, sizeof(current_column->utf8_name),
                 chunk->data.bytes, chunk->data.len);
         current_column->index = column_index;
     } else if (chunk->ref_simple == 1) {
         /* Column name (v3-v6) */
-        convert(ctx->file->converter, ctx->file->xor_mask,
+        convert_value(ctx->file,
                 current_column->utf8_name, sizeof(current_column->utf8_name),
                 chunk->data.bytes, chunk->data.len);
         current_column->index = column_index;
+    } else if (chunk->ref_simple == 2 && chunk->version_num >= 7) {
+        /* Column storage options (v7+) */
+        if (chunk->data.len >= 2)
+            current_column->type = column_type_v7(chunk->data.bytes[1]);
     } else if (chunk->ref_simple == 2) {
         /* Column type and collation (v3-v6) */
         if (chunk->data.bytes[1] <= FMP_COLUMN_TYPE_GLOBAL) {
@@ -125,7 +129,7 @@ static chunk_status_t handle_chunk_discover_v7(fmp_chunk_t *chunk, fmp_discover_
             fmp_data_t *column_path = chunk->path[chunk->path_level - 1];
             size_t column_index = path_value(chunk, column_path);
 
-            if (chunk->ref_simple == 16) {
+            if (column_index > 0 && (chunk->ref_simple == 16 || chunk->ref_simple == 2)) {
                 handle_column(chunk, ctx, table_index, column_index);
             }
         }
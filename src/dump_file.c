@@ -23,23 +23,118 @@
 #include <iconv.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
 #include <inttypes.h>
 
 #include "fmp.h"
 #include "fmp_internal.h"
 
+/* Output is collected here and written in large chunks */
+#define DUMP_BUFFER_SIZE (1 << 20)
+
 typedef struct fmp_dump_ctx_s {
     int did_print_current_path;
     unsigned char xor_mask;
     iconv_t converter;
+    const fmp_dump_options_t *options;
+    int filtered;               /* Path or chunk type filter in effect */
+
+    /* Header of the current block, printed with its first selected chunk */
+    int block_pending;
+    int prev_id, this_id, next_id;
+    size_t payload_len;
+
+    FILE *stream;
+    char *out;
+    size_t out_len;
+    int write_error;
+
+    /* Scratch space for converting values, reused across chunks */
+    char *utf8;
+    size_t utf8_capacity;
+    uint8_t *unmasked;
+    size_t unmasked_capacity;
 } fmp_dump_ctx_t;
 
+static void out_flush(fmp_dump_ctx_t *ctx) {
+    if (ctx->out_len && fwrite(ctx->out, 1, ctx->out_len, ctx->stream) != ctx->out_len)
+        ctx->write_error = 1;
+    ctx->out_len = 0;
+}
+
+static void out_append(fmp_dump_ctx_t *ctx, const char *s, size_t len) {
+    if (ctx->out_len + len > DUMP_BUFFER_SIZE) {
+        out_flush(ctx);
+        if (len > DUMP_BUFFER_SIZE) {
+            if (fwrite(s, 1, len, ctx->stream) != len)
+                ctx->write_error = 1;
+            return;
+        }
+    }
+    memcpy(ctx->out + ctx->out_len, s, len);
+    ctx->out_len += len;
+}
+
+static void out_string(fmp_dump_ctx_t *ctx, const char *s) {
+    out_append(ctx, s, strlen(s));
+}
+
+static void out_char(fmp_dump_ctx_t *ctx, char c) {
+    if (ctx->out_len == DUMP_BUFFER_SIZE)
+        out_flush(ctx);
+    ctx->out[ctx->out_len++] = c;
+}
+
+static void out_spaces(fmp_dump_ctx_t *ctx, size_t count) {
+    while (count--)
+        out_char(ctx, ' ');
+}
+
+static void out_u64(fmp_dump_ctx_t *ctx, uint64_t value) {
+    char digits[20];
+    int n = 0;
+    do {
+        digits[sizeof(digits) - ++n] = '0' + value % 10;
+        value /= 10;
+    } while (value);
+    out_append(ctx, digits + sizeof(digits) - n, n);
+}
+
+static void out_hex(fmp_dump_ctx_t *ctx, uint8_t byte) {
+    static const char hex[] = "0123456789ABCDEF";
+    char s[4] = { '0', 'x', hex[byte >> 4], hex[byte & 0x0F] };
+    out_append(ctx, s, sizeof(s));
+}
+
+/* For the rare lines that need real formatting */
+static void out_printf(fmp_dump_ctx_t *ctx, const char *fmt, ...) {
+    char line[256];
+    va_list argp;
+    va_start(argp, fmt);
+    int len = vsnprintf(line, sizeof(line), fmt, argp);
+    va_end(argp);
+    if (len > 0)
+        out_append(ctx, line, len < sizeof(line) ? len : sizeof(line) - 1);
+}
+
+static void *reserve(void *buffer, size_t *capacity, size_t len) {
+    if (len <= *capacity)
+        return buffer;
+    void *grown = realloc(buffer, len);
+    if (grown)
+        *capacity = len;
+    return grown;
+}
+
 static void dump_data(fmp_chunk_t *chunk, fmp_data_t *data, fmp_dump_ctx_t *ctx) {
     uint8_t *bytes = data->bytes;
     size_t len = data->len;
     if (len == 1 || ((bytes[0] ^ ctx->xor_mask)  >= 0x80 && len <= 3 )) {
         uint64_t val = path_value(chunk, data);
-        printf("[%" PRIu64 "]", val);
+        out_char(ctx, '[');
+        out_u64(ctx, val);
+        out_char(ctx, ']');
     } else if (((bytes[0] ^ ctx->xor_mask) < 0x20 || (bytes[0] ^ ctx->xor_mask) >= 0x80) && len <= 4) {
         uint64_t val = bytes[0];
         int i=0;
@@ -47,19 +142,37 @@ static void dump_data(fmp_chunk_t *chunk, fmp_data_t *data, fmp_dump_ctx_t *ctx)
             val <<= 8;
             val += bytes[i];
         }
-        printf("[%" PRIu64 "]", val);
+        out_char(ctx, '[');
+        out_u64(ctx, val);
+        out_char(ctx, ']');
     } else {
         size_t utf8_len = 4*len+1;
-        char *utf8 = malloc(utf8_len);
-        convert(ctx->converter, ctx->xor_mask, utf8, utf8_len, bytes, len);
-        printf("\"%s\"", utf8);
-        free(utf8);
+        char *utf8 = reserve(ctx->utf8, &ctx->utf8_capacity, utf8_len);
+        if (!utf8)
+            return;
+        ctx->utf8 = utf8;
+        /* Unmask here so that convert doesn't allocate a copy */
+        if (ctx->xor_mask) {
+            uint8_t *unmasked = reserve(ctx->unmasked, &ctx->unmasked_capacity, len);
+            if (!unmasked)
+                return;
+            ctx->unmasked = unmasked;
+            for (size_t i=0; i<len; i++)
+                unmasked[i] = bytes[i] ^ ctx->xor_mask;
+            bytes = unmasked;
+        }
+        convert(ctx->converter, 0, utf8, utf8_len, bytes, len);
+        out_char(ctx, '"');
+        out_string(ctx, utf8);
+        out_char(ctx, '"');
     }
 }
 
 static void dump_path_value(fmp_chunk_t *chunk, fmp_data_t *path, fmp_dump_ctx_t *ctx) {
     if (path->len <= 3) {
-        printf("[%" PRIu64 "]", path_value(chunk, path));
+        out_char(ctx, '[');
+        out_u64(ctx, path_value(chunk, path));
+        out_char(ctx, ']');
     } else {
         dump_data(chunk, path, ctx);
     }
@@ -68,82 +181,160 @@ static void dump_path_value(fmp_chunk_t *chunk, fmp_data_t *path, fmp_dump_ctx_t
 static void dump_path(fmp_chunk_t *chunk, fmp_dump_ctx_t *ctx) {
     for (int i=0; i<chunk->path_level; i++) {
         dump_path_value(chunk, chunk->path[i], ctx);
-        printf(".");
+        out_char(ctx, '.');
     }
 }
 
+static void dump_block_header(fmp_dump_ctx_t *ctx) {
+    ctx->block_pending = 0;
+    if (ctx->this_id == 0) {
+        out_printf(ctx, "=== [ INDEX BLOCK ] ===\n");
+        out_printf(ctx, "   # blocks: %d\n", ctx->next_id);
+    } else {
+        out_printf(ctx, "== %d -> [ BLOCK %d ] -> %d ==\n", ctx->prev_id, ctx->this_id, ctx->next_id);
+        out_printf(ctx, "        [ Len: %zu ]\n", ctx->payload_len);
+    }
+}
+
+static int chunk_selected(fmp_chunk_t *chunk, fmp_dump_ctx_t *ctx) {
+    const fmp_dump_options_t *options = ctx->options;
+    if (options->chunk_types && !(options->chunk_types & (1u << chunk->type)))
+        return 0;
+    if (options->path_prefix_len > chunk->path_level)
+        return 0;
+    for (size_t i=0; i<options->path_prefix_len; i++) {
+        if (path_value(chunk, chunk->path[i]) != options->path_prefix[i])
+            return 0;
+    }
+    return 1;
+}
+
 static chunk_status_t dump_chunk(fmp_chunk_t *chunk, void *the_ctx) {
     fmp_dump_ctx_t *ctx = (fmp_dump_ctx_t *)the_ctx;
+    if (ctx->filtered) {
+        if (!chunk_selected(chunk, ctx)) {
+            if (chunk->type == FMP_CHUNK_PATH_POP || chunk->type == FMP_CHUNK_PATH_PUSH)
+                ctx->did_print_current_path = 0;
+            return CHUNK_NEXT;
+        }
+        if (ctx->block_pending)
+            dump_block_header(ctx);
+    }
+
     if (chunk->type == FMP_CHUNK_PATH_POP) {
         ctx->did_print_current_path = 0;
-        printf("-- POP 0x%02X --\n", chunk->code);
+        out_string(ctx, "-- POP ");
+        out_hex(ctx, chunk->code);
+        out_string(ctx, " --\n");
     } else if (chunk->type == FMP_CHUNK_PATH_PUSH) {
-        printf("-- PUSH 0x%02X [ ", chunk->code);
+        out_string(ctx, "-- PUSH ");
+        out_hex(ctx, chunk->code);
+        out_string(ctx, " [ ");
         for (int i=0; i<chunk->data.len; i++) {
-            printf("0x%02X ", chunk->data.bytes[i]);
+            out_hex(ctx, chunk->data.bytes[i]);
+            out_char(ctx, ' ');
         }
-        printf(" ] --\n");
+        out_string(ctx, " ] --\n");
         ctx->did_print_current_path = 0;
     } else {
         if (!ctx->did_print_current_path && chunk->path_level) {
             dump_path(chunk, ctx);
-            printf("\n");
+            out_char(ctx, '\n');
             ctx->did_print_current_path = 1;
         }
-        printf("%*s", (int)chunk->path_level, "");
+        out_spaces(ctx, chunk->path_level);
     }
     if (chunk->type == FMP_CHUNK_DATA_SIMPLE) {
-        printf("-- data simple (0x%02X): ", chunk->code);
+        out_string(ctx, "-- data simple (");
+        out_hex(ctx, chunk->code);
+        out_string(ctx, "): ");
         unsigned char mask = ctx->xor_mask;
         ctx->xor_mask = 0;
         dump_data(chunk, &chunk->data, ctx);
         ctx->xor_mask = mask;
-        printf(" --\n");
+        out_string(ctx, " --\n");
     }
     if (chunk->type == FMP_CHUNK_FIELD_REF_SIMPLE) {
-        printf("-- field (0x%02X): [%d] => ", chunk->code, chunk->ref_simple);
+        out_string(ctx, "-- field (");
+        out_hex(ctx, chunk->code);
+        out_string(ctx, "): [");
+        out_u64(ctx, chunk->ref_simple);
+        out_string(ctx, "] => ");
         dump_data(chunk, &chunk->data, ctx);
-        printf(" --\n");
+        out_string(ctx, " --\n");
     }
     if (chunk->type == FMP_CHUNK_FIELD_REF_LONG) {
-        printf("-- field (0x%02X): ", chunk->code);
+        out_string(ctx, "-- field (");
+        out_hex(ctx, chunk->code);
+        out_string(ctx, "): ");
         dump_data(chunk, &chunk->ref_long, ctx);
-        printf(" => ");
+        out_string(ctx, " => ");
         dump_data(chunk, &chunk->data, ctx);
-        printf(" --\n");
+        out_string(ctx, " --\n");
     }
     if (chunk->type == FMP_CHUNK_DATA_SEGMENT) {
-        printf("-- segment #%d (%zu bytes) --\n", chunk->segment_index, chunk->data.len);
+        out_string(ctx, "-- segment #");
+        out_u64(ctx, chunk->segment_index);
+        out_string(ctx, " (");
+        out_u64(ctx, chunk->data.len);
+        out_string(ctx, " bytes) --\n");
     }
     if (chunk->extended)
-        printf("   => EXTENDED <= \n");
-    return CHUNK_NEXT;
+        out_string(ctx, "   => EXTENDED <= \n");
+    return ctx->write_error ? CHUNK_ABORT : CHUNK_NEXT;
 }
 
-static int start_block(fmp_block_t *block, void *ctx) {
-    ((fmp_dump_ctx_t *)ctx)->did_print_current_path = 0;
-    if (block->this_id == 0) {
-        debug("=== [ INDEX BLOCK ] ===\n");
-        debug("   # blocks: %d\n", block->next_id);
+static int start_block(fmp_block_t *block, void *the_ctx) {
+    fmp_dump_ctx_t *ctx = (fmp_dump_ctx_t *)the_ctx;
+    const fmp_dump_options_t *options = ctx->options;
+    ctx->did_print_current_path = 0;
+
+    /* Blocks outside the range aren't even parsed */
+    if ((options->first_block && block->this_id < options->first_block) ||
+            (options->last_block && block->this_id > options->last_block))
+        return 0;
+
+    ctx->prev_id = block->prev_id;
+    ctx->this_id = block->this_id;
+    ctx->next_id = block->next_id;
+    ctx->payload_len = block->payload_len;
+    if (ctx->filtered) {
+        ctx->block_pending = 1;
     } else {
-        debug("== %d -> [ BLOCK %d ] -> %d ==\n", block->prev_id, block->this_id, block->next_id);
-        debug("        [ Len: %zu ]\n", block->payload_len);
+        dump_block_header(ctx);
     }
     return 1;
 }
 
-fmp_error_t fmp_dump_file(fmp_file_t *file) {
+fmp_error_t fmp_dump_file_with_options(fmp_file_t *file, const fmp_dump_options_t *options) {
+    fmp_dump_options_t no_options = { .stream = NULL };
     fmp_dump_ctx_t ctx = { 0 };
     ctx.converter = file->converter;
     ctx.xor_mask = file->xor_mask;
+    ctx.options = options ? options : &no_options;
+    ctx.filtered = ctx.options->chunk_types || ctx.options->path_prefix_len;
+    ctx.stream = ctx.options->stream ? ctx.options->stream : stdout;
+    if (!(ctx.out = malloc(DUMP_BUFFER_SIZE)))
+        return FMP_ERROR_MALLOC;
 
-    debug("Version: File Maker %s\n", file->version_string);
+    out_printf(&ctx, "Version: File Maker %s\n", file->version_string);
     if (file->version_date.tm_mon) {
-        debug("Released: %04d-%02d-%02d\n",
+        out_printf(&ctx, "Released: %04d-%02d-%02d\n",
                 file->version_date.tm_year+1900,
                 file->version_date.tm_mon+1,
                 file->version_date.tm_mday);
     }
 
-    return process_blocks(file, &start_block, &dump_chunk, &ctx);
+    fmp_error_t retval = process_blocks(file, &start_block, &dump_chunk, &ctx);
+    out_flush(&ctx);
+    fflush(ctx.stream);
+
+    free(ctx.out);
+    free(ctx.utf8);
+    free(ctx.unmasked);
+    return retval;
+}
+
+fmp_error_t fmp_dump_file(fmp_file_t *file) {
+    return fmp_dump_file_with_options(file, NULL);
 }
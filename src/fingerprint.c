@@ -0,0 +1,370 @@
+/* FMP Tools - A library for reading FileMaker Pro databases
+ * Copyright (c) 2020 Evan Miller (except where otherwise noted)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/* Block hashes and per-table fingerprints of the block chain, used to tell
+ * what changed between two copies of a file without reading any values.
+ * Each block's payload is hashed and folded into every table that has data
+ * in that block, so a change anywhere in a shared block marks all of its
+ * tables as changed. */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "fmp.h"
+#include "fmp_internal.h"
+
+/* XXH64 */
+#define PRIME64_1 0x9E3779B185EBCA87ULL
+#define PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define PRIME64_3 0x165667B19E3779F9ULL
+#define PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define PRIME64_5 0x27D4EB2F165667C5ULL
+
+static inline uint64_t rotl64(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t read64_le(const uint8_t *p) {
+    return (uint64_t)p[0] | ((uint64_t)p[1] << 8) | ((uint64_t)p[2] << 16) | ((uint64_t)p[3] << 24) |
+        ((uint64_t)p[4] << 32) | ((uint64_t)p[5] << 40) | ((uint64_t)p[6] << 48) | ((uint64_t)p[7] << 56);
+}
+
+static inline uint32_t read32_le(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline uint64_t hash_round(uint64_t acc, uint64_t input) {
+    acc += input * PRIME64_2;
+    acc = rotl64(acc, 31);
+    return acc * PRIME64_1;
+}
+
+static inline uint64_t hash_merge_round(uint64_t acc, uint64_t val) {
+    acc ^= hash_round(0, val);
+    return acc * PRIME64_1 + PRIME64_4;
+}
+
+uint64_t hash64(const uint8_t *p, size_t len, uint64_t seed) {
+    const uint8_t *end = p + len;
+    uint64_t h;
+
+    if (len >= 32) {
+        uint64_t v1 = seed + PRIME64_1 + PRIME64_2;
+        uint64_t v2 = seed + PRIME64_2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - PRIME64_1;
+        do {
+            v1 = hash_round(v1, read64_le(p));
+            v2 = hash_round(v2, read64_le(p + 8));
+            v3 = hash_round(v3, read64_le(p + 16));
+            v4 = hash_round(v4, read64_le(p + 24));
+            p += 32;
+        } while (p + 32 <= end);
+        h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+        h = hash_merge_round(h, v1);
+        h = hash_merge_round(h, v2);
+        h = hash_merge_round(h, v3);
+        h = hash_merge_round(h, v4);
+    } else {
+        h = seed + PRIME64_5;
+    }
+
+    h += len;
+    for (; p + 8 <= end; p += 8) {
+        h ^= hash_round(0, read64_le(p));
+        h = rotl64(h, 27) * PRIME64_1 + PRIME64_4;
+    }
+    if (p + 4 <= end) {
+        h ^= (uint64_t)read32_le(p) * PRIME64_1;
+        h = rotl64(h, 23) * PRIME64_2 + PRIME64_3;
+        p += 4;
+    }
+    for (; p < end; p++) {
+        h ^= *p * PRIME64_5;
+        h = rotl64(h, 11) * PRIME64_1;
+    }
+
+    h ^= h >> 33;
+    h *= PRIME64_2;
+    h ^= h >> 29;
+    h *= PRIME64_3;
+    h ^= h >> 32;
+    return h;
+}
+
+/* Order-dependent, so moving data between blocks changes the rollup */
+uint64_t hash64_combine(uint64_t h, uint64_t value) {
+    return hash_merge_round(rotl64(h, 27), value);
+}
+
+typedef struct fmp_fingerprint_ctx_s {
+    fmp_file_t *file;
+    fmp_block_hash_array_t *blocks;   /* NULL if not wanted */
+    size_t blocks_capacity;
+    fmp_fingerprint_array_t *tables;  /* NULL if not wanted */
+    size_t tables_capacity;
+    uint64_t block_hash;
+    size_t block_serial;
+    size_t *last_block_serial; /* By table index */
+    fmp_data_t *last_table_path;
+} fmp_fingerprint_ctx_t;
+
+static void fold_block(fmp_fingerprint_ctx_t *ctx, size_t table_index) {
+    if (table_index >= ctx->tables_capacity) {
+        size_t old_capacity = ctx->tables_capacity;
+        ctx->tables_capacity = 2 * table_index + 8;
+        ctx->tables->fingerprints = realloc(ctx->tables->fingerprints,
+                ctx->tables_capacity * sizeof(fmp_fingerprint_t));
+        ctx->last_block_serial = realloc(ctx->last_block_serial,
+                ctx->tables_capacity * sizeof(size_t));
+        memset(&ctx->tables->fingerprints[old_capacity], 0,
+                (ctx->tables_capacity - old_capacity) * sizeof(fmp_fingerprint_t));
+        memset(&ctx->last_block_serial[old_capacity], 0,
+                (ctx->tables_capacity - old_capacity) * sizeof(size_t));
+    }
+    if (ctx->last_block_serial[table_index] == ctx->block_serial)
+        return;
+
+    fmp_fingerprint_t *fingerprint = &ctx->tables->fingerprints[table_index];
+    fingerprint->index = table_index;
+    fingerprint->hash = hash64_combine(fingerprint->hash, ctx->block_hash);
+    fingerprint->num_blocks++;
+    ctx->last_block_serial[table_index] = ctx->block_serial;
+}
+
+static int handle_block_fingerprint(fmp_block_t *block, void *ctxp) {
+    fmp_fingerprint_ctx_t *ctx = (fmp_fingerprint_ctx_t *)ctxp;
+    ctx->block_hash = hash64(block->payload, block->payload_len, 0);
+    ctx->block_serial++;
+    ctx->last_table_path = NULL;
+
+    if (ctx->blocks) {
+        fmp_block_hash_array_t *blocks = ctx->blocks;
+        if (blocks->count == ctx->blocks_capacity) {
+            ctx->blocks_capacity = ctx->blocks_capacity ? 2 * ctx->blocks_capacity : 1024;
+            blocks->blocks = realloc(blocks->blocks, ctx->blocks_capacity * sizeof(fmp_block_hash_t));
+        }
+        blocks->blocks[blocks->count].id = block->this_id;
+        blocks->blocks[blocks->count].hash = ctx->block_hash;
+        blocks->count++;
+    }
+
+    if (!ctx->tables)
+        return 0;
+
+    /* There's only one table before v7, so every block belongs to it */
+    if (ctx->file->version_num < 7) {
+        fold_block(ctx, 1);
+        return 0;
+    }
+    return 1;
+}
+
+static chunk_status_t handle_chunk_fingerprint_v7(fmp_chunk_t *chunk, void *ctxp) {
+    fmp_fingerprint_ctx_t *ctx = (fmp_fingerprint_ctx_t *)ctxp;
+    if (chunk->path_level == 0 || chunk->path[0] == ctx->last_table_path)
+        return CHUNK_NEXT;
+
+    /* Interned paths share their top-level value, so this only decodes
+     * the path when it changes */
+    ctx->last_table_path = chunk->path[0];
+    uint64_t table_path = path_value(chunk, chunk->path[0]);
+    if (table_path > 128)
+        fold_block(ctx, table_path - 128);
+    return CHUNK_NEXT;
+}
+
+/* Hash every block in chain order. If tables is non-NULL, per-table
+ * rollups are computed in the same pass; that requires parsing the chunks,
+ * while the block hashes alone only touch the raw payloads. */
+fmp_block_hash_array_t *fmp_hash_blocks(fmp_file_t *file,
+        fmp_fingerprint_array_t **tables, fmp_error_t *errorCode) {
+    fmp_block_hash_array_t *blocks = calloc(1, sizeof(fmp_block_hash_array_t));
+    fmp_fingerprint_ctx_t ctx = {
+        .file = file,
+        .blocks = blocks,
+        .tables = tables ? calloc(1, sizeof(fmp_fingerprint_array_t)) : NULL
+    };
+    fmp_error_t retval = process_selected_blocks(file, handle_block_fingerprint,
+            NULL, handle_chunk_fingerprint_v7, &ctx);
+
+    if (ctx.tables) {
+        /* Compact to the tables that were seen, in index order */
+        size_t j = 0;
+        for (size_t i=0; i<ctx.tables_capacity; i++) {
+            if (ctx.tables->fingerprints[i].num_blocks) {
+                if (i != j)
+                    ctx.tables->fingerprints[j] = ctx.tables->fingerprints[i];
+                j++;
+            }
+        }
+        ctx.tables->count = j;
+    }
+    free(ctx.last_block_serial);
+
+    if (errorCode)
+        *errorCode = retval;
+    if (retval != FMP_OK) {
+        fmp_free_fingerprints(ctx.tables);
+        fmp_free_block_hashes(blocks);
+        return NULL;
+    }
+    if (tables)
+        *tables = ctx.tables;
+    return blocks;
+}
+
+fmp_fingerprint_array_t *fmp_fingerprint_tables(fmp_file_t *file, fmp_error_t *errorCode) {
+    fmp_fingerprint_array_t *tables = NULL;
+    fmp_block_hash_array_t *blocks = fmp_hash_blocks(file, &tables, errorCode);
+    fmp_free_block_hashes(blocks);
+    return tables;
+}
+
+/* Decoding selected blocks to find out what they hold */
+
+typedef struct fmp_block_ranges_ctx_s {
+    fmp_file_t *file;
+    const int *block_ids; /* Sorted */
+    size_t num_block_ids;
+    fmp_block_range_array_t *array;
+    size_t capacity;
+    size_t block_start;   /* First range of the current block */
+    int block_id;
+} fmp_block_ranges_ctx_t;
+
+static int compare_ids(const void *a, const void *b) {
+    int id1 = *(const int *)a, id2 = *(const int *)b;
+    return (id1 > id2) - (id1 < id2);
+}
+
+static int block_id_wanted(fmp_block_ranges_ctx_t *ctx, int id) {
+    size_t lo = 0, hi = ctx->num_block_ids;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (ctx->block_ids[mid] < id) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo < ctx->num_block_ids && ctx->block_ids[lo] == id;
+}
+
+static int handle_block_ranges(fmp_block_t *block, void *ctxp) {
+    fmp_block_ranges_ctx_t *ctx = (fmp_block_ranges_ctx_t *)ctxp;
+    ctx->block_id = block->this_id;
+    ctx->block_start = ctx->array->count;
+    return block_id_wanted(ctx, block->this_id);
+}
+
+static chunk_status_t handle_chunk_ranges(fmp_chunk_t *chunk, void *ctxp) {
+    fmp_block_ranges_ctx_t *ctx = (fmp_block_ranges_ctx_t *)ctxp;
+    int table_index = 1;
+    int row = 0;
+
+    if (chunk->type == FMP_CHUNK_PATH_PUSH || chunk->type == FMP_CHUNK_PATH_POP || chunk->path_level == 0)
+        return CHUNK_NEXT;
+
+    if (chunk->version_num >= 7) {
+        uint64_t table_path = path_value(chunk, chunk->path[0]);
+        table_index = table_path > 128 ? table_path - 128 : 0;
+        if (table_index && chunk->path_level >= 3 && path_is(chunk, chunk->path[1], 5))
+            row = path_value(chunk, chunk->path[2]);
+    } else if (chunk->path_level >= 2 && path_is(chunk, chunk->path[0], 5)) {
+        row = path_value(chunk, chunk->path[1]);
+    }
+
+    fmp_block_range_t *range = NULL;
+    for (size_t i=ctx->block_start; i<ctx->array->count; i++) {
+        if (ctx->array->ranges[i].table_index == table_index) {
+            range = &ctx->array->ranges[i];
+            break;
+        }
+    }
+    if (!range) {
+        if (ctx->array->count == ctx->capacity) {
+            ctx->capacity = ctx->capacity ? 2 * ctx->capacity : 64;
+            ctx->array->ranges = realloc(ctx->array->ranges, ctx->capacity * sizeof(fmp_block_range_t));
+        }
+        range = &ctx->array->ranges[ctx->array->count++];
+        memset(range, 0, sizeof(fmp_block_range_t));
+        range->block_id = ctx->block_id;
+        range->table_index = table_index;
+    }
+    if (row) {
+        if (!range->first_row || row < range->first_row)
+            range->first_row = row;
+        if (row > range->last_row)
+            range->last_row = row;
+    }
+    return CHUNK_NEXT;
+}
+
+/* Report which tables and record ranges the given blocks hold. Blocks not
+ * in block_ids are skipped without being parsed. */
+fmp_block_range_array_t *fmp_block_ranges(fmp_file_t *file,
+        const int *block_ids, size_t num_block_ids, fmp_error_t *errorCode) {
+    fmp_block_range_array_t *array = calloc(1, sizeof(fmp_block_range_array_t));
+    int *sorted = malloc((num_block_ids + 1) * sizeof(int));
+    memcpy(sorted, block_ids, num_block_ids * sizeof(int));
+    qsort(sorted, num_block_ids, sizeof(int), compare_ids);
+
+    fmp_block_ranges_ctx_t ctx = {
+        .file = file,
+        .block_ids = sorted,
+        .num_block_ids = num_block_ids,
+        .array = array
+    };
+    fmp_error_t retval = num_block_ids ? process_selected_blocks(file, handle_block_ranges, NULL, handle_chunk_ranges, &ctx) : FMP_OK;
+    free(sorted);
+
+    if (errorCode)
+        *errorCode = retval;
+    if (retval != FMP_OK) {
+        fmp_free_block_ranges(array);
+        return NULL;
+    }
+    return array;
+}
+
+void fmp_free_fingerprints(fmp_fingerprint_array_t *array) {
+    if (array) {
+        free(array->fingerprints);
+        free(array);
+    }
+}
+
+void fmp_free_block_hashes(fmp_block_hash_array_t *array) {
+    if (array) {
+        free(array->blocks);
+        free(array);
+    }
+}
+
+void fmp_free_block_ranges(fmp_block_range_array_t *array) {
+    if (array) {
+        free(array->ranges);
+        free(array);
+    }
+}
@@ -146,6 +146,18 @@ int path_is(fmp_chunk_t *chunk, fmp_data_t *path, uint64_t value) {
     return path_value(chunk, path) == value;
 }
 
+/* Second byte of the column's [2] key in fmp7+; see HACKING */
+fmp_column_type_e column_type_v7(uint8_t code) {
+    switch (code) {
+    case 1: return FMP_COLUMN_TYPE_TEXT;
+    case 2: return FMP_COLUMN_TYPE_NUMBER;
+    case 3: return FMP_COLUMN_TYPE_DATE;
+    case 4: return FMP_COLUMN_TYPE_TIME;
+    case 5: return FMP_COLUMN_TYPE_TIMESTAMP;
+    default: return FMP_COLUMN_TYPE_UNKNOWN;
+    }
+}
+
 void convert(iconv_t converter, uint8_t xor_mask,
         char *dst, size_t dst_len, uint8_t *src, size_t src_len) {
     char *input_bytes = (char *)src;
@@ -178,6 +190,38 @@ void convert(iconv_t converter, uint8_t xor_mask,
     }
 }
 
+static double scan_clock(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* convert() with the file's settings, counted in the scan stats */
+void convert_value(fmp_file_t *file,
+        char *dst, size_t dst_len, uint8_t *src, size_t src_len) {
+    fmp_scan_stats_t *stats = file->stats;
+    if (!stats) {
+        convert(file->converter, file->xor_mask, dst, dst_len, src, src_len);
+        return;
+    }
+    double start = scan_clock();
+    convert(file->converter, file->xor_mask, dst, dst_len, src, src_len);
+    stats->convert_seconds += scan_clock() - start;
+    stats->values_converted++;
+    stats->bytes_converted += src_len;
+    if (file->xor_mask)
+        stats->bytes_unmasked += src_len;
+}
+
+void convert_long_string(fmp_file_t *file,
+        char *dst, size_t dst_len, uint8_t *src, size_t src_len) {
+    if (file->stats) {
+        file->stats->long_strings++;
+        file->stats->long_string_bytes += src_len;
+    }
+    convert_value(file, dst, dst_len, src, src_len);
+}
+
 int table_path_depth(fmp_chunk_t *chunk) {
     if (chunk->version_num < 7)
         return chunk->path_level;
@@ -201,30 +245,46 @@ int table_path_match_start2(fmp_chunk_t *chunk, int depth, int val1, int val2) {
             path_is(chunk, chunk->path[1], val1) && path_is(chunk, chunk->path[2], val2));
 }
 
-chunk_status_t process_chunk(fmp_file_t *file, fmp_chunk_t *chunk,
-        chunk_handler handle_chunk, void *user_ctx) {
-    chunk->path = file->path;
-    chunk->path_level = file->path_level;
+/* Paths this shallow (tables and their sections) are kept for the whole
+ * scan; deeper ones are freed when popped */
+static uint32_t shared_path_levels(fmp_file_t *file) {
+    return file->version_num < 7 ? 1 : 2;
+}
+
+static chunk_status_t process_chunk(fmp_file_t *file, fmp_chunk_t *chunk,
+        chunk_handler handle_chunk, void *user_ctx, fmp_error_t *error) {
+    fmp_path_node_t *node = path_table_node(file->paths, file->path_id);
+    chunk->path = node->path;
+    chunk->path_id = node->serial;
+    chunk->path_level = node->level;
     chunk->version_num = file->version_num;
+    if (file->stats)
+        file->stats->chunks[chunk->type]++;
     if (chunk->type == FMP_CHUNK_PATH_POP) {
-        if (file->path_level)
-            file->path_level--;
-    }
-    if (chunk->type == FMP_CHUNK_PATH_PUSH) {
-        if (file->path_level + 1 > file->path_capacity)
-            file->path = realloc(file->path, (file->path_capacity *= 2) * sizeof(fmp_data_t *));
-        file->path[file->path_level++] = &chunk->data;
-    }
-    return handle_chunk(chunk, user_ctx);
+        file->path_id = node->parent;
+    }
+    if (chunk->type == FMP_CHUNK_PATH_PUSH &&
+            path_table_push(file->paths, file->path_id, &chunk->data, &file->path_id) != 0) {
+        *error = FMP_ERROR_MALLOC;
+        return CHUNK_ABORT;
+    }
+    chunk_status_t status = handle_chunk(chunk, user_ctx);
+    /* The handler has seen the popped path; nothing else refers to it */
+    if (chunk->type == FMP_CHUNK_PATH_POP)
+        path_table_release(file->paths, node->id, node->parent, shared_path_levels(file));
+    return status;
 }
 
 fmp_error_t process_chunk_chain(fmp_file_t *file, fmp_chunk_t *chunk,
         chunk_handler handle_chunk, void *user_ctx) {
-    file->path_level = 0;
+    fmp_error_t error = FMP_OK;
+    /* Paths left open by the previous block end with it */
+    path_table_release(file->paths, file->path_id, 0, shared_path_levels(file));
+    file->path_id = 0;
     while (chunk) {
-        chunk_status_t status = process_chunk(file, chunk, handle_chunk, user_ctx);
+        chunk_status_t status = process_chunk(file, chunk, handle_chunk, user_ctx, &error);
         if (status == CHUNK_ABORT)
-            return FMP_ERROR_USER_ABORTED;
+            return error != FMP_OK ? error : FMP_ERROR_USER_ABORTED;
         if (status == CHUNK_DONE)
             break;
         if (status == CHUNK_NEXT)
@@ -269,11 +329,15 @@ static fmp_block_t *load_block_from_mmap(fmp_file_t *file, int block_idx) {
     /* Create block from sector */
     fmp_error_t error = FMP_OK;
     fmp_block_t *block = new_block_from_sector(file, sector, &error);
+    if (block && file->stats)
+        file->stats->blocks_loaded++;
 
     /* For large files, don't cache blocks - they'll be freed after use */
     /* Only cache the first few blocks for repeated access */
     if (block && error == FMP_OK && block_idx < 100 && block_idx < file->blocks_allocated) {
         file->blocks[block_idx] = block;
+        if (file->stats)
+            file->stats->blocks_cached++;
     }
 
     return block;
@@ -283,18 +347,38 @@ fmp_error_t process_blocks(fmp_file_t *file,
         block_handler handle_block,
         chunk_handler handle_chunk,
         void *user_ctx) {
+    return process_selected_blocks(file, NULL, handle_block, handle_chunk, user_ctx);
+}
+
+/* Like process_blocks, but select_block sees each block before it is
+ * decoded, and blocks it declines are skipped without being decoded. */
+fmp_error_t process_selected_blocks(fmp_file_t *file,
+        block_handler select_block,
+        block_handler handle_block,
+        chunk_handler handle_chunk,
+        void *user_ctx) {
     fmp_error_t retval = FMP_OK;
     int next_block = 2;
+    fmp_scan_stats_t *stats = file->stats;
+    double start = 0.0;
+
+    if (stats)
+        stats->scans++;
 
-    /* Debug: check memory allocation */
     if (file->use_mmap) {
-        fprintf(stderr, "Processing blocks with mmap, num_blocks=%zu\n", file->num_blocks);
+        log_message(FMP_LOG_DEBUG, "Processing blocks with mmap, num_blocks=%zu", file->num_blocks);
     }
 
+    /* Path ids are only stable within a single scan */
+    if (path_table_reset(file->paths) != 0)
+        return FMP_ERROR_MALLOC;
+    file->path_id = 0;
+
     /* For large files, don't track all visited blocks - just detect loops */
     int *blocks_visited = NULL;
     int max_iterations = file->num_blocks * 2;  /* Safety limit */
     int iteration = 0;
+    size_t blocks_done = 0;
 
     /* Only allocate visited array for small files */
     if (file->num_blocks < 100000) {
@@ -304,20 +388,26 @@ fmp_error_t process_blocks(fmp_file_t *file,
     do {
         fmp_block_t *block = NULL;
 
+        if (stats)
+            start = scan_clock();
         /* Load block on-demand for mmap'd files */
         if (file->use_mmap) {
             block = load_block_from_mmap(file, next_block - 1);
         } else {
             block = file->blocks[next_block - 1];
         }
+        if (stats) {
+            double now = scan_clock();
+            stats->read_seconds += now - start;
+            stats->blocks_read += (block != NULL);
+            start = now;
+        }
 
         if (!block) {
             retval = FMP_ERROR_BAD_SECTOR;
             break;
         }
 
-        retval = process_block(file, block);
-
         /* Only track visits for smaller files */
         if (blocks_visited && next_block - 1 < file->num_blocks) {
             if (blocks_visited[next_block-1]) {
@@ -327,12 +417,19 @@ fmp_error_t process_blocks(fmp_file_t *file,
             blocks_visited[next_block-1] = 1;
         }
 
-        if (retval != FMP_OK) {
-            break;
-        }
         block->this_id = next_block;
-        if (!handle_block || handle_block(block, user_ctx))
-            retval = process_chunk_chain(file, block->chunk, handle_chunk, user_ctx);
+        if (!select_block || select_block(block, user_ctx)) {
+            retval = process_block(file, block);
+            if (stats) {
+                double now = scan_clock();
+                stats->decode_seconds += now - start;
+                start = now;
+            }
+            if (retval == FMP_OK && (!handle_block || handle_block(block, user_ctx)))
+                retval = process_chunk_chain(file, block->chunk, handle_chunk, user_ctx);
+            if (stats)
+                stats->handle_seconds += scan_clock() - start;
+        }
         int saved_next_id = block->next_id;
 
         /* CRITICAL: Free the block if it's not cached (for large mmap files) */
@@ -350,19 +447,36 @@ fmp_error_t process_blocks(fmp_file_t *file,
         if (should_free) {
             free_chunk_chain(block);
             free(block);
+            if (stats)
+                stats->blocks_evicted++;
         }
 
         next_block = saved_next_id;
 
+        if (file->progress && retval == FMP_OK && ++blocks_done % file->progress_interval == 0 &&
+                file->progress(blocks_done, file->num_blocks, blocks_done * file->sector_size,
+                    file->progress_ctx) == FMP_HANDLER_ABORT) {
+            retval = FMP_ERROR_USER_ABORTED;
+            break;
+        }
+
         /* Safety check for large files without visited tracking */
         if (++iteration > max_iterations) {
-            fprintf(stderr, "Warning: Too many iterations, possible loop\n");
+            log_message(FMP_LOG_WARNING, "Too many iterations, possible loop");
             break;
         }
     } while (next_block != 0 && next_block - 1 < file->num_blocks && retval == FMP_OK);
 
+    /* Report the end of the scan unless the last block already did */
+    if (file->progress && retval == FMP_OK && blocks_done % file->progress_interval &&
+            file->progress(blocks_done, file->num_blocks, blocks_done * file->sector_size,
+                file->progress_ctx) == FMP_HANDLER_ABORT) {
+        retval = FMP_ERROR_USER_ABORTED;
+    }
+
     if (blocks_visited)
         free(blocks_visited);
+    log_flush_suppressed();
 
     return retval;
 }
@@ -378,8 +492,11 @@ static fmp_file_t *fmp_file_from_stream(FILE *stream, const char *filename, fmp_
         retval = FMP_ERROR_SEEK;
         goto cleanup;
     }
-    file->path_capacity = 16;
-    file->path = calloc(file->path_capacity, sizeof(fmp_data_t *));
+    file->paths = path_table_new();
+    if (!file->paths) {
+        retval = FMP_ERROR_MALLOC;
+        goto cleanup;
+    }
     file->file_size = ftello(stream);
     rewind(stream);
 
@@ -551,9 +668,8 @@ static fmp_file_t *fmp_open_file_mmap(const char *path, fmp_error_t *errorCode)
     }
 
     /* Allocate path tracking */
-    file->path_capacity = 16;
-    file->path = calloc(file->path_capacity, sizeof(fmp_data_t *));
-    if (!file->path) {
+    file->paths = path_table_new();
+    if (!file->paths) {
         retval = FMP_ERROR_MALLOC;
         goto cleanup_error;
     }
@@ -607,7 +723,7 @@ static fmp_file_t *fmp_open_file_mmap(const char *path, fmp_error_t *errorCode)
 
 cleanup_error:
     if (file) {
-        if (file->path) free(file->path);
+        path_table_free(file->paths);
         free(file);
     }
     munmap(mmap_base, st.st_size);
@@ -623,7 +739,7 @@ fmp_file_t *fmp_open_file(const char *path, fmp_error_t *errorCode) {
     if (stat(path, &st) == 0) {
         /* Use mmap for files larger than 100MB */
         if (st.st_size > 100 * 1024 * 1024) {
-            fprintf(stderr, "File size %lld bytes, using mmap\n", (long long)st.st_size);
+            log_message(FMP_LOG_INFO, "File size %lld bytes, using mmap", (long long)st.st_size);
             return fmp_open_file_mmap(path, errorCode);
         }
     }
@@ -642,13 +758,33 @@ fmp_file_t *fmp_open_file(const char *path, fmp_error_t *errorCode) {
     return file;
 }
 
+/* Enabling starts the counts over; they cover every scan until disabled */
+void fmp_enable_scan_stats(fmp_file_t *file, int enable) {
+    free(file->stats);
+    file->stats = enable ? calloc(1, sizeof(fmp_scan_stats_t)) : NULL;
+}
+
+void fmp_get_scan_stats(fmp_file_t *file, fmp_scan_stats_t *stats) {
+    if (file->stats) {
+        *stats = *file->stats;
+    } else {
+        memset(stats, 0, sizeof(fmp_scan_stats_t));
+    }
+}
+
+void fmp_set_progress_handler(fmp_file_t *file, fmp_progress_handler handle_progress,
+        size_t interval, void *ctx) {
+    file->progress = handle_progress;
+    file->progress_interval = interval ? interval : 1;
+    file->progress_ctx = ctx;
+}
+
 void fmp_close_file(fmp_file_t *file) {
     if (file->stream)
         fclose(file->stream);
     if (file->converter)
         iconv_close(file->converter);
-    if (file->path)
-        free(file->path);
+    path_table_free(file->paths);
 
     /* Handle mmap cleanup */
     if (file->use_mmap) {
@@ -660,12 +796,14 @@ void fmp_close_file(fmp_file_t *file) {
         }
     }
 
-    for (int i=0; i<file->num_blocks; i++) {
+    /* Only the first blocks_allocated are cached for mmap'd files */
+    for (size_t i=0; i<file->blocks_allocated; i++) {
         fmp_block_t *block = file->blocks[i];
         if (block) {
             free_chunk_chain(block);
             free(block);
         }
     }
+    free(file->stats);
     free(file);
 }
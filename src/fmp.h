@@ -57,7 +57,8 @@ typedef enum {
     FMP_COLUMN_TYPE_CONTAINER,
     FMP_COLUMN_TYPE_CALC,
     FMP_COLUMN_TYPE_SUMMARY,
-    FMP_COLUMN_TYPE_GLOBAL
+    FMP_COLUMN_TYPE_GLOBAL,
+    FMP_COLUMN_TYPE_TIMESTAMP
 } fmp_column_type_e;
 
 typedef enum {
@@ -106,6 +107,28 @@ typedef enum {
     FMP_CHUNK_IGNORE,
 } fmp_chunk_type_t;
 
+typedef enum {
+    FMP_VALUE_TEXT,
+    FMP_VALUE_INTEGER,
+    FMP_VALUE_REAL,
+    FMP_VALUE_DATE,
+    FMP_VALUE_TIME,
+    FMP_VALUE_TIMESTAMP
+} fmp_value_type_t;
+
+typedef struct fmp_value_s {
+    fmp_value_type_t type;
+    int64_t integer;
+    double real;    /* Also set for FMP_VALUE_INTEGER */
+    int year;
+    int month;
+    int day;
+    int hour;
+    int minute;
+    int second;
+    int usec;
+} fmp_value_t;
+
 typedef struct fmp_column_s {
     int index;
     fmp_column_type_e type;
@@ -131,21 +154,98 @@ typedef struct fmp_table_array_s {
 
 typedef struct fmp_metadata_s {
     fmp_table_array_t *tables;
-    fmp_column_array_t **columns; /* Array of column arrays, indexed by table index */
+    fmp_column_array_t **columns; /* Array of column arrays, parallel to tables->tables */
     size_t columns_capacity;
 } fmp_metadata_t;
 
+typedef struct fmp_fingerprint_s {
+    int index;          /* Matches fmp_table_t.index */
+    size_t num_blocks;  /* Blocks holding data for this table */
+    uint64_t hash;
+} fmp_fingerprint_t;
+
+typedef struct fmp_fingerprint_array_s {
+    size_t count;
+    fmp_fingerprint_t *fingerprints;
+} fmp_fingerprint_array_t;
+
+typedef struct fmp_block_hash_s {
+    int id;             /* Block number, as printed by fmpdump */
+    uint64_t hash;
+} fmp_block_hash_t;
+
+typedef struct fmp_block_hash_array_s {
+    size_t count;
+    fmp_block_hash_t *blocks; /* In chain order */
+} fmp_block_hash_array_t;
+
+typedef struct fmp_block_range_s {
+    int block_id;
+    int table_index;    /* 0 = file-level metadata */
+    int first_row;      /* 0 if the block holds no records of this table */
+    int last_row;
+} fmp_block_range_t;
+
+typedef struct fmp_block_range_array_s {
+    size_t count;
+    fmp_block_range_t *ranges;
+} fmp_block_range_array_t;
+
+/* Values a typed Arrow export wrote as null because they didn't parse as
+ * their column's type; only columns with any are listed */
+typedef struct fmp_unparsed_column_s {
+    int table_index;
+    int column_index;
+    size_t count;
+} fmp_unparsed_column_t;
+
+typedef struct fmp_unparsed_array_s {
+    size_t count;
+    fmp_unparsed_column_t *columns;
+} fmp_unparsed_array_t;
+
+typedef struct fmp_table_profile_s {
+    int index;          /* Matches fmp_table_t.index; 0 = file-level metadata */
+    size_t num_blocks;  /* Blocks holding chunks of this table */
+    size_t num_chunks;
+    size_t data_bytes;  /* Keys and values, not counting chunk headers */
+} fmp_table_profile_t;
+
+/* Block and chunk makeup of the block chain, from fmp_profile_blocks */
+typedef struct fmp_profile_s {
+    size_t file_blocks;         /* As recorded in the index block */
+    size_t chain_blocks;        /* Reached by following the chain */
+    size_t unreached_blocks;    /* Neither chained nor the header block */
+    size_t deleted_blocks;      /* Blocks in the file with the deleted flag set */
+    size_t payload_bytes;       /* Used by chunks, not counting v7 padding */
+    size_t payload_capacity;
+    size_t fill_blocks[10];     /* Blocks by payload fill, in tenths */
+    size_t level_blocks[256];   /* Blocks by level byte */
+    size_t type_chunks[FMP_CHUNK_IGNORE + 1];
+    size_t opcode_chunks[256];  /* Chunks by leading byte */
+    size_t opcode_bytes[256];
+    size_t num_tables;
+    fmp_table_profile_t *tables; /* In index order */
+} fmp_profile_t;
+
 typedef struct fmp_data_s {
     size_t len;
     uint8_t *bytes;
 } fmp_data_t;
 
+typedef struct fmp_path_table_s fmp_path_table_t;
+
 typedef struct fmp_chunk_s {
     struct fmp_chunk_s *next;
     fmp_data_t ref_long;
     fmp_data_t data;
     fmp_chunk_type_t type;
+    /* Interned snapshot. Tables and their sections (the first two levels,
+     * or one before v7) stay valid for the scan; deeper paths, such as a
+     * record's, only until they are popped. Copy them to keep them longer. */
     fmp_data_t **path;
+    uint32_t path_id;  /* Never reused within a scan; a path popped and
+                          pushed again gets a new id */
     uint8_t path_level;
     uint8_t version_num;
     uint8_t code;
@@ -166,6 +266,41 @@ typedef struct fmp_block_s {
     uint8_t payload[];
 } fmp_block_t;
 
+/* Counters kept while stats are enabled with fmp_enable_scan_stats */
+typedef struct fmp_scan_stats_s {
+    uint64_t scans;             /* Walks of the block chain */
+    uint64_t blocks_read;       /* Blocks visited in the chain */
+    uint64_t blocks_decoded;    /* Blocks split into chunks */
+    uint64_t blocks_loaded;     /* Blocks built from mmap'd sectors... */
+    uint64_t blocks_cached;     /* ...and kept for later scans */
+    uint64_t blocks_evicted;    /* ...and freed after use */
+    uint64_t chunks[FMP_CHUNK_IGNORE + 1]; /* Chunks handled, by type */
+    uint64_t values_converted;
+    uint64_t bytes_converted;   /* Input bytes of converted values */
+    uint64_t bytes_unmasked;
+    uint64_t long_strings;      /* Values assembled from several chunks */
+    uint64_t long_string_bytes;
+    double read_seconds;        /* Loading blocks */
+    double decode_seconds;      /* Splitting blocks into chunks */
+    double handle_seconds;      /* Handling chunks, conversion included */
+    double convert_seconds;
+} fmp_scan_stats_t;
+
+typedef enum {
+    FMP_LOG_NONE,
+    FMP_LOG_ERROR,
+    FMP_LOG_WARNING,
+    FMP_LOG_INFO,
+    FMP_LOG_DEBUG
+} fmp_log_level_t;
+
+/* Receives library diagnostics, without a trailing newline */
+typedef void (*fmp_log_handler)(fmp_log_level_t level, const char *message, void *ctx);
+
+/* Called every interval blocks of a scan; return FMP_HANDLER_ABORT to cancel it */
+typedef fmp_handler_status_t (*fmp_progress_handler)(size_t blocks_done, size_t blocks_total,
+        size_t bytes_done, void *ctx);
+
 typedef struct fmp_file_s {
     FILE *stream;
     char version_string[10];
@@ -182,20 +317,47 @@ typedef struct fmp_file_s {
     size_t  payload_len_offset;
     iconv_t converter;
     unsigned char    xor_mask;
-    size_t path_level;
-    size_t path_capacity;
-    fmp_data_t **path;
+    fmp_path_table_t *paths;
+    uint32_t path_id;
     size_t num_blocks;
     /* mmap support for large files */
     void *mmap_base;
     int mmap_fd;
     int use_mmap;
     size_t blocks_allocated;  /* Track how many block pointers we've allocated */
+    fmp_scan_stats_t *stats;  /* NULL unless enabled */
+    fmp_progress_handler progress;
+    size_t progress_interval;
+    void *progress_ctx;
     fmp_block_t *blocks[];
 } fmp_file_t;
 
+/* Options for the Arrow export; see fmp_arrow.h for the structures */
+enum {
+    FMP_ARROW_DICTIONARY = 1,   /* Dictionary-encode text columns */
+    FMP_ARROW_TEXT_VALUES = 2,  /* Every column as text, as entered (the default) */
+    FMP_ARROW_TYPED_VALUES = 4  /* Number, date and time columns as Arrow types;
+                                   values that don't parse become null */
+};
+
+struct ArrowSchema;
+struct ArrowArray;
+struct ArrowArrayStream;
+
+/* Filters for fmp_dump_file_with_options; zero means no filter */
+typedef struct fmp_dump_options_s {
+    FILE *stream;               /* Defaults to stdout */
+    int first_block;            /* Block ids to dump, inclusive */
+    int last_block;
+    const uint64_t *path_prefix; /* Only chunks at or below this path */
+    size_t path_prefix_len;
+    unsigned int chunk_types;   /* Mask of (1 << fmp_chunk_type_t) */
+} fmp_dump_options_t;
+
 typedef fmp_handler_status_t (*fmp_value_handler)(int row, fmp_column_t *column, const char *value, void *ctx);
 typedef fmp_handler_status_t (*fmp_table_value_handler)(int table_index, int row, fmp_column_t *column, const char *value, void *ctx);
+/* The handler takes ownership of the batch and must release it */
+typedef fmp_handler_status_t (*fmp_arrow_batch_handler)(int table_index, struct ArrowArray *batch, void *ctx);
 
 fmp_file_t *fmp_open_file(const char *path, fmp_error_t *errorCode);
 fmp_file_t *fmp_open_buffer(const void *buffer, size_t len, fmp_error_t *errorCode);
@@ -205,12 +367,50 @@ fmp_column_array_t *fmp_list_columns(fmp_file_t *file, fmp_table_t *table, fmp_e
 fmp_metadata_t *fmp_discover_all_metadata(fmp_file_t *file, fmp_error_t *errorCode);
 fmp_error_t fmp_read_values(fmp_file_t *file, fmp_table_t *table, fmp_value_handler handle_value, void *ctx);
 fmp_error_t fmp_read_all_values(fmp_file_t *file, fmp_metadata_t *metadata, fmp_table_value_handler handle_value, void *ctx);
+/* fmp_read_arrow reads the whole table into batches before it returns, so
+ * the stream holds the table in memory; fmp_read_all_arrow hands each batch
+ * to the handler as soon as it fills. An error while reading the table comes
+ * from the stream's get_next, after the batches read before it, with a
+ * message from get_last_error. */
+fmp_error_t fmp_read_arrow(fmp_file_t *file, fmp_table_t *table, size_t batch_rows, int flags,
+        struct ArrowArrayStream *out);
+/* If unparsed is non-NULL, it gets the columns that had values nulled */
+fmp_error_t fmp_read_all_arrow(fmp_file_t *file, fmp_metadata_t *metadata, size_t batch_rows, int flags,
+        fmp_arrow_batch_handler handle_batch, void *ctx, fmp_unparsed_array_t **unparsed);
+fmp_error_t fmp_arrow_schema(fmp_column_array_t *columns, int flags, struct ArrowSchema *out);
 fmp_error_t fmp_dump_file(fmp_file_t *file);
+fmp_error_t fmp_dump_file_with_options(fmp_file_t *file, const fmp_dump_options_t *options);
+fmp_fingerprint_array_t *fmp_fingerprint_tables(fmp_file_t *file, fmp_error_t *errorCode);
+fmp_block_hash_array_t *fmp_hash_blocks(fmp_file_t *file, fmp_fingerprint_array_t **tables, fmp_error_t *errorCode);
+fmp_block_range_array_t *fmp_block_ranges(fmp_file_t *file, const int *block_ids, size_t num_block_ids,
+        fmp_error_t *errorCode);
+fmp_profile_t *fmp_profile_blocks(fmp_file_t *file, fmp_error_t *errorCode);
+
+fmp_value_type_t fmp_parse_value(fmp_column_type_e type, const char *utf8_value, fmp_value_t *value);
+size_t fmp_format_value(const fmp_value_t *value, char *dst, size_t dst_len);
+
+void fmp_enable_scan_stats(fmp_file_t *file, int enable);
+void fmp_get_scan_stats(fmp_file_t *file, fmp_scan_stats_t *stats);
+void fmp_set_progress_handler(fmp_file_t *file, fmp_progress_handler handle_progress,
+        size_t interval, void *ctx);
+
+/* Process-wide: a NULL handler writes to stderr; messages above the level
+ * (FMP_LOG_WARNING by default) are dropped, as are more than
+ * messages_per_second from any one place in the library (0 for no limit),
+ * which are counted and summarized by the end of the scan */
+void fmp_set_log_handler(fmp_log_handler handle_log, void *ctx);
+void fmp_set_log_level(fmp_log_level_t level);
+void fmp_set_log_rate_limit(int messages_per_second);
 
 void fmp_close_file(fmp_file_t *file);
 void fmp_free_tables(fmp_table_array_t *array);
 void fmp_free_columns(fmp_column_array_t *array);
 void fmp_free_metadata(fmp_metadata_t *metadata);
+void fmp_free_fingerprints(fmp_fingerprint_array_t *array);
+void fmp_free_block_hashes(fmp_block_hash_array_t *array);
+void fmp_free_block_ranges(fmp_block_range_array_t *array);
+void fmp_free_unparsed(fmp_unparsed_array_t *array);
+void fmp_free_profile(fmp_profile_t *profile);
 
 #ifdef __cplusplus
 }
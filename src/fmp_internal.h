@@ -4,20 +4,53 @@ typedef enum {
     CHUNK_ABORT
 } chunk_status_t;
 
+typedef struct fmp_path_node_s {
+    uint32_t id;                /* Slot in the table; reused once freed */
+    uint32_t serial;            /* Never reused within a scan */
+    uint32_t parent;
+    uint32_t level;
+    uint32_t hash;
+    uint32_t children;          /* Interned paths one level down */
+    uint32_t size;              /* Bytes allocated for the node */
+    fmp_data_t value;
+    fmp_data_t **path;
+    struct fmp_path_node_s *next_free;
+} fmp_path_node_t;
+
 typedef int (*block_handler)(fmp_block_t *block, void *ctx);
 typedef chunk_status_t (*chunk_handler)(fmp_chunk_t *chunk, void *ctx);
 
+fmp_path_table_t *path_table_new(void);
+int path_table_reset(fmp_path_table_t *table);
+void path_table_free(fmp_path_table_t *table);
+fmp_path_node_t *path_table_node(fmp_path_table_t *table, uint32_t id);
+int path_table_push(fmp_path_table_t *table, uint32_t parent_id, const fmp_data_t *value, uint32_t *id);
+/* Frees id and its ancestors below stop_id that are deeper than
+ * shared_levels and have no children left */
+void path_table_release(fmp_path_table_t *table, uint32_t id, uint32_t stop_id, uint32_t shared_levels);
+
 uint64_t path_value(fmp_chunk_t *chunk, fmp_data_t *path);
 void debug(const char *fmt, ...);
+void log_message(fmp_log_level_t level, const char *fmt, ...);
+void log_flush_suppressed(void);
 fmp_error_t process_blocks(fmp_file_t *file,
         block_handler handle_block,
         chunk_handler handle_chunk,
         void *user_ctx);
+fmp_error_t process_selected_blocks(fmp_file_t *file,
+        block_handler select_block,
+        block_handler handle_block,
+        chunk_handler handle_chunk,
+        void *user_ctx);
 fmp_error_t process_block(fmp_file_t *file, fmp_block_t *block);
 fmp_block_t *new_block_from_sector(fmp_file_t *file, const uint8_t *sector, fmp_error_t *error);
 
 void convert(iconv_t converter, uint8_t xor_mask,
         char *dst, size_t dst_len, uint8_t *src, size_t src_len);
+void convert_value(fmp_file_t *file,
+        char *dst, size_t dst_len, uint8_t *src, size_t src_len);
+void convert_long_string(fmp_file_t *file,
+        char *dst, size_t dst_len, uint8_t *src, size_t src_len);
 size_t convert_scsu_to_utf8(
         char **restrict inbuf, size_t *restrict inbytesleft,
         char **restrict outbuf, size_t *restrict outbytesleft);
@@ -25,3 +58,7 @@ size_t convert_scsu_to_utf8(
 int table_path_match_start1(fmp_chunk_t *chunk, int depth, int val);
 int table_path_match_start2(fmp_chunk_t *chunk, int depth, int val1, int val2);
 int path_is(fmp_chunk_t *chunk, fmp_data_t *path, uint64_t value);
+fmp_column_type_e column_type_v7(uint8_t code);
+
+uint64_t hash64(const uint8_t *p, size_t len, uint64_t seed);
+uint64_t hash64_combine(uint64_t h, uint64_t value);
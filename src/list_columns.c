@@ -33,7 +33,7 @@ typedef struct fmp_list_columns_ctx_s {
     fmp_column_array_t *array;
 } fmp_list_columns_ctx_t;
 
-static chunk_status_t handle_column(size_t column_index, fmp_data_t *name, fmp_list_columns_ctx_t *ctx) {
+static fmp_column_t *column_at(size_t column_index, fmp_list_columns_ctx_t *ctx) {
     fmp_column_array_t *array = ctx->array;
     if (column_index > array->count) {
         size_t old_num_columns = array->count;
@@ -41,8 +41,12 @@ static chunk_status_t handle_column(size_t column_index, fmp_data_t *name, fmp_l
         array->columns = realloc(array->columns, array->count * sizeof(fmp_column_t));
         memset(&array->columns[old_num_columns], 0, (column_index - old_num_columns) * sizeof(fmp_column_t));
     }
-    fmp_column_t *current_column = array->columns + column_index - 1;
-    convert(ctx->file->converter, ctx->file->xor_mask,
+    return array->columns + column_index - 1;
+}
+
+static chunk_status_t handle_column(size_t column_index, fmp_data_t *name, fmp_list_columns_ctx_t *ctx) {
+    fmp_column_t *current_column = column_at(column_index, ctx);
+    convert_value(ctx->file,
             current_column->utf8_name, sizeof(current_column->utf8_name),
             name->bytes, name->len);
     current_column->index = column_index;
@@ -91,6 +95,10 @@ static chunk_status_t handle_chunk_list_columns_v7(fmp_chunk_t *chunk, fmp_list_
         size_t column_index = path_value(chunk, column_path);
         if (chunk->ref_simple == 16) {
             handle_column(column_index, &chunk->data, ctx);
+        } else if (chunk->ref_simple == 2 && chunk->data.len >= 2 && column_index > 0) {
+            /* Storage options come before the name in v7 */
+            fmp_column_t *current_column = column_at(column_index, ctx);
+            current_column->type = column_type_v7(chunk->data.bytes[1]);
         }
     }
     return CHUNK_NEXT;
@@ -0,0 +1,173 @@
+/* FMP Tools - A library for reading FileMaker Pro databases
+ * Copyright (c) 2020 Evan Miller (except where otherwise noted)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/* Diagnostics from the library go through one process-wide sink so that
+ * programs embedding it decide what reaches stderr. Each call site, keyed by
+ * its format string, is rate limited on its own; messages still suppressed
+ * when a scan ends are summarized then. Scans on several threads share the
+ * rate-limit state under a lock; the settings are not synchronized, so
+ * change them before opening files on other threads. */
+
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "fmp.h"
+#include "fmp_internal.h"
+
+/* Comfortably more than there are log_message calls in the library; sites
+ * past this many aren't rate limited */
+#define LOG_SITES 64
+
+typedef struct log_site_s {
+    const char *fmt;
+    fmp_log_level_t level;
+    time_t window;
+    int count;
+    int suppressed;
+} log_site_t;
+
+static fmp_log_handler log_handler;
+static void *log_ctx;
+static fmp_log_level_t log_level = FMP_LOG_WARNING;
+static int log_rate_limit = 10;
+static log_site_t log_sites[LOG_SITES];
+static pthread_mutex_t log_sites_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static const char *level_names[] = { "", "Error", "Warning", "Info", "Debug" };
+
+void fmp_set_log_handler(fmp_log_handler handle_log, void *ctx) {
+    log_handler = handle_log;
+    log_ctx = ctx;
+}
+
+void fmp_set_log_level(fmp_log_level_t level) {
+    log_level = level;
+}
+
+void fmp_set_log_rate_limit(int messages_per_second) {
+    log_rate_limit = messages_per_second;
+}
+
+/* The site's slot, claiming a free one the first time; call with the lock
+ * held */
+static log_site_t *log_site(const char *fmt) {
+    size_t slot = ((uintptr_t)fmt >> 3) % LOG_SITES;
+    for (size_t i = 0; i < LOG_SITES; i++, slot = (slot + 1) % LOG_SITES) {
+        if (log_sites[slot].fmt == fmt)
+            return &log_sites[slot];
+        if (!log_sites[slot].fmt) {
+            log_sites[slot].fmt = fmt;
+            return &log_sites[slot];
+        }
+    }
+    return NULL;
+}
+
+/* Returns how many messages from this site were dropped since the last one
+ * that got through, or -1 if this one should be dropped too */
+static int log_site_admit(fmp_log_level_t level, const char *fmt) {
+    time_t now = time(NULL);
+    int suppressed = -1;
+
+    pthread_mutex_lock(&log_sites_lock);
+    log_site_t *site = log_site(fmt);
+    if (!site) {
+        pthread_mutex_unlock(&log_sites_lock);
+        return 0;
+    }
+    site->level = level;
+    if (site->window != now) {
+        site->window = now;
+        site->count = 0;
+    }
+    if (++site->count > log_rate_limit) {
+        site->suppressed++;
+    } else {
+        suppressed = site->suppressed;
+        site->suppressed = 0;
+    }
+    pthread_mutex_unlock(&log_sites_lock);
+    return suppressed;
+}
+
+static void log_emit(fmp_log_level_t level, const char *message) {
+    if (log_handler) {
+        log_handler(level, message, log_ctx);
+    } else {
+        fprintf(stderr, "%s: %s\n", level_names[level], message);
+    }
+}
+
+/* Reports the messages dropped since each site's last one got through */
+void log_flush_suppressed(void) {
+    struct {
+        const char *fmt;
+        fmp_log_level_t level;
+        int suppressed;
+    } pending[LOG_SITES];
+    size_t num_pending = 0;
+
+    pthread_mutex_lock(&log_sites_lock);
+    for (size_t i = 0; i < LOG_SITES; i++) {
+        if (!log_sites[i].suppressed)
+            continue;
+        pending[num_pending].fmt = log_sites[i].fmt;
+        pending[num_pending].level = log_sites[i].level;
+        pending[num_pending].suppressed = log_sites[i].suppressed;
+        num_pending++;
+        log_sites[i].suppressed = 0;
+    }
+    pthread_mutex_unlock(&log_sites_lock);
+
+    for (size_t i = 0; i < num_pending; i++) {
+        char message[512];
+        snprintf(message, sizeof(message), "%d more messages like \"%s\" were suppressed",
+                pending[i].suppressed, pending[i].fmt);
+        log_emit(pending[i].level, message);
+    }
+}
+
+void log_message(fmp_log_level_t level, const char *fmt, ...) {
+    if (level > log_level || level <= FMP_LOG_NONE)
+        return;
+
+    int suppressed = log_rate_limit > 0 ? log_site_admit(level, fmt) : 0;
+    if (suppressed < 0)
+        return;
+
+    char message[512];
+    va_list argp;
+    va_start(argp, fmt);
+    int len = vsnprintf(message, sizeof(message), fmt, argp);
+    va_end(argp);
+    if (len < 0)
+        return;
+    if (suppressed && len < sizeof(message)) {
+        snprintf(message + len, sizeof(message) - len,
+                " (%d similar messages suppressed)", suppressed);
+    }
+
+    log_emit(level, message);
+}
@@ -0,0 +1,290 @@
+/* FMP Tools - A library for reading FileMaker Pro databases
+ * Copyright (c) 2020 Evan Miller (except where otherwise noted)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/* Interned path table. Every distinct path seen during a scan is stored once
+ * and identified by a small integer; id 0 is the empty (root) path. A node
+ * owns a copy of its last component and a snapshot of the full path, so a
+ * chunk's path stays valid after the parser has moved on, even if the
+ * underlying block has been freed.
+ *
+ * Paths at or above the shared level (tables and their sections) live for
+ * the whole scan. Deeper nodes, one per record and below, are freed once
+ * they are popped and have no children left, so memory stays proportional
+ * to the nesting depth rather than the number of records. Their slots and
+ * memory are reused, so such a snapshot is only valid until it is popped.
+ * Chunks are identified by the node's serial instead, which is never
+ * handed out twice in a scan, so an id can't come to name another path. */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "fmp.h"
+#include "fmp_internal.h"
+
+/* Handlers index the first few path components without checking the depth,
+ * so short paths are padded out with NULLs */
+#define PATH_MIN_SLOTS 4
+#define PATH_SLAB_SIZE 65536
+/* Freed nodes are kept for reuse by size, in 8-byte steps up to this size */
+#define PATH_FREE_CLASSES 64
+
+typedef struct path_slab_s {
+    struct path_slab_s *next;
+    size_t used;
+    size_t size;
+    uint8_t data[];
+} path_slab_t;
+
+struct fmp_path_table_s {
+    size_t count;       /* Ids handed out, live or free */
+    size_t live;
+    uint32_t next_serial;
+    size_t capacity;
+    fmp_path_node_t **nodes;
+    uint32_t *slots; /* Open-addressed hash of node id + 1; 0 = empty */
+    size_t num_slots;
+    uint32_t *free_ids;
+    size_t num_free_ids;
+    size_t free_ids_capacity;
+    fmp_path_node_t *free_nodes[PATH_FREE_CLASSES];
+    path_slab_t *slab;
+};
+
+static size_t node_size(size_t level, size_t len) {
+    size_t slots = level < PATH_MIN_SLOTS ? PATH_MIN_SLOTS : level;
+    return (sizeof(fmp_path_node_t) + slots * sizeof(fmp_data_t *) + len + 7) & ~(size_t)7;
+}
+
+static void *path_alloc(fmp_path_table_t *table, size_t len) {
+    size_t size_class = len / 8;
+    if (size_class < PATH_FREE_CLASSES && table->free_nodes[size_class]) {
+        fmp_path_node_t *node = table->free_nodes[size_class];
+        table->free_nodes[size_class] = node->next_free;
+        return node;
+    }
+    path_slab_t *slab = table->slab;
+    if (!slab || slab->used + len > slab->size) {
+        size_t size = len > PATH_SLAB_SIZE ? len : PATH_SLAB_SIZE;
+        if (!(slab = malloc(sizeof(path_slab_t) + size)))
+            return NULL;
+        slab->next = table->slab;
+        slab->used = 0;
+        slab->size = size;
+        table->slab = slab;
+    }
+    void *ptr = &slab->data[slab->used];
+    slab->used += len;
+    return ptr;
+}
+
+static uint32_t path_hash(uint32_t parent, const uint8_t *bytes, size_t len) {
+    uint32_t h = 2166136261u ^ parent;
+    h *= 16777619u;
+    for (size_t i=0; i<len; i++) {
+        h ^= bytes[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static fmp_path_node_t *new_node(fmp_path_table_t *table, fmp_path_node_t *parent,
+        const uint8_t *bytes, size_t len, uint32_t hash) {
+    size_t level = parent ? parent->level + 1 : 0;
+    size_t slots = level < PATH_MIN_SLOTS ? PATH_MIN_SLOTS : level;
+
+    if (!table->num_free_ids && table->count == table->capacity) {
+        size_t capacity = table->capacity ? 2 * table->capacity : 1024;
+        fmp_path_node_t **nodes = realloc(table->nodes, capacity * sizeof(fmp_path_node_t *));
+        if (!nodes)
+            return NULL;
+        table->nodes = nodes;
+        table->capacity = capacity;
+    }
+    size_t size = node_size(level, len);
+    fmp_path_node_t *node = path_alloc(table, size);
+    if (!node)
+        return NULL;
+
+    node->id = table->num_free_ids ? table->free_ids[--table->num_free_ids] : table->count++;
+    node->serial = table->next_serial++;
+    node->parent = parent ? parent->id : 0;
+    node->level = level;
+    node->hash = hash;
+    node->children = 0;
+    node->size = size;
+    node->next_free = NULL;
+    node->path = (fmp_data_t **)&node[1];
+    node->value.len = len;
+    node->value.bytes = (uint8_t *)&node->path[slots];
+    if (len)
+        memcpy(node->value.bytes, bytes, len);
+    memset(node->path, 0, slots * sizeof(fmp_data_t *));
+    if (parent) {
+        memcpy(node->path, parent->path, parent->level * sizeof(fmp_data_t *));
+        node->path[level-1] = &node->value;
+        parent->children++;
+    }
+
+    table->nodes[node->id] = node;
+    table->live++;
+    return node;
+}
+
+static int rehash(fmp_path_table_t *table, size_t num_slots) {
+    uint32_t *slots = calloc(num_slots, sizeof(uint32_t));
+    if (!slots)
+        return -1;
+    free(table->slots);
+    table->slots = slots;
+    table->num_slots = num_slots;
+    for (size_t i=1; i<table->count; i++) {
+        if (!table->nodes[i])
+            continue;
+        size_t slot = table->nodes[i]->hash & (num_slots - 1);
+        while (table->slots[slot])
+            slot = (slot + 1) & (num_slots - 1);
+        table->slots[slot] = i + 1;
+    }
+    return 0;
+}
+
+/* Takes the node out of the hash, shifting back any entries that probed
+ * past it so lookups don't stop at the hole */
+static void unhash(fmp_path_table_t *table, fmp_path_node_t *node) {
+    size_t mask = table->num_slots - 1;
+    size_t hole = node->hash & mask;
+    while (table->slots[hole] != node->id + 1)
+        hole = (hole + 1) & mask;
+    for (size_t slot = (hole + 1) & mask; table->slots[slot]; slot = (slot + 1) & mask) {
+        size_t home = table->nodes[table->slots[slot] - 1]->hash & mask;
+        if (((slot - home) & mask) >= ((slot - hole) & mask)) {
+            table->slots[hole] = table->slots[slot];
+            hole = slot;
+        }
+    }
+    table->slots[hole] = 0;
+}
+
+static int free_node(fmp_path_table_t *table, fmp_path_node_t *node) {
+    if (table->num_free_ids == table->free_ids_capacity) {
+        size_t capacity = table->free_ids_capacity ? 2 * table->free_ids_capacity : 256;
+        uint32_t *free_ids = realloc(table->free_ids, capacity * sizeof(uint32_t));
+        if (!free_ids)
+            return -1;
+        table->free_ids = free_ids;
+        table->free_ids_capacity = capacity;
+    }
+    unhash(table, node);
+    table->nodes[node->parent]->children--;
+    table->nodes[node->id] = NULL;
+    table->free_ids[table->num_free_ids++] = node->id;
+    table->live--;
+    size_t size_class = node->size / 8;
+    if (size_class < PATH_FREE_CLASSES) {
+        node->next_free = table->free_nodes[size_class];
+        table->free_nodes[size_class] = node;
+    }
+    return 0;
+}
+
+fmp_path_table_t *path_table_new(void) {
+    fmp_path_table_t *table = calloc(1, sizeof(fmp_path_table_t));
+    if (table && path_table_reset(table) != 0) {
+        path_table_free(table);
+        return NULL;
+    }
+    return table;
+}
+
+int path_table_reset(fmp_path_table_t *table) {
+    while (table->slab && table->slab->next) {
+        path_slab_t *next = table->slab->next;
+        free(table->slab);
+        table->slab = next;
+    }
+    if (table->slab)
+        table->slab->used = 0;
+    memset(table->free_nodes, 0, sizeof(table->free_nodes));
+    table->count = 0;
+    table->live = 0;
+    table->next_serial = 0;
+    table->num_free_ids = 0;
+    if (!new_node(table, NULL, NULL, 0, 0))
+        return -1;
+    return rehash(table, 1024);
+}
+
+void path_table_free(fmp_path_table_t *table) {
+    if (!table)
+        return;
+    while (table->slab) {
+        path_slab_t *next = table->slab->next;
+        free(table->slab);
+        table->slab = next;
+    }
+    free(table->nodes);
+    free(table->slots);
+    free(table->free_ids);
+    free(table);
+}
+
+fmp_path_node_t *path_table_node(fmp_path_table_t *table, uint32_t id) {
+    if (id >= table->count)
+        return NULL;
+    return table->nodes[id];
+}
+
+int path_table_push(fmp_path_table_t *table, uint32_t parent_id, const fmp_data_t *value, uint32_t *id) {
+    fmp_path_node_t *parent = table->nodes[parent_id];
+    uint32_t hash = path_hash(parent_id, value->bytes, value->len);
+    size_t slot = hash & (table->num_slots - 1);
+    while (table->slots[slot]) {
+        fmp_path_node_t *node = table->nodes[table->slots[slot] - 1];
+        if (node->hash == hash && node->parent == parent_id && node->level == parent->level + 1 &&
+                node->value.len == value->len && memcmp(node->value.bytes, value->bytes, value->len) == 0) {
+            *id = node->id;
+            return 0;
+        }
+        slot = (slot + 1) & (table->num_slots - 1);
+    }
+    fmp_path_node_t *node = new_node(table, parent, value->bytes, value->len, hash);
+    if (!node)
+        return -1;
+    table->slots[slot] = node->id + 1;
+    if (2 * table->live > table->num_slots && rehash(table, 2 * table->num_slots) != 0)
+        return -1;
+    *id = node->id;
+    return 0;
+}
+
+void path_table_release(fmp_path_table_t *table, uint32_t id, uint32_t stop_id, uint32_t shared_levels) {
+    while (id != stop_id) {
+        fmp_path_node_t *node = table->nodes[id];
+        if (node->level <= shared_levels || node->children)
+            break;
+        id = node->parent;
+        /* Without room to recycle the id, the node just stays interned */
+        if (free_node(table, node) != 0)
+            break;
+    }
+}
@@ -0,0 +1,181 @@
+/* FMP Tools - A library for reading FileMaker Pro databases
+ * Copyright (c) 2020 Evan Miller (except where otherwise noted)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/* A structural profile of the block chain for capacity planning: block
+ * headers, chunk opcodes and lengths, and which table each chunk belongs
+ * to. No values are converted. */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "fmp.h"
+#include "fmp_internal.h"
+
+typedef struct fmp_profile_ctx_s {
+    fmp_file_t *file;
+    fmp_profile_t *profile;
+    size_t tables_capacity;
+    size_t block_serial;
+    size_t *last_block_serial;  /* By table index */
+    fmp_data_t *last_table_path;
+    int table_index;
+} fmp_profile_ctx_t;
+
+static fmp_table_profile_t *table_profile(fmp_profile_ctx_t *ctx, size_t table_index) {
+    if (table_index >= ctx->tables_capacity) {
+        size_t old_capacity = ctx->tables_capacity;
+        ctx->tables_capacity = 2 * table_index + 8;
+        ctx->profile->tables = realloc(ctx->profile->tables,
+                ctx->tables_capacity * sizeof(fmp_table_profile_t));
+        ctx->last_block_serial = realloc(ctx->last_block_serial,
+                ctx->tables_capacity * sizeof(size_t));
+        memset(&ctx->profile->tables[old_capacity], 0,
+                (ctx->tables_capacity - old_capacity) * sizeof(fmp_table_profile_t));
+        memset(&ctx->last_block_serial[old_capacity], 0,
+                (ctx->tables_capacity - old_capacity) * sizeof(size_t));
+    }
+    fmp_table_profile_t *table = &ctx->profile->tables[table_index];
+    if (ctx->last_block_serial[table_index] != ctx->block_serial) {
+        table->index = table_index;
+        table->num_blocks++;
+        ctx->last_block_serial[table_index] = ctx->block_serial;
+    }
+    return table;
+}
+
+static int handle_block_profile(fmp_block_t *block, void *ctxp) {
+    fmp_profile_ctx_t *ctx = (fmp_profile_ctx_t *)ctxp;
+    fmp_profile_t *profile = ctx->profile;
+    size_t capacity = ctx->file->sector_size - ctx->file->sector_head_len;
+    size_t used = block->payload_len;
+
+    /* v7 headers don't record a length: the payload always fills the
+     * sector, with zeros after the last chunk */
+    if (ctx->file->payload_len_offset == -1) {
+        while (used && block->payload[used-1] == 0)
+            used--;
+    }
+
+    profile->chain_blocks++;
+    profile->level_blocks[block->level & 0xFF]++;
+    profile->payload_bytes += used;
+    profile->payload_capacity += capacity;
+    if (capacity) {
+        size_t tenth = 10 * used / capacity;
+        profile->fill_blocks[tenth < 10 ? tenth : 9]++;
+    }
+
+    ctx->block_serial++;
+    ctx->last_table_path = NULL;
+    /* There's only one table before v7 */
+    ctx->table_index = ctx->file->version_num < 7;
+    return 1;
+}
+
+static chunk_status_t handle_chunk_profile(fmp_chunk_t *chunk, void *ctxp) {
+    fmp_profile_ctx_t *ctx = (fmp_profile_ctx_t *)ctxp;
+    fmp_profile_t *profile = ctx->profile;
+    size_t data_bytes = chunk->data.len + chunk->ref_long.len;
+
+    if (chunk->type <= FMP_CHUNK_IGNORE)
+        profile->type_chunks[chunk->type]++;
+    profile->opcode_chunks[chunk->code]++;
+    profile->opcode_bytes[chunk->code] += data_bytes;
+
+    if (chunk->version_num >= 7) {
+        if (chunk->path_level == 0) {
+            /* A push at the top level names the table it opens */
+            uint64_t table_path = 0;
+            if (chunk->type == FMP_CHUNK_PATH_PUSH && chunk->data.len)
+                table_path = path_value(chunk, &chunk->data);
+            ctx->table_index = table_path > 128 ? table_path - 128 : 0;
+            ctx->last_table_path = NULL;
+        } else if (chunk->path[0] != ctx->last_table_path) {
+            /* Interned paths share their top-level value, so this only
+             * decodes the path when it changes */
+            ctx->last_table_path = chunk->path[0];
+            uint64_t table_path = path_value(chunk, chunk->path[0]);
+            ctx->table_index = table_path > 128 ? table_path - 128 : 0;
+        }
+    }
+
+    fmp_table_profile_t *table = table_profile(ctx, ctx->table_index);
+    table->num_chunks++;
+    table->data_bytes += data_bytes;
+    return CHUNK_NEXT;
+}
+
+/* Deleted blocks are unlinked from the chain, so this looks at every
+ * sector's header instead */
+static size_t count_deleted_blocks(fmp_file_t *file) {
+    size_t deleted = 0;
+    for (size_t i=0; i<file->num_blocks; i++) {
+        if (file->use_mmap) {
+            size_t offset = (i + 1) * file->sector_size;
+            deleted += offset < file->file_size && ((const uint8_t *)file->mmap_base)[offset] != 0;
+        } else {
+            deleted += file->blocks[i] && file->blocks[i]->deleted;
+        }
+    }
+    return deleted;
+}
+
+fmp_profile_t *fmp_profile_blocks(fmp_file_t *file, fmp_error_t *errorCode) {
+    fmp_profile_t *profile = calloc(1, sizeof(fmp_profile_t));
+    fmp_profile_ctx_t ctx = {
+        .file = file,
+        .profile = profile
+    };
+    profile->file_blocks = file->num_blocks;
+    profile->deleted_blocks = count_deleted_blocks(file);
+    fmp_error_t retval = process_blocks(file, handle_block_profile, handle_chunk_profile, &ctx);
+
+    /* Compact to the tables that were seen, in index order */
+    size_t j = 0;
+    for (size_t i=0; i<ctx.tables_capacity; i++) {
+        if (profile->tables[i].num_blocks) {
+            if (i != j)
+                profile->tables[j] = profile->tables[i];
+            j++;
+        }
+    }
+    profile->num_tables = j;
+    if (profile->file_blocks > profile->chain_blocks + 1)
+        profile->unreached_blocks = profile->file_blocks - profile->chain_blocks - 1;
+    free(ctx.last_block_serial);
+
+    if (errorCode)
+        *errorCode = retval;
+    if (retval != FMP_OK) {
+        fmp_free_profile(profile);
+        return NULL;
+    }
+    return profile;
+}
+
+void fmp_free_profile(fmp_profile_t *profile) {
+    if (profile) {
+        free(profile->tables);
+        free(profile);
+    }
+}
@@ -35,6 +35,8 @@ typedef struct table_read_state_s {
     size_t long_string_len;
     size_t long_string_used;
     fmp_column_array_t *columns;
+    fmp_column_t **column_map;   /* Columns by index, with gaps for deleted fields */
+    size_t num_columns;          /* Highest column index */
 } table_read_state_t;
 
 typedef struct fmp_read_all_values_ctx_s {
@@ -44,6 +46,8 @@ typedef struct fmp_read_all_values_ctx_s {
     void *user_ctx;
     table_read_state_t *table_states;  /* Array of states, one per table */
     size_t table_states_capacity;
+    uint32_t cached_path_id;     /* Path of the last chunk looked up... */
+    size_t cached_table_index;   /* ...and the table it maps to (0 = none) */
 } fmp_read_all_values_ctx_t;
 
 static void ensure_table_state(fmp_read_all_values_ctx_t *ctx, size_t table_index) {
@@ -55,10 +59,28 @@ static void ensure_table_state(fmp_read_all_values_ctx_t *ctx, size_t table_inde
         ctx->table_states_capacity = new_capacity;
     }
 
-    if (!ctx->table_states[table_index].columns &&
-        table_index < ctx->metadata->columns_capacity &&
-        ctx->metadata->columns[table_index]) {
-        ctx->table_states[table_index].columns = ctx->metadata->columns[table_index];
+    table_read_state_t *state = &ctx->table_states[table_index];
+    if (state->columns)
+        return;
+
+    /* Column arrays are stored by the table's position, not its index */
+    for (size_t i = 0; i < ctx->metadata->tables->count && i < ctx->metadata->columns_capacity; i++) {
+        if (ctx->metadata->tables->tables[i].index == table_index) {
+            state->columns = ctx->metadata->columns[i];
+            break;
+        }
+    }
+    if (!state->columns)
+        return;
+
+    for (size_t i = 0; i < state->columns->count; i++) {
+        if (state->columns->columns[i].index > state->num_columns)
+            state->num_columns = state->columns->columns[i].index;
+    }
+    state->column_map = calloc(state->num_columns + 1, sizeof(fmp_column_t *));
+    for (size_t i = 0; i < state->columns->count; i++) {
+        fmp_column_t *column = &state->columns->columns[i];
+        state->column_map[column->index] = column;
     }
 }
 
@@ -97,26 +119,18 @@ static chunk_status_t process_value_for_table(fmp_chunk_t *chunk, fmp_read_all_v
         long_string = 1;
         column_index = path_value(chunk, chunk->path[chunk->path_level-1]);
     } else if (path_is_table_data(chunk)) {
-        if (chunk->type == FMP_CHUNK_FIELD_REF_SIMPLE && chunk->ref_simple <= state->columns->count
+        if (chunk->type == FMP_CHUNK_FIELD_REF_SIMPLE && chunk->ref_simple <= state->num_columns
                 && chunk->ref_simple != 252 /* Special metadata value? */) {
             column_index = chunk->ref_simple;
-        } else if (chunk->type == FMP_CHUNK_DATA_SEGMENT && chunk->segment_index <= state->columns->count) {
+        } else if (chunk->type == FMP_CHUNK_DATA_SEGMENT && chunk->segment_index <= state->num_columns) {
             column_index = chunk->segment_index;
         }
     }
 
-    if (column_index == 0 || column_index > state->columns->count)
+    if (column_index == 0 || column_index > state->num_columns)
         return CHUNK_NEXT;
 
-    /* Find the column with this index */
-    column = NULL;
-    for (size_t i = 0; i < state->columns->count; i++) {
-        if (state->columns->columns[i].index == column_index) {
-            column = &state->columns->columns[i];
-            break;
-        }
-    }
-
+    column = state->column_map[column_index];
     if (!column)
         return CHUNK_NEXT;
 
@@ -124,15 +138,9 @@ static chunk_status_t process_value_for_table(fmp_chunk_t *chunk, fmp_read_all_v
     if (column->index != state->last_column && state->long_string_used) {
         if (ctx->handle_value && state->last_column > 0) {
             char utf8_value[state->long_string_used*4+1];
-            fmp_column_t *last_col = NULL;
-            for (size_t i = 0; i < state->columns->count; i++) {
-                if (state->columns->columns[i].index == state->last_column) {
-                    last_col = &state->columns->columns[i];
-                    break;
-                }
-            }
+            fmp_column_t *last_col = state->column_map[state->last_column];
             if (last_col) {
-                convert(ctx->file->converter, ctx->file->xor_mask,
+                convert_long_string(ctx->file,
                         utf8_value, sizeof(utf8_value), state->long_string_buf, state->long_string_used);
                 if (ctx->handle_value(table_index, state->current_row, last_col,
                         utf8_value, ctx->user_ctx) == FMP_HANDLER_ABORT)
@@ -159,7 +167,7 @@ static chunk_status_t process_value_for_table(fmp_chunk_t *chunk, fmp_read_all_v
     } else {
         /* Handle regular value */
         char utf8_value[chunk->data.len*4+1];
-        convert(ctx->file->converter, ctx->file->xor_mask,
+        convert_value(ctx->file,
                 utf8_value, sizeof(utf8_value), chunk->data.bytes, chunk->data.len);
         if (ctx->handle_value) {
             if (ctx->handle_value(table_index, state->current_row, column,
@@ -174,27 +182,36 @@ static chunk_status_t process_value_for_table(fmp_chunk_t *chunk, fmp_read_all_v
     return CHUNK_NEXT;
 }
 
-static chunk_status_t handle_chunk_read_all_values_v7(fmp_chunk_t *chunk, fmp_read_all_values_ctx_t *ctx) {
+static size_t lookup_table_index(fmp_chunk_t *chunk, fmp_read_all_values_ctx_t *ctx) {
     /* Determine which table this chunk belongs to */
     size_t path0 = path_value(chunk, chunk->path[0]);
 
     if (path0 < 128) {
         /* Not table data */
-        return CHUNK_NEXT;
+        return 0;
     }
 
     size_t table_index = path0 - 128;
 
     /* Find the actual table with this index */
-    fmp_table_t *table = NULL;
     for (size_t i = 0; i < ctx->metadata->tables->count; i++) {
-        if (ctx->metadata->tables->tables[i].index == table_index) {
-            table = &ctx->metadata->tables->tables[i];
-            break;
-        }
+        fmp_table_t *table = &ctx->metadata->tables->tables[i];
+        if (table->index == table_index)
+            return table->skip ? 0 : table_index;
     }
+    return 0;
+}
 
-    if (!table || table->skip) {
+static chunk_status_t handle_chunk_read_all_values_v7(fmp_chunk_t *chunk, fmp_read_all_values_ctx_t *ctx) {
+    /* Consecutive chunks usually share a path, so only redo the table
+     * lookup when the path id changes */
+    if (chunk->path_id != ctx->cached_path_id) {
+        ctx->cached_path_id = chunk->path_id;
+        ctx->cached_table_index = lookup_table_index(chunk, ctx);
+    }
+
+    size_t table_index = ctx->cached_table_index;
+    if (!table_index) {
         return CHUNK_NEXT;
     }
 
@@ -208,9 +225,9 @@ static chunk_status_t handle_chunk_read_all_values_v7(fmp_chunk_t *chunk, fmp_re
 }
 
 static chunk_status_t handle_chunk_read_all_values_v3(fmp_chunk_t *chunk, fmp_read_all_values_ctx_t *ctx) {
-    /* For v3-v6, there's only one table at index 1 */
-    if (path_value(chunk, chunk->path[0]) > 3)
-        return CHUNK_NEXT;
+    /* For v3-v6, there's only one table at index 1, with records under [5] */
+    if (path_value(chunk, chunk->path[0]) > 5)
+        return CHUNK_DONE;
 
     ensure_table_state(ctx, 1);
     table_read_state_t *state = &ctx->table_states[1];
@@ -239,7 +256,8 @@ fmp_error_t fmp_read_all_values(fmp_file_t *file, fmp_metadata_t *metadata,
         .handle_value = handle_value,
         .user_ctx = user_ctx,
         .table_states = NULL,
-        .table_states_capacity = 0
+        .table_states_capacity = 0,
+        .cached_path_id = UINT32_MAX
     };
 
     fmp_error_t retval = process_blocks(file, NULL, handle_chunk_read_all_values, &ctx);
@@ -252,16 +270,10 @@ fmp_error_t fmp_read_all_values(fmp_file_t *file, fmp_metadata_t *metadata,
                 if (ctx.table_states[i].long_string_used && ctx.handle_value) {
                     char utf8_value[ctx.table_states[i].long_string_used*4+1];
                     fmp_column_t *last_col = NULL;
-                    if (ctx.table_states[i].columns) {
-                        for (size_t j = 0; j < ctx.table_states[i].columns->count; j++) {
-                            if (ctx.table_states[i].columns->columns[j].index == ctx.table_states[i].last_column) {
-                                last_col = &ctx.table_states[i].columns->columns[j];
-                                break;
-                            }
-                        }
-                    }
+                    if (ctx.table_states[i].column_map)
+                        last_col = ctx.table_states[i].column_map[ctx.table_states[i].last_column];
                     if (last_col) {
-                        convert(file->converter, file->xor_mask,
+                        convert_long_string(file,
                                 utf8_value, sizeof(utf8_value),
                                 ctx.table_states[i].long_string_buf,
                                 ctx.table_states[i].long_string_used);
@@ -271,6 +283,7 @@ fmp_error_t fmp_read_all_values(fmp_file_t *file, fmp_metadata_t *metadata,
                 }
                 free(ctx.table_states[i].long_string_buf);
             }
+            free(ctx.table_states[i].column_map);
         }
         free(ctx.table_states);
     }
@@ -87,7 +87,7 @@ static chunk_status_t process_value(fmp_chunk_t *chunk, fmp_read_values_ctx_t *c
     if (column->index != ctx->last_column && ctx->long_string_used) {
         if (ctx->handle_value) {
             char utf8_value[ctx->long_string_used*4+1];
-            convert(ctx->file->converter, ctx->file->xor_mask,
+            convert_long_string(ctx->file,
                     utf8_value, sizeof(utf8_value), ctx->long_string_buf, ctx->long_string_used);
             if (ctx->handle_value(ctx->current_row, &ctx->columns[ctx->last_column-1],
                     utf8_value, ctx->user_ctx) == FMP_HANDLER_ABORT)
@@ -110,7 +110,7 @@ static chunk_status_t process_value(fmp_chunk_t *chunk, fmp_read_values_ctx_t *c
         ctx->long_string_buf[ctx->long_string_used] = '\0';
     } else if (ctx->handle_value) {
         char utf8_value[chunk->data.len*4+1];
-        convert(ctx->file->converter, ctx->file->xor_mask,
+        convert_value(ctx->file,
                 utf8_value, sizeof(utf8_value), chunk->data.bytes, chunk->data.len);
         if (ctx->handle_value(ctx->current_row, column, utf8_value, ctx->user_ctx) == FMP_HANDLER_ABORT)
             return CHUNK_ABORT;
@@ -136,7 +136,7 @@ static chunk_status_t handle_chunk_read_values_v3(fmp_chunk_t *chunk, fmp_read_v
         }
         fmp_column_t *current_column = ctx->columns + column_index - 1;
         if (chunk->ref_simple == 1) {
-            convert(ctx->file->converter, ctx->file->xor_mask,
+            convert_value(ctx->file,
                     current_column->utf8_name, sizeof(current_column->utf8_name),
                     chunk->data.bytes, chunk->data.len);
             current_column->index = column_index;
@@ -169,7 +169,7 @@ static chunk_status_t handle_chunk_read_values_v7(fmp_chunk_t *chunk, fmp_read_v
         }
         fmp_column_t *current_column = ctx->columns + column_index - 1;
         if (chunk->ref_simple == 16) {
-            convert(ctx->file->converter, ctx->file->xor_mask,
+            convert_value(ctx->file,
                     current_column->utf8_name, sizeof(current_column->utf8_name),
                     chunk->data.bytes, chunk->data.len);
             current_column->index = column_index;
@@ -195,7 +195,7 @@ fmp_error_t fmp_read_values(fmp_file_t *file, fmp_table_t *table, fmp_value_hand
     fmp_error_t retval = process_blocks(file, NULL, handle_chunk_read_values, ctx);
     if (ctx->long_string_used && ctx->handle_value) {
         char utf8_value[ctx->long_string_used*4+1];
-        convert(ctx->file->converter, ctx->file->xor_mask,
+        convert_long_string(ctx->file,
                 utf8_value, sizeof(utf8_value), ctx->long_string_buf, ctx->long_string_used);
         ctx->handle_value(ctx->current_row, &ctx->columns[ctx->last_column-1],
                 utf8_value, user_ctx);
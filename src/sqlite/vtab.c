@@ -0,0 +1,563 @@
+/* FMP Tools - A library for reading FileMaker Pro databases
+ * Copyright (c) 2020 Evan Miller (except where otherwise noted)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/* A loadable SQLite extension that exposes FileMaker tables as virtual
+ * tables:
+ *
+ *   .load ./fmp
+ *   CREATE VIRTUAL TABLE t USING fmp('file.fmp12', 'Table name');
+ *
+ * The rowid is the FileMaker record number. A scan reads the table into
+ * the cursor, keeping only the columns the query uses; rowid constraints
+ * and LIMIT are pushed into the scan so that it stops as soon as it has
+ * passed the requested records. Columns are declared and typed the same
+ * way fmp2sqlite does it. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+#include <sqlite3ext.h>
+SQLITE_EXTENSION_INIT1
+
+#include "../fmp.h"
+
+#define FMP_VTAB_DEFAULT_ROWS 100000
+
+typedef struct fmp_vtab_s {
+    sqlite3_vtab base;
+    fmp_file_t *file;
+    fmp_table_array_t *tables;
+    fmp_table_t *table;
+    fmp_column_array_t *columns;
+    int *positions;         /* Column position by FileMaker column index */
+    size_t num_indexes;
+} fmp_vtab_t;
+
+typedef struct fmp_vtab_value_s {
+    size_t offset;
+    int len;                /* -1 = NULL */
+} fmp_vtab_value_t;
+
+typedef struct fmp_vtab_cursor_s {
+    sqlite3_vtab_cursor base;
+    fmp_vtab_t *vtab;
+
+    /* Set by xFilter */
+    sqlite3_int64 min_row;
+    sqlite3_int64 max_row;
+    sqlite3_int64 stop_after; /* -1 = read every row in range */
+    sqlite3_uint64 columns_used;
+
+    /* The rows read by the last scan, in record order */
+    sqlite3_int64 *rowids;
+    fmp_vtab_value_t *values; /* num_rows x columns->count */
+    size_t num_rows;
+    size_t rows_capacity;
+    char *data;
+    size_t data_len;
+    size_t data_capacity;
+    size_t pos;
+    int error;
+} fmp_vtab_cursor_t;
+
+static const char *declared_type(fmp_column_type_e type) {
+    switch (type) {
+    case FMP_COLUMN_TYPE_NUMBER: return "NUMERIC";
+    case FMP_COLUMN_TYPE_DATE: return "DATE";
+    case FMP_COLUMN_TYPE_TIME: return "TIME";
+    case FMP_COLUMN_TYPE_TIMESTAMP: return "TIMESTAMP";
+    default: return "TEXT";
+    }
+}
+
+/* Arguments arrive as written, possibly quoted */
+static char *dequote(const char *arg) {
+    size_t len = strlen(arg);
+    char quote = arg[0];
+    if (len < 2 || (quote != '\'' && quote != '"') || arg[len-1] != quote)
+        return sqlite3_mprintf("%s", arg);
+    char *out = sqlite3_malloc64(len);
+    if (!out)
+        return NULL;
+    size_t j = 0;
+    for (size_t i = 1; i < len - 1; i++) {
+        out[j++] = arg[i];
+        if (arg[i] == quote && arg[i+1] == quote)
+            i++;
+    }
+    out[j] = '\0';
+    return out;
+}
+
+static void vtab_free(fmp_vtab_t *vtab) {
+    if (vtab->columns)
+        fmp_free_columns(vtab->columns);
+    if (vtab->tables)
+        fmp_free_tables(vtab->tables);
+    if (vtab->file)
+        fmp_close_file(vtab->file);
+    sqlite3_free(vtab->positions);
+    sqlite3_free(vtab);
+}
+
+static int vtab_open_table(fmp_vtab_t *vtab, const char *path, const char *name, char **pzErr) {
+    fmp_error_t error = FMP_OK;
+    if (!(vtab->file = fmp_open_file(path, &error))) {
+        *pzErr = sqlite3_mprintf("fmp: couldn't open %s (error %d)", path, error);
+        return SQLITE_ERROR;
+    }
+    if (!(vtab->tables = fmp_list_tables(vtab->file, &error))) {
+        *pzErr = sqlite3_mprintf("fmp: couldn't list tables in %s (error %d)", path, error);
+        return SQLITE_ERROR;
+    }
+    for (size_t i = 0; i < vtab->tables->count; i++) {
+        if (strcmp(vtab->tables->tables[i].utf8_name, name) == 0)
+            vtab->table = &vtab->tables->tables[i];
+    }
+    if (!vtab->table) {
+        *pzErr = sqlite3_mprintf("fmp: no table named %s in %s", name, path);
+        return SQLITE_ERROR;
+    }
+    if (!(vtab->columns = fmp_list_columns(vtab->file, vtab->table, &error))) {
+        *pzErr = sqlite3_mprintf("fmp: couldn't list columns of %s (error %d)", name, error);
+        return SQLITE_ERROR;
+    }
+
+    for (size_t i = 0; i < vtab->columns->count; i++) {
+        if (vtab->columns->columns[i].index >= vtab->num_indexes)
+            vtab->num_indexes = vtab->columns->columns[i].index + 1;
+    }
+    if (!(vtab->positions = sqlite3_malloc64(vtab->num_indexes * sizeof(int) + 1)))
+        return SQLITE_NOMEM;
+    for (size_t i = 0; i < vtab->num_indexes; i++)
+        vtab->positions[i] = -1;
+    for (size_t i = 0; i < vtab->columns->count; i++)
+        vtab->positions[vtab->columns->columns[i].index] = i;
+    return SQLITE_OK;
+}
+
+static int fmp_vtab_connect(sqlite3 *db, void *aux, int argc, const char *const *argv,
+        sqlite3_vtab **ppVtab, char **pzErr) {
+    if (argc != 5) {
+        *pzErr = sqlite3_mprintf("fmp: usage is USING fmp(file, table)");
+        return SQLITE_ERROR;
+    }
+
+    fmp_vtab_t *vtab = sqlite3_malloc(sizeof(fmp_vtab_t));
+    if (!vtab)
+        return SQLITE_NOMEM;
+    memset(vtab, 0, sizeof(fmp_vtab_t));
+
+    char *path = dequote(argv[3]);
+    char *name = dequote(argv[4]);
+    int rc = (path && name) ? vtab_open_table(vtab, path, name, pzErr) : SQLITE_NOMEM;
+    sqlite3_free(path);
+    sqlite3_free(name);
+
+    if (rc == SQLITE_OK) {
+        sqlite3_str *sql = sqlite3_str_new(db);
+        sqlite3_str_appendall(sql, "CREATE TABLE x(");
+        for (size_t i = 0; i < vtab->columns->count; i++) {
+            fmp_column_t *column = &vtab->columns->columns[i];
+            sqlite3_str_appendf(sql, "%s\"%w\" %s", i ? ", " : "",
+                    column->utf8_name, declared_type(column->type));
+        }
+        sqlite3_str_appendall(sql, ")");
+        char *create = sqlite3_str_finish(sql);
+        rc = create ? sqlite3_declare_vtab(db, create) : SQLITE_NOMEM;
+        sqlite3_free(create);
+    }
+
+    if (rc != SQLITE_OK) {
+        vtab_free(vtab);
+        return rc;
+    }
+    *ppVtab = &vtab->base;
+    return SQLITE_OK;
+}
+
+static int fmp_vtab_disconnect(sqlite3_vtab *pVtab) {
+    vtab_free((fmp_vtab_t *)pVtab);
+    return SQLITE_OK;
+}
+
+/* idxStr lists the pushed-down constraints in argv order, one character
+ * each, followed by ':' and the colUsed mask in hex */
+#define OP_EQ 'e'
+#define OP_GT 'g'
+#define OP_GE 'G'
+#define OP_LT 'l'
+#define OP_LE 'L'
+#define OP_LIMIT 'n'
+#define OP_OFFSET 'o'
+
+static char rowid_op(unsigned char op) {
+    switch (op) {
+    case SQLITE_INDEX_CONSTRAINT_EQ: return OP_EQ;
+    case SQLITE_INDEX_CONSTRAINT_GT: return OP_GT;
+    case SQLITE_INDEX_CONSTRAINT_GE: return OP_GE;
+    case SQLITE_INDEX_CONSTRAINT_LT: return OP_LT;
+    case SQLITE_INDEX_CONSTRAINT_LE: return OP_LE;
+    default: return 0;
+    }
+}
+
+static int fmp_vtab_best_index(sqlite3_vtab *pVtab, sqlite3_index_info *info) {
+    char ops[info->nConstraint + 1];
+    int num_ops = 0;
+    int all_consumed = 1;
+    int eq = 0, range = 0;
+
+    for (int i = 0; i < info->nConstraint; i++) {
+        const struct sqlite3_index_constraint *c = &info->aConstraint[i];
+        char op = c->iColumn == -1 ? rowid_op(c->op) : 0;
+        if (!c->usable || !op) {
+#ifdef SQLITE_INDEX_CONSTRAINT_LIMIT
+            if (c->op == SQLITE_INDEX_CONSTRAINT_LIMIT || c->op == SQLITE_INDEX_CONSTRAINT_OFFSET)
+                continue;
+#endif
+            all_consumed = 0;
+            continue;
+        }
+        ops[num_ops++] = op;
+        info->aConstraintUsage[i].argvIndex = num_ops;
+        info->aConstraintUsage[i].omit = 1;
+        if (op == OP_EQ)
+            eq = 1;
+        else
+            range = 1;
+    }
+
+    /* Records are read in rowid order */
+    if (info->nOrderBy == 1 && info->aOrderBy[0].iColumn == -1 && !info->aOrderBy[0].desc)
+        info->orderByConsumed = 1;
+
+#ifdef SQLITE_INDEX_CONSTRAINT_LIMIT
+    /* Stopping after LIMIT + OFFSET rows is only right if no other
+     * constraint can drop rows after the scan and SQLite does not sort
+     * them afterwards. SQLite applies both. */
+    int unsorted = info->nOrderBy == 0 || info->orderByConsumed;
+    for (int i = 0; all_consumed && unsorted && i < info->nConstraint; i++) {
+        const struct sqlite3_index_constraint *c = &info->aConstraint[i];
+        if (c->usable && (c->op == SQLITE_INDEX_CONSTRAINT_LIMIT || c->op == SQLITE_INDEX_CONSTRAINT_OFFSET)) {
+            ops[num_ops++] = c->op == SQLITE_INDEX_CONSTRAINT_LIMIT ? OP_LIMIT : OP_OFFSET;
+            info->aConstraintUsage[i].argvIndex = num_ops;
+        }
+    }
+#endif
+    ops[num_ops] = '\0';
+
+    if (!(info->idxStr = sqlite3_mprintf("%s:%llx", ops, (unsigned long long)info->colUsed)))
+        return SQLITE_NOMEM;
+    info->needToFreeIdxStr = 1;
+
+    if (eq) {
+        info->estimatedRows = 1;
+        info->idxFlags = SQLITE_INDEX_SCAN_UNIQUE;
+    } else if (range) {
+        info->estimatedRows = FMP_VTAB_DEFAULT_ROWS / 4;
+    } else {
+        info->estimatedRows = FMP_VTAB_DEFAULT_ROWS;
+    }
+    info->estimatedCost = info->estimatedRows;
+    return SQLITE_OK;
+}
+
+static int fmp_vtab_open(sqlite3_vtab *pVtab, sqlite3_vtab_cursor **ppCursor) {
+    fmp_vtab_cursor_t *cursor = sqlite3_malloc(sizeof(fmp_vtab_cursor_t));
+    if (!cursor)
+        return SQLITE_NOMEM;
+    memset(cursor, 0, sizeof(fmp_vtab_cursor_t));
+    cursor->vtab = (fmp_vtab_t *)pVtab;
+    *ppCursor = &cursor->base;
+    return SQLITE_OK;
+}
+
+static int fmp_vtab_close(sqlite3_vtab_cursor *pCursor) {
+    fmp_vtab_cursor_t *cursor = (fmp_vtab_cursor_t *)pCursor;
+    sqlite3_free(cursor->rowids);
+    sqlite3_free(cursor->values);
+    sqlite3_free(cursor->data);
+    sqlite3_free(cursor);
+    return SQLITE_OK;
+}
+
+static int add_row(fmp_vtab_cursor_t *cursor, sqlite3_int64 rowid) {
+    size_t num_columns = cursor->vtab->columns->count;
+    if (cursor->num_rows == cursor->rows_capacity) {
+        size_t capacity = cursor->rows_capacity ? 2 * cursor->rows_capacity : 64;
+        sqlite3_int64 *rowids = sqlite3_realloc64(cursor->rowids, capacity * sizeof(sqlite3_int64));
+        if (rowids)
+            cursor->rowids = rowids;
+        fmp_vtab_value_t *values = sqlite3_realloc64(cursor->values,
+                capacity * num_columns * sizeof(fmp_vtab_value_t) + 1);
+        if (values)
+            cursor->values = values;
+        if (!rowids || !values)
+            return -1;
+        cursor->rows_capacity = capacity;
+    }
+    fmp_vtab_value_t *row = &cursor->values[cursor->num_rows * num_columns];
+    for (size_t i = 0; i < num_columns; i++)
+        row[i].len = -1;
+    cursor->rowids[cursor->num_rows++] = rowid;
+    return 0;
+}
+
+static sqlite3_int64 find_row(fmp_vtab_cursor_t *cursor, sqlite3_int64 rowid) {
+    size_t lo = 0, hi = cursor->num_rows;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (cursor->rowids[mid] < rowid) {
+            lo = mid + 1;
+        } else if (cursor->rowids[mid] > rowid) {
+            hi = mid;
+        } else {
+            return mid;
+        }
+    }
+    return -1;
+}
+
+static int set_value(fmp_vtab_cursor_t *cursor, size_t row, int position, const char *value) {
+    size_t len = strlen(value);
+    if (cursor->data_len + len + 1 > cursor->data_capacity) {
+        size_t capacity = cursor->data_capacity ? 2 * cursor->data_capacity : 65536;
+        while (capacity < cursor->data_len + len + 1)
+            capacity *= 2;
+        char *data = sqlite3_realloc64(cursor->data, capacity);
+        if (!data)
+            return -1;
+        cursor->data = data;
+        cursor->data_capacity = capacity;
+    }
+    fmp_vtab_value_t *slot = &cursor->values[row * cursor->vtab->columns->count + position];
+    slot->offset = cursor->data_len;
+    slot->len = len;
+    memcpy(cursor->data + cursor->data_len, value, len + 1);
+    cursor->data_len += len + 1;
+    return 0;
+}
+
+static int column_used(fmp_vtab_cursor_t *cursor, int position) {
+    return (cursor->columns_used >> (position < 63 ? position : 63)) & 1;
+}
+
+/* Records come in rowid order, so the scan can stop after max_row */
+static fmp_handler_status_t handle_value(int row, fmp_column_t *column, const char *value, void *ctxp) {
+    fmp_vtab_cursor_t *cursor = (fmp_vtab_cursor_t *)ctxp;
+    if (row < cursor->min_row)
+        return FMP_HANDLER_OK;
+    if (row > cursor->max_row)
+        return FMP_HANDLER_ABORT;
+
+    sqlite3_int64 index;
+    if (cursor->num_rows == 0 || row > cursor->rowids[cursor->num_rows-1]) {
+        if (cursor->stop_after >= 0 && (sqlite3_int64)cursor->num_rows >= cursor->stop_after)
+            return FMP_HANDLER_ABORT;
+        if (add_row(cursor, row) != 0) {
+            cursor->error = SQLITE_NOMEM;
+            return FMP_HANDLER_ABORT;
+        }
+        index = cursor->num_rows - 1;
+    } else if ((index = find_row(cursor, row)) < 0) {
+        return FMP_HANDLER_OK;
+    }
+
+    int position = column->index < cursor->vtab->num_indexes ? cursor->vtab->positions[column->index] : -1;
+    if (position < 0 || !column_used(cursor, position))
+        return FMP_HANDLER_OK;
+    if (set_value(cursor, index, position, value) != 0) {
+        cursor->error = SQLITE_NOMEM;
+        return FMP_HANDLER_ABORT;
+    }
+    return FMP_HANDLER_OK;
+}
+
+/* Narrows [min_row, max_row] the way SQLite compares an integer rowid to
+ * the value, including NUMERIC affinity for text */
+static void apply_rowid_constraint(fmp_vtab_cursor_t *cursor, char op, sqlite3_value *value) {
+    int type = sqlite3_value_numeric_type(value);
+    sqlite3_int64 lo = INT64_MIN, hi = INT64_MAX;
+    int none = 0;
+
+    if (type == SQLITE_NULL) {
+        none = 1;
+    } else if (type == SQLITE_INTEGER) {
+        sqlite3_int64 v = sqlite3_value_int64(value);
+        switch (op) {
+        case OP_EQ: lo = hi = v; break;
+        case OP_GT: if (v == INT64_MAX) none = 1; else lo = v + 1; break;
+        case OP_GE: lo = v; break;
+        case OP_LT: if (v == INT64_MIN) none = 1; else hi = v - 1; break;
+        case OP_LE: hi = v; break;
+        }
+    } else if (type == SQLITE_FLOAT) {
+        double v = sqlite3_value_double(value);
+        double floor_v = floor(v), ceil_v = ceil(v);
+        /* Record numbers fit comfortably in a double */
+        if (floor_v > 9e15 || ceil_v < -9e15) {
+            none = (v > 0) == (op == OP_GT || op == OP_GE || op == OP_EQ);
+        } else {
+            switch (op) {
+            case OP_EQ: if (floor_v != v) none = 1; else lo = hi = v; break;
+            case OP_GT: lo = floor_v + 1; break;
+            case OP_GE: lo = ceil_v; break;
+            case OP_LT: hi = ceil_v - 1; break;
+            case OP_LE: hi = floor_v; break;
+            }
+        }
+    } else {
+        /* Text and blobs sort after every number */
+        none = (op == OP_EQ || op == OP_GT || op == OP_GE);
+    }
+
+    if (none) {
+        cursor->min_row = 1;
+        cursor->max_row = 0;
+        return;
+    }
+    if (lo > cursor->min_row)
+        cursor->min_row = lo;
+    if (hi < cursor->max_row)
+        cursor->max_row = hi;
+}
+
+static int fmp_vtab_filter(sqlite3_vtab_cursor *pCursor, int idxNum, const char *idxStr,
+        int argc, sqlite3_value **argv) {
+    fmp_vtab_cursor_t *cursor = (fmp_vtab_cursor_t *)pCursor;
+    fmp_vtab_t *vtab = cursor->vtab;
+    sqlite3_int64 limit = -1, offset = 0;
+
+    cursor->num_rows = 0;
+    cursor->data_len = 0;
+    cursor->pos = 0;
+    cursor->error = SQLITE_OK;
+    cursor->min_row = INT64_MIN;
+    cursor->max_row = INT64_MAX;
+
+    const char *colon = strchr(idxStr, ':');
+    cursor->columns_used = strtoull(colon + 1, NULL, 16);
+    for (int i = 0; i < argc && idxStr + i < colon; i++) {
+        char op = idxStr[i];
+        if (op == OP_LIMIT) {
+            limit = sqlite3_value_int64(argv[i]);
+        } else if (op == OP_OFFSET) {
+            offset = sqlite3_value_int64(argv[i]);
+        } else {
+            apply_rowid_constraint(cursor, op, argv[i]);
+        }
+    }
+    cursor->stop_after = limit >= 0 ? limit + (offset > 0 ? offset : 0) : -1;
+
+    if (cursor->min_row > cursor->max_row || cursor->stop_after == 0)
+        return SQLITE_OK;
+
+    fmp_error_t error = fmp_read_values(vtab->file, vtab->table, &handle_value, cursor);
+    if (cursor->error)
+        return cursor->error;
+    if (error != FMP_OK && error != FMP_ERROR_USER_ABORTED) {
+        sqlite3_free(vtab->base.zErrMsg);
+        vtab->base.zErrMsg = sqlite3_mprintf("fmp: error %d reading %s", error, vtab->table->utf8_name);
+        return SQLITE_ERROR;
+    }
+    return SQLITE_OK;
+}
+
+static int fmp_vtab_next(sqlite3_vtab_cursor *pCursor) {
+    ((fmp_vtab_cursor_t *)pCursor)->pos++;
+    return SQLITE_OK;
+}
+
+static int fmp_vtab_eof(sqlite3_vtab_cursor *pCursor) {
+    fmp_vtab_cursor_t *cursor = (fmp_vtab_cursor_t *)pCursor;
+    return cursor->pos >= cursor->num_rows;
+}
+
+/* Numbers come back natively and dates/times as ISO-8601 text; anything
+ * that doesn't parse comes back as the original text */
+static int fmp_vtab_column(sqlite3_vtab_cursor *pCursor, sqlite3_context *ctx, int i) {
+    fmp_vtab_cursor_t *cursor = (fmp_vtab_cursor_t *)pCursor;
+    fmp_column_t *column = &cursor->vtab->columns->columns[i];
+    fmp_vtab_value_t *slot = &cursor->values[cursor->pos * cursor->vtab->columns->count + i];
+    if (slot->len < 0)
+        return SQLITE_OK;
+
+    const char *value = cursor->data + slot->offset;
+    fmp_value_t parsed;
+    char iso[64];
+    if (column->type == FMP_COLUMN_TYPE_TEXT || column->type == FMP_COLUMN_TYPE_UNKNOWN) {
+        sqlite3_result_text(ctx, value, slot->len, SQLITE_TRANSIENT);
+        return SQLITE_OK;
+    }
+    switch (fmp_parse_value(column->type, value, &parsed)) {
+    case FMP_VALUE_INTEGER:
+        sqlite3_result_int64(ctx, parsed.integer);
+        break;
+    case FMP_VALUE_REAL:
+        sqlite3_result_double(ctx, parsed.real);
+        break;
+    case FMP_VALUE_DATE:
+    case FMP_VALUE_TIME:
+    case FMP_VALUE_TIMESTAMP:
+        fmp_format_value(&parsed, iso, sizeof(iso));
+        sqlite3_result_text(ctx, iso, -1, SQLITE_TRANSIENT);
+        break;
+    default:
+        sqlite3_result_text(ctx, value, slot->len, SQLITE_TRANSIENT);
+        break;
+    }
+    return SQLITE_OK;
+}
+
+static int fmp_vtab_rowid(sqlite3_vtab_cursor *pCursor, sqlite3_int64 *pRowid) {
+    fmp_vtab_cursor_t *cursor = (fmp_vtab_cursor_t *)pCursor;
+    *pRowid = cursor->rowids[cursor->pos];
+    return SQLITE_OK;
+}
+
+static sqlite3_module fmp_module = {
+    .iVersion = 0,
+    .xCreate = fmp_vtab_connect,
+    .xConnect = fmp_vtab_connect,
+    .xBestIndex = fmp_vtab_best_index,
+    .xDisconnect = fmp_vtab_disconnect,
+    .xDestroy = fmp_vtab_disconnect,
+    .xOpen = fmp_vtab_open,
+    .xClose = fmp_vtab_close,
+    .xFilter = fmp_vtab_filter,
+    .xNext = fmp_vtab_next,
+    .xEof = fmp_vtab_eof,
+    .xColumn = fmp_vtab_column,
+    .xRowid = fmp_vtab_rowid
+};
+
+#ifdef _WIN32
+__declspec(dllexport)
+#endif
+int sqlite3_fmp_init(sqlite3 *db, char **pzErrMsg, const sqlite3_api_routines *pApi) {
+    SQLITE_EXTENSION_INIT2(pApi);
+    return sqlite3_create_module(db, "fmp", &fmp_module, NULL);
+}
@@ -0,0 +1,224 @@
+/* FMP Tools - A library for reading FileMaker Pro databases
+ * Copyright (c) 2020 Evan Miller (except where otherwise noted)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/* Typed interpretation of the UTF-8 strings handed to value handlers.
+ * FileMaker stores numbers, dates and times as the text that was entered,
+ * so these parse the common forms and report FMP_VALUE_TEXT for anything
+ * else; callers are expected to fall back to the original string. */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include "fmp.h"
+
+static const char *skip_spaces(const char *p) {
+    while (*p == ' ' || *p == '\t')
+        p++;
+    return p;
+}
+
+static int is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+static const char *parse_uint(const char *p, int max_digits, int *out) {
+    int n = 0, digits = 0;
+    while (is_digit(*p) && digits < max_digits) {
+        n = 10 * n + (*p++ - '0');
+        digits++;
+    }
+    if (!digits)
+        return NULL;
+    *out = n;
+    return p;
+}
+
+static int days_in_month(int year, int month) {
+    static const int days[] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+    if (month == 2 && (year % 4 == 0 && (year % 100 != 0 || year % 400 == 0)))
+        return 29;
+    return days[month-1];
+}
+
+/* M/D/YYYY as stored by FileMaker, or an already-normalized YYYY-MM-DD */
+static const char *parse_date(const char *p, fmp_value_t *value) {
+    int a, b, c;
+    const char *q = parse_uint(p, 4, &a);
+    if (!q)
+        return NULL;
+    if (*q == '-' && q - p == 4) {
+        if (!(q = parse_uint(q+1, 2, &b)) || *q != '-' || !(q = parse_uint(q+1, 2, &c)))
+            return NULL;
+        value->year = a; value->month = b; value->day = c;
+    } else if (*q == '/' && q - p <= 2) {
+        const char *year_start;
+        if (!(q = parse_uint(q+1, 2, &b)) || *q != '/')
+            return NULL;
+        year_start = q+1;
+        if (!(q = parse_uint(year_start, 4, &c)) || q - year_start != 4)
+            return NULL;
+        value->month = a; value->day = b; value->year = c;
+    } else {
+        return NULL;
+    }
+    if (value->month < 1 || value->month > 12 || value->year < 1 ||
+            value->day < 1 || value->day > days_in_month(value->year, value->month))
+        return NULL;
+    return q;
+}
+
+/* H:MM[:SS[.ffffff]] with an optional AM/PM suffix. Only times of day:
+ * durations of 24 hours or more stay text, since they have no ISO form */
+static const char *parse_time(const char *p, fmp_value_t *value) {
+    int h, m, s = 0, usec = 0;
+    const char *q = parse_uint(p, 2, &h);
+    if (!q || h > 23 || *q != ':' || !(q = parse_uint(q+1, 2, &m)) || m > 59)
+        return NULL;
+    if (*q == ':') {
+        if (!(q = parse_uint(q+1, 2, &s)) || s > 59)
+            return NULL;
+        if (*q == '.' && is_digit(q[1])) {
+            int scale = 100000;
+            for (q++; is_digit(*q); q++) {
+                usec += (*q - '0') * scale;
+                scale /= 10;
+            }
+        }
+    }
+    const char *r = skip_spaces(q);
+    if ((r[0] == 'A' || r[0] == 'a' || r[0] == 'P' || r[0] == 'p') && (r[1] == 'M' || r[1] == 'm')) {
+        if (h < 1 || h > 12)
+            return NULL;
+        if (h == 12)
+            h = 0;
+        if (r[0] == 'P' || r[0] == 'p')
+            h += 12;
+        q = r + 2;
+    }
+    value->hour = h; value->minute = m; value->second = s; value->usec = usec;
+    return q;
+}
+
+static fmp_value_type_t parse_number(const char *p, fmp_value_t *value) {
+    /* Only plain decimal notation; strtod would also take hex, inf and nan */
+    const char *q = p;
+    int digits = 0, is_real = 0;
+    if (*q == '-' || *q == '+')
+        q++;
+    for (; is_digit(*q); q++)
+        digits++;
+    if (*q == '.') {
+        is_real = 1;
+        for (q++; is_digit(*q); q++)
+            digits++;
+    }
+    if (!digits)
+        return FMP_VALUE_TEXT;
+    if (*q == 'e' || *q == 'E') {
+        is_real = 1;
+        q++;
+        if (*q == '-' || *q == '+')
+            q++;
+        if (!is_digit(*q))
+            return FMP_VALUE_TEXT;
+        while (is_digit(*q))
+            q++;
+    }
+    if (*skip_spaces(q))
+        return FMP_VALUE_TEXT;
+
+    char *end = NULL;
+    errno = 0;
+    if (!is_real) {
+        long long i = strtoll(p, &end, 10);
+        if (errno == 0) {
+            value->integer = i;
+            value->real = i;
+            return value->type = FMP_VALUE_INTEGER;
+        }
+    }
+    errno = 0;
+    value->real = strtod(p, &end);
+    if (errno == ERANGE)
+        return FMP_VALUE_TEXT;
+    return value->type = FMP_VALUE_REAL;
+}
+
+fmp_value_type_t fmp_parse_value(fmp_column_type_e type, const char *utf8_value, fmp_value_t *value) {
+    const char *p = skip_spaces(utf8_value);
+    memset(value, 0, sizeof(fmp_value_t));
+    value->type = FMP_VALUE_TEXT;
+
+    if (type == FMP_COLUMN_TYPE_NUMBER) {
+        return parse_number(p, value);
+    }
+    if (type == FMP_COLUMN_TYPE_DATE) {
+        if ((p = parse_date(p, value)) && !*skip_spaces(p))
+            value->type = FMP_VALUE_DATE;
+    } else if (type == FMP_COLUMN_TYPE_TIME) {
+        if ((p = parse_time(p, value)) && !*skip_spaces(p))
+            value->type = FMP_VALUE_TIME;
+    } else if (type == FMP_COLUMN_TYPE_TIMESTAMP) {
+        if ((p = parse_date(p, value)) && (*p == ' ' || *p == 'T') &&
+                (p = parse_time(skip_spaces(p+1), value)) && !*skip_spaces(p))
+            value->type = FMP_VALUE_TIMESTAMP;
+    }
+    return value->type;
+}
+
+size_t fmp_format_value(const fmp_value_t *value, char *dst, size_t dst_len) {
+    int len = 0;
+    char fraction[8] = "";
+    if (value->usec)
+        snprintf(fraction, sizeof(fraction), ".%06d", value->usec);
+
+    switch (value->type) {
+    case FMP_VALUE_INTEGER:
+        len = snprintf(dst, dst_len, "%lld", (long long)value->integer);
+        break;
+    case FMP_VALUE_REAL:
+        /* Shortest of %.15g / %.17g that survives a round trip */
+        len = snprintf(dst, dst_len, "%.15g", value->real);
+        if (len > 0 && len < dst_len && strtod(dst, NULL) != value->real)
+            len = snprintf(dst, dst_len, "%.17g", value->real);
+        break;
+    case FMP_VALUE_DATE:
+        len = snprintf(dst, dst_len, "%04d-%02d-%02d", value->year, value->month, value->day);
+        break;
+    case FMP_VALUE_TIME:
+        len = snprintf(dst, dst_len, "%02d:%02d:%02d%s",
+                value->hour, value->minute, value->second, fraction);
+        break;
+    case FMP_VALUE_TIMESTAMP:
+        len = snprintf(dst, dst_len, "%04d-%02d-%02dT%02d:%02d:%02d%s",
+                value->year, value->month, value->day,
+                value->hour, value->minute, value->second, fraction);
+        break;
+    default:
+        if (dst_len)
+            dst[0] = '\0';
+        break;
+    }
+    return len < 0 ? 0 : len;
+}
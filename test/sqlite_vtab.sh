@@ -0,0 +1,38 @@
+#!/bin/sh
+# Checks that LIMIT and OFFSET pushed into the fmp virtual table agree with
+# SQLite applying them itself. Run by `make check`.
+
+DATA="${srcdir:-.}/test/data/fmp12/FMburgh_2012_11_07_Database.fmp12"
+EXTENSION="${builddir:-.}/.libs/fmp"
+
+command -v sqlite3 >/dev/null || exit 77
+
+query() {
+    sqlite3 :memory: ".load $EXTENSION" \
+        "CREATE VIRTUAL TABLE t USING fmp('$DATA', 'Orders_Schema');" "$1"
+}
+
+status=0
+check() {
+    expected=$(query "$1" | sed -n "$3")
+    actual=$(query "$2")
+    if [ "$expected" != "$actual" ]; then
+        echo "FAIL: $2"
+        echo "expected: $expected"
+        echo "actual:   $actual"
+        status=1
+    fi
+}
+
+check "SELECT rowid FROM t ORDER BY rowid DESC" \
+    "SELECT rowid FROM t ORDER BY rowid DESC LIMIT 2" 1,2p
+check "SELECT WidthActual FROM t ORDER BY WidthActual DESC" \
+    "SELECT WidthActual FROM t ORDER BY WidthActual DESC LIMIT 3" 1,3p
+check "SELECT WidthActual FROM t ORDER BY WidthActual DESC" \
+    "SELECT WidthActual FROM t ORDER BY WidthActual DESC LIMIT 3 OFFSET 2" 3,5p
+check "SELECT rowid FROM t ORDER BY rowid" \
+    "SELECT rowid FROM t ORDER BY rowid LIMIT 2 OFFSET 5" 6,7p
+check "SELECT rowid FROM t" \
+    "SELECT rowid FROM t LIMIT 2 OFFSET 5" 6,7p
+
+exit $status